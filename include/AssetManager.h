@@ -0,0 +1,57 @@
+/**************************************************
+AssetManager loads every obj file once and shares the
+resulting Obj between all the models that show it.
+
+ AssetManager assets;
+ scene.add(assets.acquire("models/teapot.obj"), a); // loads
+ scene.add(assets.acquire("models/teapot.obj"), b); // shares
+
+The scene (see SceneStore) only holds a reference to the
+shared mesh per object.  The manager itself keeps weak
+references, so the vertex array and buffers of a mesh
+are released as soon as the last object using it is
+removed.
+
+acquireAsync() returns at once with a mesh that is not
+ready yet, and queues it on the manager's AsyncLoader;
+loader.pump() has to be called every frame to finish it.
+A mesh whose load failed is not shared: the next
+acquireAsync() of its file tries again.
+Files above options.streamingThresholdMB are loaded by
+StreamedObj instead (in the background as well, with
+acquireAsync).
+*****************************************************/
+#include <memory>
+#include <string>
+#include <unordered_map>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "AsyncLoader.h"
+#include "Obj.h"
+
+#ifndef __ASSET_MANAGER_H__
+#define __ASSET_MANAGER_H__
+
+class AssetManager {
+public:
+    ObjLoadOptions options; // used for every mesh loaded by the manager
+
+    AsyncLoader loader;     // background loads started by acquireAsync
+
+    // Returns the mesh of filename, loading it if no instance uses it yet
+    std::shared_ptr<Obj> acquire(const char* filename);
+
+    // Same as acquire, but a mesh that is not loaded yet is queued on the
+    // loader with the given priority (or moved to it, if already queued)
+    std::shared_ptr<Obj> acquireAsync(const char* filename, int priority);
+
+    // Number of meshes currently alive
+    size_t meshCount() const;
+
+private:
+    std::shared_ptr<Obj> createMesh(const char* filename) const;
+
+    std::unordered_map<std::string, std::weak_ptr<Obj>> meshes_;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/**************************************************
+AsyncLoader loads obj files in the background.
+
+Loading is split in two halves:
+ - worker threads run Obj::load (parsing, welding,
+   cache handling) or StreamedObj::load, which do not
+   touch GL;
+ - the GL thread calls pump() once per frame, which
+   copies finished meshes into their buffers through
+   mapped ranges, never more than a given number of
+   bytes per frame, so big meshes are spread over
+   several frames instead of stalling one.
+
+Until its upload completes a mesh has ready == false,
+and the caller can draw a placeholder instead.  A mesh
+whose file cannot be loaded gets failed == true in
+pump(), which also reports it; it never becomes ready.
+
+Every request has a priority; workers and uploads
+always take the highest one first.  Requests can be
+re-prioritised or cancelled while they are pending,
+and a request is dropped on its own once nothing
+references its mesh any more.
+*****************************************************/
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Obj.h"
+
+#ifndef __ASYNC_LOADER_H__
+#define __ASYNC_LOADER_H__
+
+class AsyncLoader {
+public:
+    explicit AsyncLoader(unsigned int threadCount = 2) : threadCount_(threadCount) {}
+    ~AsyncLoader();
+
+    AsyncLoader(const AsyncLoader&) = delete;
+    AsyncLoader& operator=(const AsyncLoader&) = delete;
+
+    // Queues filename to be loaded into mesh
+    void request(const std::shared_ptr<Obj>& mesh, const std::string& filename,
+                 const ObjLoadOptions& options, int priority);
+    void prioritize(const Obj* mesh, int priority);
+    void cancel(const Obj* mesh);
+    void cancelAll();
+
+    // Uploads finished meshes, copying at most budgetBytes.
+    // Must be called on the GL thread. Returns the bytes copied.
+    size_t pump(size_t budgetBytes);
+
+    // Requests that are queued, loading or uploading
+    size_t pendingCount() const;
+    // Loads that failed so far (reported by pump())
+    size_t failedCount() const { return failedCount_; }
+
+private:
+    struct Job {
+        std::weak_ptr<Obj> mesh;
+        const Obj* key;        // identifies the job after the mesh is gone
+        std::string filename;
+        ObjLoadOptions options;
+        bool streamed;         // loaded by StreamedObj::load
+        int priority;
+        uint64_t sequence;     // orders requests of the same priority
+        std::atomic<bool> cancelled{ false };
+        bool ok = false;
+        ObjLoadResult result;
+    };
+
+    void workerLoop();
+    static std::shared_ptr<Job> takeBest(std::vector<std::shared_ptr<Job>>& jobs);
+
+    unsigned int threadCount_;
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<std::shared_ptr<Job>> queued_;   // waiting for a worker
+    std::vector<std::shared_ptr<Job>> finished_; // loaded, waiting for upload
+    std::vector<std::shared_ptr<Job>> failed_;   // not loaded, waiting for pump() to report them
+    std::shared_ptr<Job> uploading_;             // being uploaded (GL thread only)
+    std::vector<std::shared_ptr<Job>> loading_;  // held by a worker
+    uint64_t sequence_ = 0;
+    size_t failedCount_ = 0; // GL thread only
+    bool stopping_ = false;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/**************************************************
+BatchMath transforms many matrices and boxes per call,
+for per-frame work on thousands of objects.  The data
+is kept as structure-of-arrays (FloatArrays): one array
+per matrix element or coordinate, so four objects are
+processed per SSE instruction instead of one matrix per
+handful of instructions.
+
+ multiply        a * m[i] for one affine a (the view)
+                 and n affine matrices, or only for the
+                 matrices m[indices[k]] (the visible
+                 objects of a scene)
+ inverse         inverse of n affine matrices, from the
+                 3x3 cofactors (no general 4x4 inverse)
+ transformBoxes  world space boxes around n object space
+                 boxes (Arvo: center and extent)
+ fromTransforms  affine matrices from positions,
+                 quaternion rotations and scales
+
+Affine matrices have the last row 0 0 0 1, so only the
+first three rows are stored: component row * 4 + column.
+Every function has a scalar version with the same
+arguments (...Scalar) that is the reference for the SSE
+one and runs on CPUs without SSE.
+
+benchmark() compares them with glm::mat4 one by one and
+with glm's SSE matrix product (glm/simd/matrix.h):
+
+ ModelViewer --bench-math
+*****************************************************/
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#ifndef __BATCH_MATH_H__
+#define __BATCH_MATH_H__
+
+// Components arrays of size() floats in one allocation.  Every array
+// starts on a 32-byte boundary and is padded to a multiple of 8 floats,
+// so SIMD loops may read and write up to the padding.  The allocation
+// only grows (to twice its capacity at least), so arrays that are resized
+// every frame are not copied every frame.
+template <int Components>
+class FloatArrays {
+public:
+    FloatArrays() = default;
+    FloatArrays(const FloatArrays&) = delete;
+    FloatArrays& operator=(const FloatArrays&) = delete;
+
+    // Keeps the first min(n, size()) entries; the ones after them hold 0
+    // or values left from a larger size
+    void resize(size_t n);
+    size_t size() const { return size_; }
+    size_t padded() const { return padded_; }
+
+    float* operator[](int component) { return data_[component]; }
+    const float* operator[](int component) const { return data_[component]; }
+
+private:
+    std::vector<float> storage_;
+    float* data_[Components] = {};
+    size_t size_ = 0;
+    size_t padded_ = 0;
+    size_t capacity_ = 0; // floats per array, a multiple of 8
+};
+
+using AffineArrays = FloatArrays<12>;    // rows 0 .. 2 of 4x4 matrices
+using BoxArrays = FloatArrays<6>;        // min x, y, z, max x, y, z
+using TransformArrays = FloatArrays<10>; // position xyz, rotation xyzw, scale xyz
+
+class BatchMath {
+public:
+    // Components of BoxArrays and TransformArrays
+    enum { MIN_X, MIN_Y, MIN_Z, MAX_X, MAX_Y, MAX_Z };
+    enum { POSITION_X = 0, ROTATION_X = 3, SCALE_X = 7 };
+
+    static void store(AffineArrays& arrays, size_t i, const glm::mat4& matrix);
+    static glm::mat4 load(const AffineArrays& arrays, size_t i);
+
+    // out = a * m, for the first n entries (out grows to n if needed, and
+    // may be m)
+    static void multiply(const glm::mat4& a, const AffineArrays& m, AffineArrays& out, size_t n);
+    // out[k] = a * m[indices[k]], for k < n (out may not be m)
+    static void multiply(const glm::mat4& a, const AffineArrays& m, const uint32_t* indices, AffineArrays& out, size_t n);
+    static void inverse(const AffineArrays& m, AffineArrays& out, size_t n);
+    static void transformBoxes(const AffineArrays& m, const BoxArrays& boxes, BoxArrays& out, size_t n);
+    static void fromTransforms(const TransformArrays& transforms, AffineArrays& out, size_t n);
+
+    static void multiplyScalar(const glm::mat4& a, const AffineArrays& m, AffineArrays& out, size_t n);
+    static void multiplyScalar(const glm::mat4& a, const AffineArrays& m, const uint32_t* indices, AffineArrays& out,
+                               size_t n);
+    static void inverseScalar(const AffineArrays& m, AffineArrays& out, size_t n);
+    static void transformBoxesScalar(const AffineArrays& m, const BoxArrays& boxes, BoxArrays& out, size_t n);
+    static void fromTransformsScalar(const TransformArrays& transforms, AffineArrays& out, size_t n);
+
+    // Runs the kernels on 100k objects and prints the timings; returns 0
+    static int benchmark();
+};
+
+template <int Components>
+void FloatArrays<Components>::resize(size_t n) {
+    size_t padded = (n + 7) & ~size_t(7);
+    if (padded > capacity_) {
+        // 8 floats of slack to align the first array
+        size_t capacity = std::max(padded, capacity_ * 2);
+        std::vector<float> storage(capacity * Components + 8, 0.0f);
+        uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+        float* first = storage.data() + ((32 - address % 32) % 32) / sizeof(float);
+        size_t keep = std::min(n, size_);
+        for (int c = 0; c < Components; c++) {
+            float* array = first + c * capacity;
+            for (size_t i = 0; i < keep; i++)
+                array[i] = data_[c][i];
+            data_[c] = array;
+        }
+        storage_.swap(storage);
+        capacity_ = capacity;
+    }
+    padded_ = padded;
+    size_ = n;
+}
+
+#endif
@@ -52,26 +52,26 @@ public:
         glGenVertexArrays(1, &vao );
         buffers.resize(3); // recall that buffers is std::vector<GLuint>
         glGenBuffers(3, buffers.data());
-        glBindVertexArray(vao);
+        GLState::bindVertexArray(vao);
         
         // 0th attribute: position
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, buffers[0]);
         glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,(void*)0);
         
         // 1st attribute: normal
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, buffers[1]);
         glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,0,(void*)0);
         
         // indices
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+        GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
         
         count = sizeof(indices)/sizeof(indices[0]);
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
     }
     
     
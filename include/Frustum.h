@@ -21,7 +21,7 @@ public:
         }
     }
 
-    bool isInFrustum(const glm::vec3& position, float radius) {
+    bool isInFrustum(const glm::vec3& position, float radius) const {
         for (int i = 0; i < 6; i++) {
             // Check if the sphere is outside any of the frustum planes
             if (glm::dot(glm::vec3(planes[i]), position) + planes[i].w < -radius) {
@@ -0,0 +1,96 @@
+/**************************************************
+FrustumCuller tests many objects against a Frustum at
+once.  The world space bounds of every object are kept
+as structure-of-arrays (one array per component), so
+four objects are tested per SSE instruction, or eight
+per AVX instruction when the CPU supports it (checked
+at run time, so no compiler flags are needed):
+
+ 1. every object first re-tests the plane that rejected
+    it in the last frame; the others are appended to a
+    list of survivors (through a lookup table from the
+    movemask, without a branch per object);
+ 2. the bounding spheres of the survivors, gathered
+    four or eight at a time, are tested against the six
+    planes;
+ 3. only survivors whose sphere straddles a plane get
+    the tighter box test.
+
+While the camera moves smoothly, most hidden objects stop
+at step 1, so steps 2 and 3 cost about as much as the
+visible objects.
+
+ FrustumCuller culler;
+ culler.resize(n);
+ culler.setBounds(i, model, boundsMin, boundsMax);
+ // or, for objects that rarely move:
+ culler.updateBounds(i, transform.version(), transform.world(), ...);
+ culler.cull(frustum);
+ if (culler.visible[i]) ...
+
+Without SSE the same steps run one object at a time
+(cullScalar(), which computes the same sums in the same
+order).  benchmark() times every path on a moving
+camera and checks that each frame gives the same result
+as cullScalar():
+
+ ModelViewer --bench-culling
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+#ifndef __FRUSTUM_CULLER_H__
+#define __FRUSTUM_CULLER_H__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+class FrustumCuller {
+public:
+    // World space bounding spheres
+    std::vector<float> centerX, centerY, centerZ, radius;
+    // World space bounding boxes
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    // Version of the transform the bounds were computed from (0: none)
+    std::vector<uint64_t> boundsVersion;
+    // Plane that last rejected each object (0 .. 5), kept between frames
+    std::vector<uint8_t> lastPlane;
+    // Result of the last cull: 1 if the object may be visible
+    std::vector<uint8_t> visible;
+
+    bool useAvx = true; // ignored when the CPU has no AVX
+
+    static bool avxSupported();
+
+    size_t size() const { return count_; }
+
+    // Keeps the bounds of the first n objects (and their last planes)
+    void resize(size_t n);
+
+    // Bounds of object i from its object space box and model matrix
+    void setBounds(size_t i, const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    // The same, skipped if the bounds were already computed from version
+    // (see Transform::version)
+    void updateBounds(size_t i, uint64_t version, const glm::mat4& model, const glm::vec3& boundsMin,
+                      const glm::vec3& boundsMax);
+
+    // Fills visible and returns the number of visible objects
+    size_t cull(const Frustum& frustum);
+    // The same, one object at a time (the reference for the SIMD paths)
+    size_t cullScalar(const Frustum& frustum);
+
+    // Culls 100k random objects with every path, prints the timings and
+    // mismatches; returns 0, or 1 if the paths disagree
+    static int benchmark();
+
+private:
+    size_t count_ = 0;
+    std::vector<uint32_t> survivors_; // of step 1, tested by steps 2 and 3
+};
+
+#endif
@@ -0,0 +1,59 @@
+/**************************************************
+GBuffer is the render target of the deferred path: the
+opaque draws write what lighting needs to know about
+each pixel, and a screen-space pass lights every pixel
+once, however many draws covered it.
+
+ attachment  format       content
+ color 0     RG16         view space normal, octahedral
+                          encoding mapped to 0 .. 1
+ color 1     RGBA8        albedo (rgb) and flags (a: 1
+                          where geometry was drawn)
+ depth       DEPTH24      the view space position is
+                          reconstructed from it and
+                          the projection
+
+12 bytes per pixel.  The textures follow the viewport:
+resize() recreates them when its size changes.
+
+ gbuffer.resize(w, h);
+ gbuffer.bind();           // and clear
+ ... opaque draws with gbuffer.frag ...
+ GBuffer::unbind();
+ gbuffer.bindTextures(unit);
+ ... full screen pass with deferred.frag ...
+*****************************************************/
+#include <cstddef>
+
+#ifndef __G_BUFFER_H__
+#define __G_BUFFER_H__
+
+class GBuffer {
+public:
+    static constexpr size_t bytesPerPixel = 12;
+
+    // (Re)creates the textures for a viewport of width x height; false
+    // if the framebuffer is not complete (then valid() is false as well)
+    bool resize(int width, int height);
+    bool valid() const { return valid_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Makes it the framebuffer and clears it (no geometry, far depth)
+    void bind() const;
+    // Back to the window's framebuffer
+    static void unbind();
+    // normal, albedo and depth on firstUnit .. firstUnit + 2
+    void bindTextures(GLuint firstUnit) const;
+
+    // Deletes the framebuffer and textures (needs a current GL context)
+    void release();
+
+private:
+    GLuint framebuffer_ = 0;
+    GLuint textures_[3] = {}; // normal, albedo, depth
+    int width_ = 0, height_ = 0;
+    bool valid_ = false;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/**************************************************
+GLState sits between our code and the GL calls that
+change bindings and fixed-function state.  It remembers
+what was last set and skips calls that would set the
+same value again:
+
+ GLState::useProgram(shader.program);
+ GLState::bindVertexArray(vao);      // once per mesh,
+ glDrawElements(...);                // not once per draw
+
+Covered are the program, the vertex array, the buffer
+bindings (generic and indexed uniform blocks), polygon
+mode, depth test / depth mask / depth function, color
+mask, blending and 2D textures per texture unit.  The element array
+binding belongs to the vertex array, so it is forgotten
+whenever the vertex array changes.
+
+Code that changes this state without GLState (ImGui's
+renderer) has to be followed by invalidate(), after
+which every value is unknown and the next call is
+issued.  Buffers and vertex arrays must be deleted
+through GLState, since GL unbinds deleted objects and
+recycles their names.
+
+issued() and skipped() count the calls since the last
+resetCounters(), i.e. per frame.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+class GLState {
+public:
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void polygonMode(GLenum mode); // for GL_FRONT_AND_BACK
+    static void enable(GLenum capability, bool enabled = true); // GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE
+    static void disable(GLenum capability) { enable(capability, false); }
+    static void depthMask(bool write);
+    static void depthFunc(GLenum func);
+    static void colorMask(bool write); // all four channels
+    static void blendFunc(GLenum source, GLenum destination);
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    // Deletes objects and forgets the bindings that referred to them
+    static void deleteBuffers(GLsizei n, const GLuint* buffers);
+    static void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+
+    // Forgets everything, after GL state was changed behind our back
+    static void invalidate();
+
+    static size_t issued() { return issued_; }
+    static size_t skipped() { return skipped_; }
+    static void resetCounters() { issued_ = skipped_ = 0; }
+
+private:
+    static size_t issued_;
+    static size_t skipped_;
+
+    // Counts a call; true if it has to be issued
+    static bool change(uint32_t& cached, uint32_t value);
+};
+
+#endif
@@ -16,7 +16,8 @@ Geometry is an abstract class for a geometric object.
  
 which should explain the purpose of those class members.
  We can also just call the "draw()" member function, which
- is equivalent to the commands above.
+ is equivalent to the commands above (the bind goes through
+ GLState, so it is skipped when the array is already bound).
  
 The array of buffers is encapsulated in std::vector so
 we do not need to manually allocate/free the memory for
@@ -25,6 +26,7 @@ arrays of unknown size.
 #include <vector>
 #define GLM_FORCE_RADIANS
 #include <glm/gtc/matrix_transform.hpp>
+#include "GLState.h"
 
 #ifndef __GEOMETRY_H__
 #define __GEOMETRY_H__
@@ -32,42 +34,33 @@ arrays of unknown size.
 class Geometry {
 public:
     GLenum mode = GL_TRIANGLES; // the cookboook for glDrawElements
-    int count; // number of elements to draw
+    int count = 0; // number of elements to draw
     GLenum type = GL_UNSIGNED_INT; // type of the index array
-    GLuint vao; // vertex array object a.k.a. geometry spreadsheet
+    GLuint vao = 0; // vertex array object a.k.a. geometry spreadsheet
     std::vector<GLuint> buffers; // data storage
+    glm::vec3 boundsMin = glm::vec3(-0.5f); // object space bounding box
+    glm::vec3 boundsMax = glm::vec3(0.5f);
+    glm::vec3 positionScale = glm::vec3(1.0f); // decoding of quantized positions:
+    glm::vec3 positionBias = glm::vec3(0.0f);  // bias + attribute * scale
     
+    virtual ~Geometry(){};
     virtual void init(){};
     virtual void init(const char* s){};
-    
-    glm::mat4 model = glm::mat4(1.0f);   // model matrix
-
-
-    // Model translation
-    void translate(const float tx, const float ty, const float tz) {
-        model = glm::translate(model, glm::vec3(tx, ty, tz));
-    }
-    
-    void rotateX(const float degrees) {
-        model = glm::rotate(model, glm::radians(degrees), glm::vec3(1.0f, 0.0f, 0.0f));
-    }
-
-    void rotateY(const float degrees) {
-        model = glm::rotate(model, glm::radians(degrees), glm::vec3(0.0f, 1.0f, 0.0f));
-    }
-
-    void rotateZ(const float degrees) {
-        model = glm::rotate(model, glm::radians(degrees), glm::vec3(0.0f, 0.0f, 1.0f));
-    }
-
 
-    void reset(void) {
-        model = glm::mat4(1.0f);
+    // Frees the vertex array and buffers (needs a current GL context)
+    virtual void release(void) {
+        if (!buffers.empty())
+            GLState::deleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+        buffers.clear();
+        if (vao)
+            GLState::deleteVertexArrays(1, &vao);
+        vao = 0;
+        count = 0;
     }
 
 
-    void draw(void){
-        glBindVertexArray(vao);
+    virtual void draw(void){
+        GLState::bindVertexArray(vao);
 
         glDrawElements(mode,count,type,0);
     }
@@ -0,0 +1,114 @@
+/**************************************************
+GeometryPool keeps the vertices and indices of many
+meshes in a few large buffers, so that they can all be
+drawn by one glMultiDrawElementsIndirect call instead
+of one vertex array bind and one draw per mesh.
+
+Meshes with the same vertex layout and index type share
+one storage: one buffer per vertex stream, one index
+buffer and one vertex array.  Every mesh gets a range
+of vertices and a range of indices in its storage; the
+ranges are suballocated first-fit, freed ranges are
+merged with their neighbours, and a full storage is
+grown by copying it into buffers twice as large.
+
+add() copies a mesh that is already on the GPU with
+glCopyBufferSubData, so meshes keep their own buffers
+for the other draw paths.  A draw command of a pooled
+mesh then uses
+
+ firstIndex = entry.firstIndex + lod.first
+ baseVertex = entry.baseVertex
+
+The pool needs OpenGL 4.3 or ARB_multi_draw_indirect,
+and 4.2 or ARB_base_instance (the baseInstance of each
+command selects its slice of the instance buffer);
+supported() tells whether the context has them.
+
+Only the meshes of InstanceRenderer's groups are pooled,
+i.e. the loaded models drawn without an occlusion query.
+The built-in models (translucent, with their own colors),
+the placeholder boxes (drawn as lines), models tested by
+an occlusion query and StreamedObj meshes (several vertex
+arrays) keep their own draws, so the opaque scene takes
+one multi-draw per storage plus those draws.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "Obj.h"
+
+#ifndef __GEOMETRY_POOL_H__
+#define __GEOMETRY_POOL_H__
+
+// Command layout read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Place of one mesh in the pool
+struct PoolEntry {
+    uint32_t storage;     // storage holding the mesh
+    uint32_t baseVertex;  // first vertex of the mesh in that storage
+    uint32_t vertexCount;
+    uint32_t firstIndex;  // first index of the mesh in that storage
+    uint32_t indexCount;
+    Obj* mesh;            // null for unused entries
+};
+
+class GeometryPool {
+public:
+    // True if the context can draw from the pool
+    static bool supported();
+
+    // Copies the buffers of a mesh that is ready into the pool and sets
+    // mesh.pool; returns false for meshes without a single vertex array
+    bool add(Obj& mesh);
+    // Frees the ranges of a mesh (Obj::release calls it)
+    void remove(Obj& mesh);
+    bool contains(const Obj& mesh) const { return mesh.pool == this; }
+
+    const PoolEntry& entry(const Obj& mesh) const { return entries_[mesh.poolSlot]; }
+    size_t storageCount() const { return storages_.size(); }
+    GLuint vertexArray(uint32_t storage) const { return storages_[storage].vao; }
+    GLenum indexType(uint32_t storage) const { return storages_[storage].layout.indexType; }
+    size_t meshCount() const { return entries_.size() - freeSlots_.size(); }
+    // Bytes of GPU memory held by the pool
+    size_t capacityBytes() const;
+
+    // Frees all storages and detaches the meshes still in them
+    // (needs a current GL context)
+    void release();
+
+private:
+    // First-fit allocator of element ranges
+    struct RangeAllocator {
+        std::map<uint32_t, uint32_t> free; // offset -> size
+        uint32_t capacity = 0;
+
+        bool allocate(uint32_t size, uint32_t& offset);
+        void deallocate(uint32_t offset, uint32_t size);
+        void grow(uint32_t newCapacity);
+    };
+
+    struct Storage {
+        MeshView layout;  // vertex layout and index type, without data
+        GLuint vao = 0;
+        std::vector<GLuint> buffers; // vertex streams, then the indices
+        RangeAllocator vertices, indices;
+    };
+
+    std::vector<Storage> storages_;
+    std::vector<PoolEntry> entries_;
+    std::vector<uint32_t> freeSlots_; // unused entries_
+
+    uint32_t findStorage(const MeshView& layout);
+    void resize(Storage& storage, uint32_t vertexCapacity, uint32_t indexCapacity);
+};
+
+#endif
@@ -0,0 +1,63 @@
+/**************************************************
+GpuTimer measures how long the GPU takes for the
+commands between begin() and end(), with GL_TIME_ELAPSED
+queries, without waiting for the results.
+
+Each begin() / end() pair uses the next query of a small
+ring; begin() first reads the queries that have finished
+(usually those of a few frames earlier), so
+milliseconds() lags the current frame slightly.  When
+every query of the ring is still pending, the frame is
+not measured.
+
+ timer.begin();
+ ... draw ...
+ timer.end();
+ ImGui::Text("%.3f ms", timer.milliseconds());
+
+Only one GL_TIME_ELAPSED query can be active at a time,
+so timers must not be nested.
+
+A GpuTimer made with GL_SAMPLES_PASSED counts the samples
+that pass the depth test instead (result()).  Such a
+count cannot overlap the GL_ANY_SAMPLES_PASSED queries of
+OcclusionQueries.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+
+#ifndef __GPU_TIMER_H__
+#define __GPU_TIMER_H__
+
+class GpuTimer {
+public:
+    static constexpr size_t latency = 4; // queries in flight
+
+    explicit GpuTimer(GLenum target = GL_TIME_ELAPSED) : target_(target) {}
+
+    void begin();
+    void end();
+
+    // The newest result (nanoseconds or samples), 0 until one has arrived
+    uint64_t result() const { return result_; }
+    double milliseconds() const { return result_ * 1e-6; }
+    bool hasResult() const { return hasResult_; }
+
+    // Forgets the results still in flight, e.g. when the measured
+    // commands change
+    void discard();
+
+    // Deletes the query objects (needs a current GL context)
+    void release();
+
+private:
+    GLuint queries_[latency] = {};
+    bool pending_[latency] = {};
+    size_t next_ = 0;
+    bool active_ = false;
+    bool hasResult_ = false;
+    GLenum target_;
+    uint64_t result_ = 0;
+};
+
+#endif
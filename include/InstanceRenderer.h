@@ -0,0 +1,116 @@
+/**************************************************
+InstanceRenderer draws every instance of a mesh (at one
+level of detail) with a single glDrawElementsInstanced
+call instead of one draw and one set of uniforms per
+instance.
+
+Each frame the visible instances are added with their
+model matrix, then upload() groups them by mesh and
+level, and writes one InstanceData per instance into a
+shared instance buffer.  draw() points the per-instance
+attributes of the mesh's vertex array at the group's
+slice of that buffer:
+
+ location 2..4  rows of the 3x4 affine model matrix
+ location 5     highlight flag
+ location 6, 7  position decoding (drawIndirect only)
+
+ instances.begin();
+ instances.add(mesh, lod, model, highlighted); // ...
+ instances.upload();
+ for (const InstanceGroup& group : instances.groups())
+     instances.draw(group);
+
+drawIndirect() draws all groups from a GeometryPool
+instead, with one glMultiDrawElementsIndirect call per
+pool storage.  Each group becomes one command whose
+baseInstance is the group's first instance, so the
+per-instance attributes of every command start at its
+own slice of the instance buffer without rebinding
+them.  The meshes of such a draw can be quantized
+differently, so their position decoding comes from the
+instance buffer as well (locations 6 and 7).
+
+Draws that do not go through InstanceRenderer read the
+constant values of those attributes, which
+setDefaults() sets to an identity matrix, no highlight
+and an identity decoding.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "GeometryPool.h"
+#include "Obj.h"
+
+#ifndef __INSTANCE_RENDERER_H__
+#define __INSTANCE_RENDERER_H__
+
+// Per-instance attributes, as stored in the instance buffer
+struct InstanceData {
+    float rows[3][4]; // model matrix rows (the last row is 0 0 0 1)
+    float highlight;  // 1 for the selected model
+    float positionScale[3]; // position decoding of the mesh
+    float positionBias[3];
+};
+
+// Consecutive instances of one mesh at one level of detail
+struct InstanceGroup {
+    Obj* mesh;
+    size_t lod;
+    size_t first; // first instance in the instance buffer
+    size_t count;
+    float depth;  // of the nearest instance
+};
+
+class InstanceRenderer {
+public:
+    static constexpr GLuint modelLocation = 2;     // 3 consecutive locations
+    static constexpr GLuint highlightLocation = 5;
+    static constexpr GLuint positionScaleLocation = 6;
+    static constexpr GLuint positionBiasLocation = 7;
+
+    void begin();
+    // depth orders the instances of a group front to back
+    void add(Obj* mesh, size_t lod, const glm::mat4& model, bool highlighted, float depth = 0.0f);
+
+    // Sorts the instances into groups and copies them to the GPU
+    void upload();
+    const std::vector<InstanceGroup>& groups() const { return groups_; }
+    void draw(const InstanceGroup& group);
+
+    // Draws every group whose mesh is in the pool, with one multi-draw
+    // per storage, and the others with draw(). Returns the draw calls.
+    size_t drawIndirect(const GeometryPool& pool);
+
+    size_t instanceCount() const { return entries_.size(); }
+
+    // Constant instance attributes for non-instanced draws
+    static void setDefaults();
+
+    // Frees the instance buffer (needs a current GL context)
+    void release();
+
+private:
+    struct Entry {
+        Obj* mesh;
+        size_t lod;
+        float depth;
+        InstanceData data;
+    };
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> order_;      // entries_ sorted by mesh, level and depth
+    std::vector<InstanceData> staging_;
+    std::vector<InstanceGroup> groups_;
+    GLuint buffer_ = 0;
+    size_t capacity_ = 0;              // in instances
+    std::vector<DrawElementsIndirectCommand> commands_; // of drawIndirect, by storage
+    std::vector<size_t> storageEnd_;   // end of each storage's commands
+    GLuint indirectBuffer_ = 0;
+    size_t indirectCapacity_ = 0;      // in commands
+
+    void setAttributes(size_t first, bool withDecoding);
+};
+
+#endif
@@ -0,0 +1,124 @@
+/**************************************************
+LightClusters sorts point lights into the cells of the
+view frustum (froxels), so a fragment only loops over
+the few lights whose range reaches its cell instead of
+over every light in the scene.
+
+The frustum is split into tilesX x tilesY tiles on the
+screen and into slices in depth.  The slices grow
+exponentially from the near to the far plane (the same
+ratio far / near for every slice), so near cells are
+not much deeper than they are wide:
+
+ slice = floor(log(depth) * depthScale + depthBias)
+
+build() takes the lights in world space and the camera
+(view matrix, fovy, aspect, near and far), moves the
+lights to view space and bins them on the CPU: each
+thread takes every n-th slice, finds the tiles each
+light's sphere covers in every one of its slices, and
+sorts its light indices by cell.  The result is
+
+ grid     offset and count of every cluster (2 uints)
+ indices  light indices, the lists of all clusters
+          one after the other
+ lights   view space position and radius, and color
+          (2 vec4 per light)
+
+which upload() copies into three buffer textures
+(GL 3.1 texture buffers rather than storage buffers,
+which would need OpenGL 4.3):
+
+ uniform usamplerBuffer clusterGrid;    // RG32UI
+ uniform usamplerBuffer clusterLights;  // R32UI
+ uniform samplerBuffer lightData;       // RGBA32F
+
+Every light that reaches a cluster is in its list, so
+the lists are as long as the lights make them.
+benchmark() times the binning for growing light counts,
+and reports the longest list:
+
+ ModelViewer --bench-lights
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#ifndef __LIGHT_CLUSTERS_H__
+#define __LIGHT_CLUSTERS_H__
+
+struct PointLight {
+    glm::vec3 position; // world space
+    float radius;       // the light fades to nothing at this distance
+    glm::vec3 color;    // times the intensity
+};
+
+class LightClusters {
+public:
+    static constexpr uint32_t tilesX = 16;
+    static constexpr uint32_t tilesY = 9;
+    static constexpr uint32_t slices = 24;
+    static constexpr uint32_t clusterCount = tilesX * tilesY * slices;
+
+    unsigned int threads = 0; // for the binning, 0 = one per core
+
+    // Bins the lights into the clusters of the camera; fovy in degrees
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, float fovy, float aspect,
+               float nearDist, float farDist);
+
+    // Cluster of a tile and slice: (slice * tilesY + y) * tilesX + x
+    static uint32_t cluster(uint32_t x, uint32_t y, uint32_t slice) { return (slice * tilesY + y) * tilesX + x; }
+    float depthScale() const { return depthScale_; }
+    float depthBias() const { return depthBias_; }
+
+    const std::vector<uint32_t>& grid() const { return grid_; }
+    const std::vector<uint32_t>& indices() const { return indices_; }
+    const std::vector<glm::vec4>& lights() const { return lights_; }
+    size_t lightCount() const { return lights_.size() / 2; }
+    double binMilliseconds() const { return binMilliseconds_; } // of the last build
+
+    // Copies the result of build() into the buffer textures, and binds
+    // them to the texture units firstUnit .. firstUnit + 2 (grid, indices,
+    // lights)
+    void upload();
+    void bind(GLuint firstUnit) const;
+
+    // Deletes the buffers and textures (needs a current GL context)
+    void release();
+
+    // Bins growing numbers of random lights and prints the timings;
+    // returns 0
+    static int benchmark();
+
+private:
+    struct ViewLight {
+        glm::vec3 position; // view space
+        float radius;
+        uint32_t firstSlice, lastSlice;
+    };
+    // Work of one slice: (cell in the slice, light) pairs, then the
+    // light indices sorted by cell
+    struct Slice {
+        std::vector<uint32_t> cells, lights;
+        std::vector<uint32_t> sorted;
+        uint32_t counts[tilesX * tilesY];
+    };
+
+    std::vector<ViewLight> viewLights_;
+    std::vector<Slice> slices_ = std::vector<Slice>(slices);
+    std::vector<uint32_t> grid_;
+    std::vector<uint32_t> indices_;
+    std::vector<glm::vec4> lights_;
+    float depthScale_ = 0.0f, depthBias_ = 0.0f;
+    double binMilliseconds_ = 0.0;
+
+    GLuint buffers_[3] = {};
+    GLuint textures_[3] = {};
+    size_t capacities_[3] = {}; // in bytes
+
+    void binSlice(uint32_t slice, float nearDist, float farDist, float tanHalfX, float tanHalfY);
+};
+
+#endif
@@ -0,0 +1,49 @@
+/**************************************************
+MappedFile is a read-only memory mapping of a file.
+ The whole file is mapped into the address space so
+ that loaders can scan it in place instead of copying
+ it through stdio buffers:
+
+ MappedFile file;
+ if (file.open("models/teapot.obj"))
+     parse(file.data(), file.data() + file.size());
+
+ The mapping is released when the object goes out of
+ scope (or when close() is called).
+*****************************************************/
+#include <cstddef>
+#include <utility>
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return open_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr; // first byte of the mapping
+    size_t size_ = 0;            // file size in bytes
+    bool open_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;       // HANDLE of the file
+    void* mapping_ = nullptr;    // HANDLE of the file mapping
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,113 @@
+/**************************************************
+MeshCache keeps the processed form of an obj file in a
+binary file next to it, e.g.
+ models/bunny.obj -> models/bunny.obj.meshbin
+so that later loads skip parsing entirely.
+
+The cache holds exactly what Obj::upload needs (the
+vertex streams, their attribute layout, the index
+array with its levels of detail and meshlets, the
+bounds and the position decoding).  It is memory-
+mapped on load, and the MeshView it returns points
+straight into the mapping, so the data goes to
+glBufferData without any intermediate copy.
+
+A cache is only used when its header matches the
+version of this code, the requested processing steps
+and the size, modification time and content hash of
+the source file, and when the checksum is intact.  The
+checksum covers the header too (all but its own field
+and the source time, which a load may rewrite), so a
+damaged vertex count or offset is caught as well.  Anything else is treated as a miss and the
+caller rebuilds it.
+
+File layout:
+ MeshCacheHeader
+ MeshCacheHeader::streamCount vertex streams
+ index array
+ meshlets
+(every block starts at a 16-byte aligned offset).
+*****************************************************/
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+#include "MeshData.h"
+
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+struct MeshCacheHeader {
+    char magic[8];          // "MESHBIN"
+    uint32_t version;
+    uint32_t headerSize;    // sizeof(MeshCacheHeader)
+    uint64_t sourceSize;    // size of the obj file in bytes
+    int64_t sourceTime;     // modification time of the obj file
+    uint64_t sourceHash;    // hash of the obj file contents
+    uint64_t payloadHash;   // hash of the header (see MeshCache::load) and the rest
+    uint64_t fileSize;      // total size of the cache file
+
+    float boundsMin[3];
+    float boundsMax[3];
+    float positionScale[3]; // decoding of quantized positions
+    float positionBias[3];
+    uint64_t vertexCount;
+    uint32_t streamCount;
+    uint32_t attribCount;
+    uint32_t strides[MeshView::maxStreams];
+    uint64_t streamOffsets[MeshView::maxStreams];
+    VertexAttrib attribs[MeshView::maxAttribs];
+
+    uint64_t indexCount;
+    uint32_t indexType;
+    uint32_t processing;    // MeshProcessing flags the mesh was built with
+    uint64_t indexOffset;
+    uint32_t lodCount;
+    MeshLod lods[MeshView::maxLods];
+    uint64_t meshletOffset;
+    uint64_t meshletCount;
+};
+
+// Optional processing steps applied to a cached mesh. A cache built with
+// different steps than requested is treated as a miss.
+enum MeshProcessing : uint32_t {
+    MESH_PROCESS_OPTIMIZE = 1 << 0, // MeshOptimizer::optimize
+    MESH_PROCESS_QUANTIZE = 1 << 1, // MeshData::quantize
+    MESH_PROCESS_LODS = 1 << 2,     // MeshSimplifier::buildLods
+    MESH_PROCESS_MESHLETS = 1 << 3  // Meshlets::build
+};
+
+// A mapped cache file and the mesh it contains
+struct MeshCacheEntry {
+    MappedFile file;
+    MeshView view;
+};
+
+// Identity of a source file, as recorded in the cache header
+struct MeshSourceInfo {
+    uint64_t size = 0;
+    int64_t time = 0;
+    uint64_t hash = 0;
+};
+
+class MeshCache {
+public:
+    static constexpr uint32_t version = 7;
+
+    static std::string cachePath(const char* sourcePath);
+
+    // Reads the size and modification time of a source file (not its hash)
+    static bool sourceInfo(const char* sourcePath, MeshSourceInfo& info);
+
+    // Maps the cache of sourcePath. Returns false if it is missing, stale, corrupt
+    // or built with other processing flags.
+    static bool load(const char* sourcePath, uint32_t processing, MeshCacheEntry& entry);
+
+    // Writes the cache of a source file. info must include the content hash.
+    static bool save(const char* sourcePath, const MeshSourceInfo& info, uint32_t processing,
+                     const MeshView& mesh);
+
+    // 64-bit hash used for the source contents and the payload checksum
+    static uint64_t hash(const void* data, size_t size);
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**************************************************
+MeshData is the CPU-side copy of an indexed triangle
+mesh, in the form that Obj uploads to the GPU:
+ one position and one normal per vertex, and
+ three indices per triangle.
+
+weld() builds it from the raw corners of an obj file.
+Corners that share the same (position, normal) pair
+become a single vertex, so a closed mesh needs about
+one vertex per two triangles instead of three.
+MeshSimplifier::buildLods can append coarser levels
+of detail to the index array, as extra index ranges
+over the same vertices, and Meshlets::build splits the
+full level into culling clusters.
+finalize() then computes the bounds and the 16-bit
+index array (when the vertex count allows it).
+quantize() optionally builds the compact layout: an
+8-byte position and a 4-byte normal per vertex instead
+of two float streams of 12 bytes each.  Positions are
+stored as 16-bit fractions of the bounding box and
+decoded in the vertex shader as bias + position * scale.
+Both layouts keep the positions in a stream of their
+own, so position-only passes (the depth pre-pass) fetch
+nothing else.
+
+MeshView describes the GPU-ready arrays of a mesh
+without owning them: the vertex streams, the layout
+of the attributes inside them and the index array.
+It can point into a MeshData or into a mapped cache
+file, and Obj::upload accepts either.
+*****************************************************/
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "ObjParser.h"
+
+#ifndef __MESH_DATA_H__
+#define __MESH_DATA_H__
+
+// Layout of one vertex attribute inside a vertex stream
+struct VertexAttrib {
+    uint32_t location;   // shader attribute location
+    uint32_t size;       // number of components
+    uint32_t type;       // GL component type
+    uint32_t normalized; // GL_TRUE for normalized integer types
+    uint32_t stream;     // vertex stream holding the attribute
+    uint32_t offset;     // byte offset inside a vertex of that stream
+};
+
+// Index range of one level of detail inside the index array
+struct MeshLod {
+    uint32_t first; // first index of the level
+    uint32_t count; // number of indices
+    float error;    // object space error estimate relative to the full mesh
+};
+
+// Cluster of the full level with its culling bounds (see Meshlet.h)
+struct Meshlet {
+    uint32_t first;    // first index, inside the full level
+    uint32_t count;    // number of indices
+    float center[3];   // bounding sphere, object space
+    float radius;
+    float coneAxis[3]; // average normal of the triangles
+    float coneCutoff;  // sine of the cone half angle; >= 1 disables the cone test
+};
+
+struct MeshView {
+    static constexpr uint32_t maxStreams = 2;
+    static constexpr uint32_t maxAttribs = 4;
+    static constexpr uint32_t maxLods = 8;
+
+    const void* streams[maxStreams] = {};  // vertex data, one block per stream
+    uint32_t strides[maxStreams] = {};     // bytes per vertex in each stream
+    uint32_t streamCount = 0;
+    VertexAttrib attribs[maxAttribs] = {};
+    uint32_t attribCount = 0;
+    size_t vertexCount = 0;
+
+    const void* indices = nullptr;
+    uint32_t indexType = 0;                // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    size_t indexCount = 0;
+    MeshLod lods[maxLods] = {};            // levels of detail, finest first (none: one level
+    uint32_t lodCount = 0;                 // covering every index)
+    const Meshlet* meshlets = nullptr;     // clusters of the full level, if built
+    size_t meshletCount = 0;
+
+    glm::vec3 boundsMin = glm::vec3(0.0f); // object space bounding box
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f); // object space position = bias + attribute * scale
+    glm::vec3 positionBias = glm::vec3(0.0f);
+
+    size_t streamBytes(uint32_t stream) const { return vertexCount * strides[stream]; }
+    size_t indexBytes() const;
+    size_t vertexBytes() const;
+};
+
+// Compact position of the quantized layout; the normal goes into a
+// separate stream of GL_INT_2_10_10_10_REV values
+struct PackedPosition {
+    uint16_t position[4]; // unsigned normalized, relative to the bounds (w unused)
+};
+
+// A face corner together with its attribute values
+struct MeshCorner {
+    uint32_t position; // obj position index
+    uint32_t normal;   // obj normal index
+    glm::vec3 p;
+    glm::vec3 n;
+};
+
+struct MeshData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> indices;
+    std::vector<uint16_t> shortIndices; // copy of indices when every vertex fits in 16 bits
+    std::vector<PackedPosition> packedPositions; // quantized copy of the vertices, if built
+    std::vector<uint32_t> packedNormals;         // signed normalized 10:10:10:2
+    std::vector<MeshLod> lods;          // index ranges of the levels of detail, if built
+    std::vector<Meshlet> meshlets;      // clusters of the full level, if built
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f); // decoding of packed positions
+    glm::vec3 positionBias = glm::vec3(0.0f);
+
+    void weld(const ObjData& data);
+    void weld(const MeshCorner* corners, size_t n);
+    void finalize();
+
+    // Builds the packed arrays relative to the bounds (after finalize), or
+    // to a larger box shared with other meshes. view() then returns the
+    // packed layout.
+    void quantize();
+    void quantize(const glm::vec3& lo, const glm::vec3& hi);
+    MeshView view() const;
+
+    size_t vertexCount() const { return positions.size(); }
+    size_t indexCount() const { return indices.size(); }
+};
+
+#endif
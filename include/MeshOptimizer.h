@@ -0,0 +1,56 @@
+/**************************************************
+MeshOptimizer reorders the triangles and vertices of
+an indexed mesh for faster rendering, without changing
+what is drawn:
+
+ optimizeVertexCache  orders the triangles so that the
+                      post-transform vertex cache hits
+                      as often as possible (Forsyth's
+                      "linear-speed vertex cache
+                      optimisation").
+ optimizeOverdraw     splits that order into clusters
+                      that keep its cache efficiency
+                      and sorts them so that outward
+                      facing clusters come first, which
+                      reduces overdraw from most views
+                      (Sander et al., "Tipsify").
+ optimizeVertexFetch  renumbers the vertices in the
+                      order the index buffer first uses
+                      them, so vertex fetches stream
+                      through memory.
+
+analyzeVertexCache reports the average cache miss
+ratio per triangle (ACMR) and per vertex (ATVR) of a
+FIFO cache, to measure the effect.
+*****************************************************/
+#include <cstddef>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "MeshData.h"
+
+#ifndef __MESH_OPTIMIZER_H__
+#define __MESH_OPTIMIZER_H__
+
+struct VertexCacheStats {
+    float acmr = 0.0f; // vertex shader invocations per triangle (0.5 .. 3)
+    float atvr = 0.0f; // vertex shader invocations per vertex (1 is ideal)
+};
+
+class MeshOptimizer {
+public:
+    static VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount,
+                                               size_t vertexCount, unsigned int cacheSize = 16);
+
+    static void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+    // threshold: how much worse than the whole mesh a cluster's ACMR may be
+    static void optimizeOverdraw(unsigned int* indices, size_t indexCount, const glm::vec3* positions,
+                                 size_t vertexCount, float threshold = 1.05f);
+
+    static void optimizeVertexFetch(MeshData& mesh);
+
+    // All three steps, in order
+    static void optimize(MeshData& mesh);
+};
+
+#endif
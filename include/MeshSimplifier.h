@@ -0,0 +1,47 @@
+/**************************************************
+MeshSimplifier builds the levels of detail of a mesh
+with quadric error metric edge collapses (Garland and
+Heckbert, "Surface Simplification Using Quadric Error
+Metrics").
+
+Every collapse moves a vertex onto one of its
+neighbours, so the simplified triangles still index the
+original vertex array: all the levels share one vertex
+buffer and only add index ranges to it.  Vertices on
+open borders and on attribute seams (several vertices
+at one position) never move, which keeps the surface
+closed where the full mesh is.
+
+The error of a simplification is the largest RMS
+distance, in object space, between a moved vertex and
+the planes of the triangles merged into it.  Every
+level is simplified from the previous one, so the
+error of a level is the sum of the errors along
+the chain.  The renderer turns it into pixels to pick
+a level (see Obj::selectLod).
+*****************************************************/
+#include <cstddef>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "MeshData.h"
+
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+class MeshSimplifier {
+public:
+    // Triangle count of every level relative to the full mesh
+    static constexpr float lodRatios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+    // Simplifies indices (over positions) to at most targetIndexCount indices, or
+    // as far as the locked vertices allow. Returns the error of the result.
+    static float simplify(const glm::vec3* positions, size_t vertexCount, std::vector<unsigned int>& indices,
+                          size_t targetIndexCount);
+
+    // Appends the levels of lodRatios to mesh.indices and fills mesh.lods.
+    // Levels that would not remove at least a tenth of the previous one are skipped.
+    static void buildLods(MeshData& mesh);
+};
+
+#endif
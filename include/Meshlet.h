@@ -0,0 +1,41 @@
+/**************************************************
+Meshlets builds and culls the meshlets of a mesh.
+A Meshlet (see MeshData.h) is a small cluster of the
+full level of a mesh: at most maxVertices distinct
+vertices and maxTriangles triangles, taken in index
+order, so every meshlet is one contiguous range of the
+index array.
+
+Each meshlet carries
+ a bounding sphere, for frustum culling, and
+ a normal cone (the average triangle normal and the
+ spread around it), for backface culling: when the
+ camera sees the whole cone from behind, no triangle
+ of the meshlet can be front facing.
+
+Obj::drawCulled tests the meshlets of a mesh and draws
+the surviving ranges with one glMultiDrawElements call.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "MeshData.h"
+
+#ifndef __MESHLET_H__
+#define __MESHLET_H__
+
+class Meshlets {
+public:
+    static constexpr unsigned int maxVertices = 64;
+    static constexpr unsigned int maxTriangles = 124;
+
+    // Splits the full level of mesh (lods[0], or every index) into mesh.meshlets
+    static void build(MeshData& mesh);
+
+    // frustum and eye are in the object space of the meshlet
+    static bool isVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& eye);
+};
+
+#endif
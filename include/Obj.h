@@ -2,19 +2,119 @@
 Obj is subclass class of Geometry
 that loads an obj file.
 *****************************************************/
+#include <memory>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include "Geometry.h"
+#include "MeshCache.h"
+#include "MeshData.h"
 #ifndef __OBJ_H__
 #define __OBJ_H__
 
+class GeometryPool;
+struct StreamedChunks;
+
+// Settings read by Obj::init
+struct ObjLoadOptions {
+    unsigned int parseThreads = 0; // threads used by the parser, 0 = one per core
+    bool useCache = true;          // load from / save to the .meshbin cache
+    bool optimize = true;          // reorder for the vertex cache, overdraw and fetch locality
+    bool quantize = true;          // compact 12-byte vertices (8-byte position, 4-byte normal streams)
+    bool generateLods = true;      // simplified levels of detail (see MeshSimplifier)
+    bool buildMeshlets = true;     // culling clusters of the full level (see Meshlet.h)
+    size_t streamingThresholdMB = 2048; // larger files are loaded by StreamedObj
+    size_t memoryLimitMB = 512;         // memory ceiling of StreamedObj
+
+    // MeshProcessing flags matching these options
+    uint32_t processing() const {
+        uint32_t flags = 0;
+        if (optimize)
+            flags |= MESH_PROCESS_OPTIMIZE;
+        if (quantize)
+            flags |= MESH_PROCESS_QUANTIZE;
+        if (generateLods)
+            flags |= MESH_PROCESS_LODS;
+        if (buildMeshlets)
+            flags |= MESH_PROCESS_MESHLETS;
+        return flags;
+    }
+};
+
+// CPU side result of Obj::load, ready to be uploaded
+struct ObjLoadResult {
+    MeshData mesh;         // parsed mesh, unless it came from the cache
+    MeshCacheEntry cached; // mapped cache file, if it was valid
+    MeshView view;         // the arrays to upload, inside one of the above
+    std::shared_ptr<StreamedChunks> chunks; // instead, from StreamedObj::load
+};
+
 class Obj : public Geometry {
 public:
+    ObjLoadOptions options;
+    bool ready = false; // true once all the data is on the GPU
+    bool failed = false; // the file could not be loaded (see AsyncLoader)
+    bool hasBounds = false; // boundsMin / boundsMax are known (from the start of the upload)
+    std::vector<MeshLod> lods; // levels of detail, finest first (at least one once set up)
+    std::vector<Meshlet> meshlets; // clusters of the full level, may be empty
+    MeshView layout; // the uploaded arrays, without their data pointers
+    // Coarsest level kept on the CPU for OcclusionCuller (empty when that
+    // level has more than maxOccluderIndices indices)
+    static constexpr size_t maxOccluderIndices = 3 * 4096;
+    std::vector<glm::vec3> occluderPositions;
+    std::vector<uint32_t> occluderIndices;
+    GeometryPool* pool = nullptr; // pool that also holds a copy of the mesh
+    uint32_t poolSlot = 0;        // entry of the mesh in that pool
 
     void init(const char * filename);
 
+    // Loads and processes an obj file without touching GL, so it can
+    // run on any thread. Returns false (and logs why) on failure.
+    static bool load(const char * filename, const ObjLoadOptions& options, ObjLoadResult& result);
+
+    // Creates the vertex array and buffers for a loaded mesh
+    void upload(const MeshView& mesh);
+
+    // Incremental upload for meshes loaded in the background:
+    // beginUpload allocates the buffers, and every continueUpload call
+    // copies at most budget bytes (and subtracts them from it).
+    // continueUpload returns true once the mesh is complete.
+    void beginUpload(const MeshView& mesh);
+    bool continueUpload(const MeshView& mesh, size_t& budget);
+    // The same for the result of load (StreamedObj: of its own load)
+    virtual void beginUpload(const ObjLoadResult& result) { beginUpload(result.view); }
+    virtual bool continueUpload(const ObjLoadResult& result, size_t& budget) { return continueUpload(result.view, budget); }
+
     void render();
-        
+
+    // Also removes the mesh from its GeometryPool
+    void release(void) override;
+
+    // Coarsest level whose error, projected at the nearest point of the
+    // bounding sphere, stays within maxErrorPixels on screen
+    size_t selectLod(const glm::mat4& modelview, const glm::mat4& projection, float viewportHeight,
+                     float maxErrorPixels) const;
+
+    // Draws one level of detail (the full mesh if there are none)
+    void drawLod(size_t level);
+
+    // Draws instances of one level; the vertex array has to be bound and
+    // its per-instance attributes set (see InstanceRenderer)
+    void drawLodInstanced(size_t level, GLsizei instances);
+
+    // False for meshes made of several vertex arrays (StreamedObj)
+    bool supportsInstancing() const { return vao != 0 && !lods.empty(); }
+
+    // Draws the full level without the meshlets that are outside the
+    // frustum or back facing. Returns the number of triangles culled.
+    size_t drawCulled(const glm::mat4& modelview, const glm::mat4& projection);
+
+private:
+    size_t uploaded_ = 0; // bytes already copied by continueUpload
+    std::vector<GLsizei> drawCounts_;        // ranges of the last drawCulled call
+    std::vector<const void*> drawOffsets_;
+
+    void setupBuffers(const MeshView& mesh, bool withData);
+    void setupOccluder(const MeshView& mesh);
 };
 
 #endif 
@@ -0,0 +1,85 @@
+/**************************************************
+ObjParser is a fast, in-memory tokenizer for the
+subset of the obj format that Obj understands:
+ v   x y z
+ vn nx ny nz
+ f 123//456 ...
+Faces with more than three corners are triangulated
+as a fan, and "a/t/b" corners are accepted (the texture
+index is skipped).  All other records are ignored.
+
+The parser works on a memory-mapped file.  A first pass
+only counts the records, so that every output array is
+sized exactly once; the second pass then writes the
+values in place without any further allocation.
+Indices in the output are 0-based.
+
+Large files can be parsed on several threads.  The
+buffer is split into newline-aligned chunks, every
+chunk is counted on its own thread, and a prefix sum
+over the chunk counts gives each chunk its offsets in
+the output arrays (and the number of vertices defined
+before it, for relative indices).  The result is
+identical to a single-threaded parse.
+*****************************************************/
+#include <cstddef>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#ifndef __OBJ_PARSER_H__
+#define __OBJ_PARSER_H__
+
+// Raw contents of an obj file, three corners per triangle
+struct ObjData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> positionIndices;
+    std::vector<unsigned int> normalIndices;
+};
+
+// Number of records found in (a part of) an obj file
+struct ObjCounts {
+    size_t positions = 0; // "v" lines
+    size_t normals = 0;   // "vn" lines
+    size_t corners = 0;   // triangle corners produced by "f" lines
+};
+
+// One line of an obj file, as read by ObjParser::parseLine
+struct ObjLine {
+    enum Type { OTHER, POSITION, NORMAL, FACE } type = OTHER;
+    glm::vec3 value = glm::vec3(0.0f);         // v and vn lines
+    size_t corners = 0;                        // f lines: 3 per triangle,
+    std::vector<unsigned int> positionIndices; // stored at the front of
+    std::vector<unsigned int> normalIndices;   // these arrays
+};
+
+class ObjParser {
+public:
+    // Parses the whole buffer into out. Returns false on malformed input.
+    // threadCount = 0 uses one thread per core.
+    static bool parse(const char* begin, const char* end, ObjData& out, unsigned int threadCount = 1);
+
+    // Counting pass over [begin, end).
+    static ObjCounts count(const char* begin, const char* end);
+
+    // Filling pass over [begin, end). The records are written at the
+    // offsets given by first, into arrays that are already sized.
+    static bool parseRange(const char* begin, const char* end, const ObjCounts& first, ObjData& out);
+
+    // Line-by-line interface for loaders that cannot hold the whole file.
+    // Reads the line at p and returns the start of the next one, or nullptr
+    // if the line is malformed. defined holds the number of v and vn records
+    // before the line, to resolve relative indices. Indices are not validated.
+    static const char* parseLine(const char* p, const char* end, const ObjCounts& defined, ObjLine& line);
+
+    // Parses a decimal floating point number starting at p.
+    // Returns the position after the number, or nullptr if there is none.
+    static const char* parseFloat(const char* p, const char* end, float& value);
+
+private:
+    // Checks the indices of corners [first, last) against the array sizes
+    static bool validate(const ObjData& data, size_t first, size_t last);
+};
+
+#endif
@@ -0,0 +1,114 @@
+/**************************************************
+OcclusionCuller hides objects that are behind a few
+large occluders, entirely on the CPU, before they
+reach the draw list.
+
+ 1. begin() clears a small depth buffer (width x
+    height pixels of view distance);
+ 2. addOccluder() transforms the triangles of an
+    occluder (a coarse level of detail, see
+    Obj::occluderPositions) to screen space; triangles
+    that face away or cross the near plane are dropped;
+ 3. rasterize() fills the depth buffer, split into
+    horizontal bands that are rasterized by separate
+    threads, and then keeps the farthest and nearest
+    depth of every tileSize x tileSize tile (a one-level
+    hierarchy);
+ 4. cull() projects the world space boxes that a
+    FrustumCuller keeps for the objects it found
+    visible, with one view-projection matrix for all of
+    them, and compares each box's nearest depth with
+    the tiles under its screen rectangle, and with their
+    pixels only where a tile is not conclusive.
+
+Each occluder triangle is written with the depth of its
+farthest vertex, so the buffer is never nearer than the
+real occluders and an object is only reported hidden
+when it is behind them everywhere (up to the usual
+pixel-center coverage of the triangle edges).
+
+The rasterizer evaluates the edge functions of 8 pixels
+per AVX2 instruction, and cull() projects 8 boxes per
+AVX2 instruction, when the CPU supports it (checked at
+run time, so no compiler flags are needed); the same
+loops run one pixel or box at a time otherwise.
+
+benchmark() times a synthetic scene without a window or
+GL context, for machines without a GPU; it reports the
+rasterization and the box tests separately:
+
+ ModelViewer --bench-occlusion
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#ifndef __OCCLUSION_CULLER_H__
+#define __OCCLUSION_CULLER_H__
+
+class FrustumCuller;
+
+class OcclusionCuller {
+public:
+    static constexpr int width = 256;  // multiple of 8
+    static constexpr int height = 128; // multiple of tileSize
+    static constexpr int tileSize = 8;
+    static constexpr int tilesX = width / tileSize;
+    static constexpr int tilesY = height / tileSize;
+
+    unsigned int threads = 0; // rasterizer threads, 0 = one per core
+    bool useAvx2 = true;      // ignored when the CPU has no AVX2
+
+    static bool avx2Supported();
+
+    // Starts a frame seen through viewProjection
+    void begin(const glm::mat4& viewProjection);
+    void addOccluder(const glm::vec3* positions, const uint32_t* indices, size_t indexCount, const glm::mat4& model);
+    void rasterize();
+
+    // Clears visible[i] of the objects of culler whose world box is
+    // certainly hidden by the occluders; returns how many it cleared
+    size_t cull(FrustumCuller& culler);
+
+    size_t triangleCount() const { return triangles_.size(); }
+    const std::vector<float>& depth() const { return depth_; } // row by row, nearest occluder distance
+
+    // Runs the synthetic scene and prints the timings; returns 0
+    static int benchmark();
+
+private:
+    // Screen space triangle: edge functions a * x + b * y + c, positive
+    // inside, and the pixel rectangle it may cover
+    struct Triangle {
+        float a[3], b[3], c[3];
+        float depth;
+        int x0, y0, x1, y1;
+    };
+
+    // Screen rectangles and nearest depths of objects' boxes, one array
+    // per component
+    struct ScreenRects {
+        std::vector<uint32_t> object;
+        std::vector<float> loX, loY, hiX, hiY, nearest;
+    };
+
+    glm::mat4 viewProjection_ = glm::mat4(1.0f);
+    std::vector<Triangle> triangles_;
+    std::vector<glm::vec4> clip_;          // scratch for addOccluder
+    std::vector<float> depth_;             // width * height
+    std::vector<float> tileMax_, tileMin_; // tilesX * tilesY, farthest / nearest depth per tile
+    std::vector<uint32_t> candidates_;     // scratch for cull
+    ScreenRects undecided_;                // by the tiles, in cullAvx2
+
+    void rasterizeBand(int y0, int y1);
+    void rasterizeBandAvx2(int y0, int y1);
+    bool boxVisible(const FrustumCuller& culler, size_t i) const;
+    // Returns the number of boxes hidden, and the number of undecided_
+    size_t cullAvx2(FrustumCuller& culler, size_t& undecided);
+    // False if the screen rectangle is behind the occluders everywhere
+    bool rectVisible(float loX, float loY, float hiX, float hiY, float nearest) const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**************************************************
+OcclusionQueries lets the GPU decide which objects are
+hidden, with one occlusion query per object, without
+ever waiting for a query result.
+
+Every object (an index chosen by the caller) has at most
+one query in flight.  beginFrame() collects the results
+that have arrived since the last frame, usually those of
+the frame before, and action() then says how the object
+is drawn in this frame:
+
+ DRAW             visible, not due for a query: draw it
+                  normally (it may be batched);
+ DRAW_QUERIED     visible and due: draw it inside
+                  beginQuery() / endQuery(), so the draw
+                  itself is the test;
+ TEST_BOX         hidden last time: draw its bounding box
+                  inside a query with color and depth
+                  writes off, then draw the object with
+                  glBeginConditionalRender on that query,
+                  so the GPU skips it while it stays hidden;
+ DRAW_CONDITIONAL hidden, and the last query has not
+                  returned yet: draw it conditionally on
+                  that query.
+
+Draws are submitted front-to-back, so the box of a
+hidden object is tested after its occluders were drawn.
+The conditional renders use GL_QUERY_BY_REGION_NO_WAIT:
+an object whose query is still pending is drawn, never
+waited for.  Visible objects are only queried every
+interval frames (spread over the frames by object
+index), since they usually stay visible; hidden objects
+are tested every frame, so they reappear at once.
+
+The queries count GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+where available (OpenGL 4.3 or ARB_ES3_compatibility),
+and GL_ANY_SAMPLES_PASSED otherwise.  Query objects come
+from a pool that grows as needed and are reused once
+their result has been read.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef __OCCLUSION_QUERIES_H__
+#define __OCCLUSION_QUERIES_H__
+
+class OcclusionQueries {
+public:
+    enum Action { DRAW, DRAW_QUERIED, TEST_BOX, DRAW_CONDITIONAL };
+
+    int interval = 8; // frames between the queries of a visible object
+
+    static bool conservative();
+
+    // Polls the queries in flight; objectCount objects are drawn this
+    // frame (fewer than last frame means the indices changed: all
+    // objects start over as visible)
+    void beginFrame(size_t objectCount);
+
+    // How object i is drawn in this frame
+    Action action(size_t i) const;
+    // Marks object i as visible and due for a query, e.g. when it
+    // leaves the frustum or the camera is inside its bounding box
+    void reset(size_t i);
+
+    // Wraps the draws of object i in a new query (at most one open)
+    void beginQuery(size_t i);
+    void endQuery();
+    // Starts / ends a conditional render on the query of object i
+    void beginConditional(size_t i) const;
+    void endConditional() const;
+
+    size_t queriesIssued() const { return issued_; }   // in this frame
+    size_t resultsRead() const { return read_; }       // in this frame
+    size_t objectsHidden() const { return hidden_; }   // by their last result
+    size_t poolSize() const { return queries_.size(); }
+
+    // Deletes the query objects (needs a current GL context)
+    void release();
+
+private:
+    struct Slot {
+        GLuint query = 0;        // in flight, 0 if none
+        bool visible = true;     // last result
+        uint32_t nextQuery = 0;  // frame in which a visible object is queried again
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<GLuint> queries_; // every query object
+    std::vector<GLuint> free_;    // those without a pending result
+    uint32_t frame_ = 0;
+    size_t issued_ = 0, read_ = 0, hidden_ = 0;
+};
+
+#endif
@@ -0,0 +1,37 @@
+/**************************************************
+Small helpers for fork/join parallelism.
+
+ parallelFor(n, [&](unsigned int i){ ... });
+
+runs the body once for every i in [0, n), each on its
+own thread (the calling thread takes i = 0), and
+returns when all of them have finished.
+*****************************************************/
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+// Number of worker threads to use for a requested count (0 = all cores)
+inline unsigned int resolveThreadCount(unsigned int requested) {
+    if (requested > 0)
+        return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+template <typename Function>
+void parallelFor(unsigned int n, Function&& body) {
+    if (n == 0)
+        return;
+    std::vector<std::thread> workers;
+    workers.reserve(n - 1);
+    for (unsigned int i = 1; i < n; i++)
+        workers.emplace_back([&body, i]() { body(i); });
+    body(0);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+#endif
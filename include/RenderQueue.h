@@ -0,0 +1,76 @@
+/**************************************************
+RenderQueue orders the draws of a frame by a 64-bit
+sort key instead of by the order the scene lists them.
+
+Each draw pushes a key and a 32-bit item (an index into
+the caller's own draw list).  makeKey() packs
+
+ opaque:      pass | shader | mesh | depth
+ translucent: pass | far-to-near depth | shader | mesh
+
+ bits 63-62  pass (opaque before translucent)
+ opaque      61-56 shader, 55-40 mesh, 39-16 depth
+ translucent 61-38 inverted depth, 37-32 shader,
+             31-16 mesh
+
+so opaque draws are grouped by program and vertex array
+and drawn front-to-back inside a group (for early-Z),
+while translucent draws go back-to-front across meshes,
+which blending needs.  depth is the view distance as a
+fraction of the far plane, quantized to 24 bits.
+
+sort() is an LSD radix sort over 8-bit digits that
+moves the items with their keys.  It is stable (equal
+keys keep their push order), skips the digits where all
+keys agree, and reuses its buffers, so it does not
+allocate once the queue has reached its largest size.
+
+ queue.clear();
+ queue.push(RenderQueue::makeKey(pass, program, vao, depth), item);
+ queue.sort();
+ for (size_t i = 0; i < queue.size(); i++)
+     draw(queue.item(i));
+
+benchmark() sorts random queues with sort() and with
+std::stable_sort, and checks that both give the same
+keys and items in the same order:
+
+ ModelViewer --bench-sort
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef __RENDER_QUEUE_H__
+#define __RENDER_QUEUE_H__
+
+enum RenderPass : uint32_t {
+    PASS_OPAQUE = 0,
+    PASS_TRANSLUCENT = 1,
+};
+
+class RenderQueue {
+public:
+    // depth is clamped to [0, 1]; shader and mesh keep their low 6 and
+    // 16 bits (GL names are small, so they stay distinct in practice)
+    static uint64_t makeKey(RenderPass pass, uint32_t shader, uint32_t mesh, float depth);
+    static RenderPass passOf(uint64_t key) { return static_cast<RenderPass>(key >> 62); }
+
+    void clear();
+    void push(uint64_t key, uint32_t item);
+    void sort();
+
+    // Compares sort() with std::stable_sort on random keys, prints the
+    // timings; returns 0, or 1 if the orders differ
+    static int benchmark();
+
+    size_t size() const { return keys_.size(); }
+    uint64_t key(size_t i) const { return keys_[i]; }
+    uint32_t item(size_t i) const { return items_[i]; }
+
+private:
+    std::vector<uint64_t> keys_, keyScratch_;
+    std::vector<uint32_t> items_, itemScratch_;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/**************************************************
+SceneStore keeps the objects of the scene as parallel
+arrays (structure of arrays): transforms[i], boundsMin[i],
+meshes[i] ... all describe object i, and the objects are
+always packed in 0 .. size() - 1, so the per-frame loops
+walk each array from front to back.
+
+ SceneStore scene;
+ SceneHandle h = scene.add(mesh, transform);
+ for (size_t i = 0; i < scene.size(); i++)
+     draw(scene.meshes[i], scene.transforms[i].world());
+ scene.remove(h);
+
+remove() moves the last object into the gap (swap-
+remove), so an object's index changes when another one
+is removed.  References that have to survive that, such
+as the selection, are handles: a slot that tracks the
+object's current index, and a generation that is bumped
+when the object is removed, so an old handle no longer
+finds anything even after its slot has been reused.
+
+worlds keeps the world matrices as BatchMath arrays, so
+the per-frame batches read them without going through
+every Transform; updateWorlds() copies the ones whose
+Transform::version changed.
+
+Meshes are shared between objects (see AssetManager).
+boundsMin and boundsMax are copies of the mesh's object
+space bounds; objects added before the upload of their
+mesh has begun (Obj::hasBounds) are flagged
+BOUNDS_PENDING until the caller copies the real bounds.
+
+benchmark() compares one frame of per-object work on
+100k objects against heap-allocated objects behind
+pointers, and times removal and insertion:
+
+ ModelViewer --bench-scene
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "BatchMath.h"
+#include "Transform.h"
+
+#ifndef __SCENE_STORE_H__
+#define __SCENE_STORE_H__
+
+class Obj;
+
+struct SceneHandle {
+    uint32_t slot = 0xFFFFFFFFu;
+    uint32_t generation = 0; // 0 never refers to an object
+
+    bool operator==(const SceneHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const SceneHandle& other) const { return !(*this == other); }
+};
+
+class SceneStore {
+public:
+    enum Flag : uint8_t {
+        STATIC = 1,         // a built-in model: drawn whole and translucent
+        BOUNDS_PENDING = 2, // the mesh's bounds are not known yet
+    };
+    static constexpr size_t npos = ~size_t(0);
+
+    // One entry per object
+    std::vector<Transform> transforms;
+    std::vector<glm::vec3> boundsMin, boundsMax; // object space
+    std::vector<std::shared_ptr<Obj>> meshes;
+    std::vector<uint32_t> lods;                  // chosen in the last frame
+    std::vector<uint8_t> flags;
+    AffineArrays worlds;                         // as of the last updateWorlds()
+
+    size_t size() const { return transforms.size(); }
+
+    // The bounds are taken from mesh (or flagged BOUNDS_PENDING if it is
+    // not ready yet)
+    SceneHandle add(std::shared_ptr<Obj> mesh, const Transform& transform, uint8_t flags = 0);
+    // False if handle was already removed
+    bool remove(SceneHandle handle);
+    // Removes every object i for which predicate(i) is true
+    template <class Predicate>
+    size_t removeIf(Predicate predicate);
+    void clear();
+
+    // Copies the world matrices that changed into worlds; returns how many
+    size_t updateWorlds();
+
+    bool contains(SceneHandle handle) const { return indexOf(handle) != npos; }
+    size_t indexOf(SceneHandle handle) const; // npos if removed
+    SceneHandle handle(size_t index) const;
+
+    // Runs the synthetic scene and prints the timings; returns 0
+    static int benchmark();
+
+private:
+    std::vector<uint32_t> slots_;       // slot of each index
+    std::vector<uint32_t> indices_;     // index of each slot
+    std::vector<uint32_t> generations_; // of each slot
+    std::vector<uint32_t> freeSlots_;
+    std::vector<uint64_t> worldVersions_; // Transform::version of worlds (0: none)
+};
+
+template <class Predicate>
+size_t SceneStore::removeIf(Predicate predicate) {
+    // from the back, so the object moved into a gap was already tested
+    size_t removed = 0;
+    for (size_t i = size(); i-- > 0;) {
+        if (predicate(i)) {
+            remove(handle(i));
+            removed++;
+        }
+    }
+    return removed;
+}
+
+#endif
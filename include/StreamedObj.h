@@ -0,0 +1,84 @@
+/**************************************************
+StreamedObj is an Obj for files that are too large to
+load in memory.  Its loader never holds more than
+options.memoryLimitMB of data, whatever the file size.
+load() does not touch GL, so it runs on the workers of
+AsyncLoader like Obj::load:
+
+ 1. counting pass: the file is read through a fixed
+    buffer, positions and normals are spilled to
+    temporary files and the bounds are computed;
+ 2. filling pass: every triangle fetches its vertices
+    from the spill files through a bounded page cache
+    and is appended to the chunk file of the spatial
+    grid cell containing its centroid;
+ 3. every chunk file is read back, in pieces no larger
+    than the memory limit allows, welded and appended
+    to one file of processed chunks (StreamedChunks).
+
+The peak resident set size of the process is reported
+at the end, so the limit can be checked.  Errors are
+reported and make load() return false; the temporary
+files are removed either way.
+
+beginUpload() / continueUpload() then upload the chunks,
+each one as a mesh of its own, under the byte budget of
+AsyncLoader::pump().  A chunk is read from the file only
+as far as it is uploaded, into one buffer of at most a
+chunk, so the memory limit holds for the upload too.
+*****************************************************/
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Obj.h"
+
+#ifndef __STREAMED_OBJ_H__
+#define __STREAMED_OBJ_H__
+
+// The processed chunks of a StreamedObj load; deletes its file
+struct StreamedChunks {
+    std::string path;
+    FILE* writer = NULL;           // while load() appends to the file
+    FILE* reader = NULL;           // afterwards, for the upload
+    std::vector<uint64_t> offsets; // of each chunk in the file
+    std::vector<MeshView> views;   // layout of each chunk, without data
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f), positionBias = glm::vec3(0.0f);
+    size_t corners = 0;
+
+    StreamedChunks() = default;
+    StreamedChunks(const StreamedChunks&) = delete;
+    StreamedChunks& operator=(const StreamedChunks&) = delete;
+    ~StreamedChunks();
+};
+
+class StreamedObj : public Obj {
+public:
+    // Loads and uploads at once, on the GL thread (AssetManager::acquire)
+    void init(const char * filename) override;
+
+    // Same contract as Obj::load; fills result.chunks
+    static bool load(const char * filename, const ObjLoadOptions& options, ObjLoadResult& result);
+    void beginUpload(const ObjLoadResult& result) override;
+    bool continueUpload(const ObjLoadResult& result, size_t& budget) override;
+
+    void draw(void) override;
+    void release(void) override;
+
+    size_t chunkCount() const { return chunks_.size(); }
+
+    // Peak resident memory of the process so far, in bytes
+    static size_t peakResidentBytes();
+
+private:
+    std::vector<std::unique_ptr<Obj>> chunks_; // one per uploaded piece
+    // The chunk being uploaded: its data as far as it was read
+    std::vector<char> buffer_;
+    MeshView chunkView_;
+    size_t chunkBytes_ = 0, chunkRead_ = 0;
+
+    bool failUpload(const StreamedChunks& chunks);
+};
+
+#endif
@@ -0,0 +1,79 @@
+/**************************************************
+Transform places an object relative to a parent
+transform, or to the world when it has none:
+
+ world = parent.world * translate(position)
+                      * rotate(rotation) * scale(scale)
+
+The rotation is a quaternion, so rotations applied
+every frame do not drift away from a rotation the way
+a product of matrices does.
+
+world() and normalMatrix() are cached and only
+recomputed after the transform or one of its ancestors
+changed.  Children do not have to be listed for that:
+every recomputation gets a new version() number, and a
+child whose parent's version differs from the one it
+was built from is out of date.  A parent has to outlive
+its children (it is normally the scene root).
+
+ Transform root;
+ Transform child(glm::vec3(1.0f, 0.0f, 0.0f));
+ child.setParent(&root);
+ root.rotate(glm::angleAxis(angle, axis)); // moves child too
+ draw(child.world(), child.normalMatrix());
+
+normalMatrix() is the inverse transpose of the upper
+3x3 of world(), for normals; it is built from the
+rotations and inverse scales, without a matrix inverse.
+*****************************************************/
+#include <cstdint>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+class Transform {
+public:
+    Transform() = default;
+    explicit Transform(const glm::vec3& position) : position_(position) {}
+
+    const glm::vec3& position() const { return position_; }
+    const glm::quat& rotation() const { return rotation_; }
+    const glm::vec3& scale() const { return scale_; }
+    const Transform* parent() const { return parent_; }
+
+    void setPosition(const glm::vec3& position);
+    void setRotation(const glm::quat& rotation);
+    void setScale(const glm::vec3& scale);
+    void setParent(const Transform* parent);
+
+    // Moves and rotates in the object's own frame, like glm::translate and
+    // glm::rotate applied to its matrix
+    void translate(const glm::vec3& offset);
+    void rotate(const glm::quat& rotation);
+
+    const glm::mat4& world() const;
+    const glm::mat3& normalMatrix() const;
+    // Changes whenever world() does; unique across all transforms
+    uint64_t version() const;
+
+private:
+    glm::vec3 position_ = glm::vec3(0.0f);
+    glm::quat rotation_ = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale_ = glm::vec3(1.0f);
+    const Transform* parent_ = nullptr;
+
+    // cache
+    mutable glm::mat4 world_ = glm::mat4(1.0f);
+    mutable glm::mat3 normal_ = glm::mat3(1.0f);
+    mutable uint64_t version_ = 0;
+    mutable uint64_t parentVersion_ = 0; // of the parent when world_ was computed
+    mutable bool dirty_ = true;
+
+    void update() const;
+};
+
+#endif
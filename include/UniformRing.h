@@ -0,0 +1,81 @@
+/**************************************************
+UniformRing streams uniform block data to the GPU
+through one buffer that stays mapped for its whole
+lifetime, instead of one glUniform call per value.
+
+The buffer is split into frameCount regions.  Each
+frame writes into the next region, and every upload()
+appends its data there (at the uniform buffer offset
+alignment) and binds that range to a uniform block
+binding point with glBindBufferRange:
+
+ ring.beginFrame();       // waits for the region's fence
+ ring.upload(binding, &data, sizeof(data)); // ...
+ ring.endFrame();         // fences the region
+
+With three regions the CPU writes one frame while the
+GPU may still read the two before it, so the fence
+wait in beginFrame() normally returns at once and the
+driver never has to synchronize implicitly.
+
+The mapping needs OpenGL 4.4 or ARB_buffer_storage
+(glBufferStorage with GL_MAP_PERSISTENT_BIT and
+GL_MAP_COHERENT_BIT).  Without them the same regions
+and fences are used, but each upload() is copied with
+glBufferSubData.  A region that runs out of space is
+replaced by a buffer twice as large.  The old buffer is
+not deleted before the fence of that frame has passed:
+the blocks uploaded earlier in the frame (FrameData)
+stay bound to it, and the draws already issued read it.
+*****************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef __UNIFORM_RING_H__
+#define __UNIFORM_RING_H__
+
+class UniformRing {
+public:
+    static constexpr int frameCount = 3;
+
+    // Creates the buffer (needs a current GL context)
+    void init(size_t bytesPerFrame);
+
+    void beginFrame();
+    // Copies data into this frame's region and binds it to binding
+    void upload(GLuint binding, const void* data, size_t size);
+    void endFrame();
+
+    bool persistent() const { return mapped_ != nullptr; }
+    size_t bytesPerFrame() const { return regionSize_; }
+    size_t bytesUsed() const { return head_; }        // by the current frame
+    size_t uploads() const { return uploads_; }       // by the current frame
+    double waitMilliseconds() const { return waitMilliseconds_; } // in the last beginFrame
+
+    // Frees the buffer and the fences (needs a current GL context)
+    void release();
+
+private:
+    GLuint buffer_ = 0;
+    char* mapped_ = nullptr;      // persistent mapping of the whole buffer
+    size_t regionSize_ = 0;
+    size_t alignment_ = 256;      // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    int region_ = 0;              // region of the current frame
+    size_t head_ = 0;             // next free byte in that region
+    size_t uploads_ = 0;
+    double waitMilliseconds_ = 0.0;
+    GLsync fences_[frameCount] = {};
+    // Replaced buffers, deleted once the fence of the frame that replaced
+    // them has passed (0 until that frame ends)
+    struct RetiredBuffer {
+        GLuint buffer;
+        GLsync fence;
+    };
+    std::vector<RetiredBuffer> retired_;
+
+    void createBuffer(size_t bytesPerFrame);
+    void deleteRetired(bool wait);
+};
+
+#endif
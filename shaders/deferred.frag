@@ -0,0 +1,72 @@
+#version 330 core
+
+// Lighting pass of the deferred path: every pixel of the G-buffer once,
+// with the same lights as normal.frag
+
+// Same block as projective.vert
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 clusterScale; // tiles per pixel (x, y), slice = log(depth) * z + w
+    uvec4 clusterSize; // tiles x, y, slices, point lights (0: none)
+};
+
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferDepth;
+
+// Point lights binned by LightClusters, as in normal.frag
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLights;
+uniform samplerBuffer lightData;
+
+out vec4 color;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Same as in normal.frag, for a view space position and normal
+vec3 pointLighting(vec3 position, vec3 normal) {
+    vec3 light = vec3(0.0);
+    if (clusterSize.w == 0u)
+        return light;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterSize.xy - 1u);
+    uint slice = uint(clamp(log(-position.z) * clusterScale.z + clusterScale.w, 0.0, float(clusterSize.z - 1u)));
+    uvec2 list = texelFetch(clusterGrid, int((slice * clusterSize.y + tile.y) * clusterSize.x + tile.x)).xy;
+    for (uint k = 0u; k < list.y; k++) {
+        int index = int(texelFetch(clusterLights, int(list.x + k)).x);
+        vec4 positionRadius = texelFetch(lightData, 2 * index);
+        vec3 toLight = positionRadius.xyz - position;
+        float lightDistance = length(toLight);
+        float falloff = clamp(1.0 - lightDistance / positionRadius.w, 0.0, 1.0);
+        float diffuse = max(dot(normal, toLight / max(lightDistance, 1e-4)), 0.0);
+        light += texelFetch(lightData, 2 * index + 1).rgb * (diffuse * falloff * falloff);
+    }
+    return light;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(gbufferAlbedo, pixel, 0);
+    if (albedo.a < 0.5)
+        discard; // nothing drawn: keep the background and its depth
+
+    // view space position from the depth, for glm::perspective projections
+    float depth = texelFetch(gbufferDepth, pixel, 0).r;
+    vec3 ndc = vec3(gl_FragCoord.xy / vec2(textureSize(gbufferDepth, 0)), depth) * 2.0 - 1.0;
+    float viewZ = -projection[3][2] / (ndc.z + projection[2][2]);
+    vec3 position = vec3(-viewZ * ndc.x / projection[0][0], -viewZ * ndc.y / projection[1][1], viewZ);
+    vec3 normal = octahedralDecode(texelFetch(gbufferNormal, pixel, 0).xy * 2.0 - 1.0);
+
+    vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0));
+    float diffuse = max(dot(normal, lightDir), 0.0);
+    color = vec4(albedo.rgb * (0.2 + 0.8 * diffuse + pointLighting(position, normal)), 1.0);
+
+    // the translucent draws that follow are tested against this depth
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,41 @@
+#version 330 core
+
+// Depth pre-pass: only the position stream is read, and gl_Position is
+// computed exactly as in projective.vert, so the color pass can test
+// with GL_EQUAL against the depth written here
+layout(location = 0) in vec3 position;
+
+// Same per-instance attributes as projective.vert (the highlight is
+// not needed)
+layout(location = 2) in vec4 instanceRow0;
+layout(location = 3) in vec4 instanceRow1;
+layout(location = 4) in vec4 instanceRow2;
+layout(location = 6) in vec3 instanceScale;
+layout(location = 7) in vec3 instanceBias;
+
+// Same blocks as projective.vert
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 clusterScale; // tiles per pixel (x, y), slice = log(depth) * z + w
+    uvec4 clusterSize; // tiles x, y, slices, point lights (0: none)
+};
+
+layout(std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 highlightColor;
+    vec4 baseColor;
+    int isHighlighted;
+};
+
+invariant gl_Position;
+
+void main() {
+    mat4 instanceModel = transpose(mat4(instanceRow0, instanceRow1, instanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+    mat4 instanceModelview = view * model * instanceModel;
+    vec4 worldPosition = instanceModelview * vec4(instanceBias + (positionBias.xyz + position * positionScale.xyz) * instanceScale, 1.0);
+    gl_Position = projection * worldPosition;
+}
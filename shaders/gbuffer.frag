@@ -0,0 +1,38 @@
+#version 330 core
+
+// Geometry pass of the deferred path (see GBuffer.h), after
+// projective.vert: what lighting needs, instead of a color
+
+in vec3 fragNormal;
+in vec3 fragPosition;
+flat in float fragHighlight;
+
+// Same block as in the vertex shader
+layout(std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix; // of model, in the upper 3x3
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 highlightColor;
+    vec4 baseColor;
+    int isHighlighted;
+};
+
+layout(location = 0) out vec2 gbufferNormal; // RG16
+layout(location = 1) out vec4 gbufferAlbedo; // RGBA8
+
+// Unit vector -> point of the [-1, 1] square: the octahedron |x|+|y|+|z| = 1
+// unfolded, with the lower half folded out over the corners
+vec2 octahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+
+void main() {
+    gbufferNormal = octahedralEncode(normalize(fragNormal)) * 0.5 + 0.5;
+    vec4 currentColor = (isHighlighted == 1 || fragHighlight > 0.5) ? highlightColor : baseColor;
+    gbufferAlbedo = vec4(currentColor.rgb, 1.0); // a: geometry was drawn here
+}
@@ -2,18 +2,61 @@
 
 in vec3 fragNormal;
 in vec3 fragPosition;
+flat in float fragHighlight;
 
-uniform vec4 baseColor = vec4(0.8, 0.8, 0.8, 1.0);
-uniform vec4 highlightColor = vec4(1.0, 0.5, 0.0, 1.0);
-uniform int isHighlighted;
+// Same blocks as in the vertex shader
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 clusterScale; // tiles per pixel (x, y), slice = log(depth) * z + w
+    uvec4 clusterSize; // tiles x, y, slices, point lights (0: none)
+};
+
+layout(std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix; // of model, in the upper 3x3
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 highlightColor;
+    vec4 baseColor;
+    int isHighlighted;
+};
+
+// Point lights binned by LightClusters: the offset and count of each
+// cluster's list, the lists, and per light its view space position and
+// radius followed by its color
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLights;
+uniform samplerBuffer lightData;
 
 out vec4 color;
 
+// Diffuse light of the point lights whose range reaches this fragment's
+// cluster; fragPosition and normal are in view space
+vec3 pointLighting(vec3 normal) {
+    vec3 light = vec3(0.0);
+    if (clusterSize.w == 0u)
+        return light;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterSize.xy - 1u);
+    uint slice = uint(clamp(log(-fragPosition.z) * clusterScale.z + clusterScale.w, 0.0, float(clusterSize.z - 1u)));
+    uvec2 list = texelFetch(clusterGrid, int((slice * clusterSize.y + tile.y) * clusterSize.x + tile.x)).xy;
+    for (uint k = 0u; k < list.y; k++) {
+        int index = int(texelFetch(clusterLights, int(list.x + k)).x);
+        vec4 positionRadius = texelFetch(lightData, 2 * index);
+        vec3 toLight = positionRadius.xyz - fragPosition;
+        float lightDistance = length(toLight);
+        float falloff = clamp(1.0 - lightDistance / positionRadius.w, 0.0, 1.0);
+        float diffuse = max(dot(normal, toLight / max(lightDistance, 1e-4)), 0.0);
+        light += texelFetch(lightData, 2 * index + 1).rgb * (diffuse * falloff * falloff);
+    }
+    return light;
+}
+
 void main() {
     vec3 normal = normalize(fragNormal);
     vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0));
     float diffuse = max(dot(normal, lightDir), 0.0);
 
-    vec4 currentColor = isHighlighted == 1 ? highlightColor : baseColor;
-    color = currentColor * (0.2 + 0.8 * diffuse);
+    vec4 currentColor = (isHighlighted == 1 || fragHighlight > 0.5) ? highlightColor : baseColor;
+    color = vec4(currentColor.rgb * (0.2 + 0.8 * diffuse + pointLighting(normal)), currentColor.a);
 }
\ No newline at end of file
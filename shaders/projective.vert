@@ -3,15 +3,58 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 
-uniform mat4 modelview;
-uniform mat4 projection;
+// Per-instance model matrix rows and highlight flag; draws that are not
+// instanced get an identity matrix and no highlight
+layout(location = 2) in vec4 instanceRow0;
+layout(location = 3) in vec4 instanceRow1;
+layout(location = 4) in vec4 instanceRow2;
+layout(location = 5) in float instanceHighlight;
+
+// Per-instance position decoding, for indirect draws that mix meshes
+// quantized to different boxes; identity otherwise
+layout(location = 6) in vec3 instanceScale;
+layout(location = 7) in vec3 instanceBias;
+
+// Written once per frame
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 clusterScale; // tiles per pixel (x, y), slice = log(depth) * z + w
+    uvec4 clusterSize; // tiles x, y, slices, point lights (0: none)
+};
+
+// Written once per draw; quantized meshes store positions as fractions
+// of their bounding box (positionScale and positionBias).  normalMatrix
+// is computed on the CPU, when the model's transform changes.
+layout(std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix; // of model, in the upper 3x3
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 highlightColor;
+    vec4 baseColor;
+    int isHighlighted;
+};
 
 out vec3 fragNormal;
 out vec3 fragPosition;
+flat out float fragHighlight;
+
+// Bit-identical to depth.vert, for the GL_EQUAL test after the pre-pass
+invariant gl_Position;
 
 void main() {
-    vec4 worldPosition = modelview * vec4(position, 1.0);
+    mat4 instanceModel = transpose(mat4(instanceRow0, instanceRow1, instanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+    mat4 instanceModelview = view * model * instanceModel;
+    vec4 worldPosition = instanceModelview * vec4(instanceBias + (positionBias.xyz + position * positionScale.xyz) * instanceScale, 1.0);
     fragPosition = worldPosition.xyz;
-    fragNormal = mat3(transpose(inverse(modelview))) * normal;
+    // The view is a rotation and translation, so its normal matrix is its
+    // own upper 3x3.  The instance matrix needs the cofactor matrix: the
+    // inverse transpose up to a scale, which normalize() removes later.
+    mat3 instanceLinear = mat3(instanceModel);
+    mat3 instanceNormal = mat3(cross(instanceLinear[1], instanceLinear[2]), cross(instanceLinear[2], instanceLinear[0]),
+                              cross(instanceLinear[0], instanceLinear[1]));
+    fragNormal = mat3(view) * mat3(normalMatrix) * instanceNormal * normal;
+    fragHighlight = instanceHighlight;
     gl_Position = projection * worldPosition;
 }
\ No newline at end of file
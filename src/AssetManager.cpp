@@ -0,0 +1,63 @@
+#include <filesystem>
+#include <iostream>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include "AssetManager.h"
+#include "StreamedObj.h"
+
+std::shared_ptr<Obj> AssetManager::acquire(const char* filename) {
+    std::weak_ptr<Obj>& entry = meshes_[filename];
+    if (std::shared_ptr<Obj> mesh = entry.lock()) {
+        std::cout << "Reusing " << filename << " (" << mesh.use_count() - 1 << " other instances)." << std::endl;
+        return mesh;
+    }
+
+    std::shared_ptr<Obj> mesh = createMesh(filename);
+    mesh->init(filename);
+    entry = mesh;
+    return mesh;
+}
+
+std::shared_ptr<Obj> AssetManager::acquireAsync(const char* filename, int priority) {
+    std::weak_ptr<Obj>& entry = meshes_[filename];
+    std::shared_ptr<Obj> mesh = entry.lock();
+    if (mesh && !mesh->failed) { // a failed file is tried again
+        if (!mesh->ready)
+            loader.prioritize(mesh.get(), priority);
+        return mesh;
+    }
+
+    mesh = createMesh(filename);
+    loader.request(mesh, filename, options, priority);
+    entry = mesh;
+    return mesh;
+}
+
+std::shared_ptr<Obj> AssetManager::createMesh(const char* filename) const {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(filename, error);
+    bool streamed = !error && (size >> 20) >= options.streamingThresholdMB;
+
+    // The last reference frees the GPU buffers along with the object
+    std::shared_ptr<Obj> mesh(streamed ? new StreamedObj() : new Obj(), [](Obj* obj) {
+        obj->release();
+        delete obj;
+    });
+    mesh->options = options;
+    return mesh;
+}
+
+size_t AssetManager::meshCount() const {
+    size_t n = 0;
+    for (const auto& entry : meshes_) {
+        if (!entry.second.expired())
+            n++;
+    }
+    return n;
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <iostream>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include "AsyncLoader.h"
+#include "StreamedObj.h"
+
+AsyncLoader::~AsyncLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& job : queued_)
+            job->cancelled = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_)
+        worker.join();
+}
+
+void AsyncLoader::request(const std::shared_ptr<Obj>& mesh, const std::string& filename,
+                          const ObjLoadOptions& options, int priority) {
+    auto job = std::make_shared<Job>();
+    job->mesh = mesh;
+    job->key = mesh.get();
+    job->filename = filename;
+    job->options = options;
+    job->priority = priority;
+    job->streamed = (dynamic_cast<StreamedObj*>(mesh.get()) != nullptr);
+    mesh->ready = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job->sequence = sequence_++;
+        queued_.push_back(job);
+        if (workers_.empty()) {
+            for (unsigned int i = 0; i < std::max(1u, threadCount_); i++)
+                workers_.emplace_back(&AsyncLoader::workerLoop, this);
+        }
+    }
+    wake_.notify_one();
+}
+
+void AsyncLoader::prioritize(const Obj* mesh, int priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto* jobs : { &queued_, &finished_ }) {
+        for (auto& job : *jobs) {
+            if (job->key == mesh)
+                job->priority = priority;
+        }
+    }
+}
+
+void AsyncLoader::cancel(const Obj* mesh) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto matches = [mesh](const std::shared_ptr<Job>& job) { return job->key == mesh; };
+    for (auto* jobs : { &queued_, &finished_, &failed_ })
+        jobs->erase(std::remove_if(jobs->begin(), jobs->end(), matches), jobs->end());
+    for (auto& job : loading_) {
+        if (matches(job))
+            job->cancelled = true; // the worker drops it when it is done
+    }
+    if (uploading_ && matches(uploading_))
+        uploading_->cancelled = true;
+}
+
+void AsyncLoader::cancelAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_.clear();
+    finished_.clear();
+    failed_.clear();
+    for (auto& job : loading_)
+        job->cancelled = true;
+    if (uploading_)
+        uploading_->cancelled = true;
+}
+
+std::shared_ptr<AsyncLoader::Job> AsyncLoader::takeBest(std::vector<std::shared_ptr<Job>>& jobs) {
+    if (jobs.empty())
+        return nullptr;
+    auto best = jobs.begin();
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if ((*it)->priority > (*best)->priority ||
+            ((*it)->priority == (*best)->priority && (*it)->sequence < (*best)->sequence))
+            best = it;
+    }
+    std::shared_ptr<Job> job = *best;
+    jobs.erase(best);
+    return job;
+}
+
+void AsyncLoader::workerLoop() {
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return stopping_ || !queued_.empty(); });
+            if (stopping_)
+                return;
+            job = takeBest(queued_);
+            loading_.push_back(job);
+        }
+
+        // Nobody is waiting for meshes that have no instance left
+        if (!job->cancelled && !job->mesh.expired())
+            job->ok = job->streamed ? StreamedObj::load(job->filename.c_str(), job->options, job->result)
+                                    : Obj::load(job->filename.c_str(), job->options, job->result);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        loading_.erase(std::find(loading_.begin(), loading_.end(), job));
+        if (!job->cancelled && !job->mesh.expired())
+            (job->ok ? finished_ : failed_).push_back(job);
+    }
+}
+
+size_t AsyncLoader::pump(size_t budgetBytes) {
+    // Failed loads are reported here, on the thread that owns the meshes
+    std::vector<std::shared_ptr<Job>> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed.swap(failed_);
+    }
+    for (auto& job : failed) {
+        if (std::shared_ptr<Obj> mesh = job->mesh.lock()) {
+            mesh->failed = true;
+            std::cerr << "Cannot load " << job->filename << "; it will not be shown." << std::endl;
+            failedCount_++;
+        }
+    }
+
+    size_t budget = budgetBytes;
+    while (budget > 0) {
+        if (!uploading_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            uploading_ = takeBest(finished_);
+            if (!uploading_)
+                break;
+            if (std::shared_ptr<Obj> mesh = uploading_->mesh.lock())
+                mesh->beginUpload(uploading_->result);
+        }
+
+        std::shared_ptr<Obj> mesh = uploading_->mesh.lock();
+        if (!mesh || uploading_->cancelled || mesh->continueUpload(uploading_->result, budget))
+            uploading_.reset(); // frees the CPU copy (or unmaps the cache)
+    }
+    return budgetBytes - budget;
+}
+
+size_t AsyncLoader::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_.size() + loading_.size() + finished_.size() + failed_.size() + (uploading_ ? 1 : 0);
+}
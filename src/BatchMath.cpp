@@ -0,0 +1,457 @@
+// glm's SSE functions (glm/simd/*.h) are only declared with intrinsics
+// enabled.  That only changes glm's aligned types, which the rest of the
+// program does not use, so glm::mat4 code is the same as in other files.
+#define GLM_FORCE_INTRINSICS
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "BatchMath.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_MATH_SSE 1
+#include <emmintrin.h>
+#include <glm/simd/matrix.h>
+#endif
+
+void BatchMath::store(AffineArrays& arrays, size_t i, const glm::mat4& matrix) {
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 4; column++)
+            arrays[row * 4 + column][i] = matrix[column][row];
+}
+
+glm::mat4 BatchMath::load(const AffineArrays& arrays, size_t i) {
+    glm::mat4 matrix(1.0f);
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 4; column++)
+            matrix[column][row] = arrays[row * 4 + column][i];
+    return matrix;
+}
+
+// Scalar references
+
+namespace {
+
+// a * m[i] for multiplyScalar(), with the rows of a in weights
+void multiplyOne(const float weights[3][4], const AffineArrays& m, size_t i, float result[12]) {
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            float sum = (column == 3) ? weights[row][3] : 0.0f;
+            for (int k = 0; k < 3; k++)
+                sum += weights[row][k] * m[k * 4 + column][i];
+            result[row * 4 + column] = sum;
+        }
+    }
+}
+
+}
+
+void BatchMath::multiplyScalar(const glm::mat4& a, const AffineArrays& m, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    // a copied, so that the stores to out cannot change it
+    float weights[3][4];
+    for (int row = 0; row < 3; row++)
+        for (int k = 0; k < 4; k++)
+            weights[row][k] = a[k][row];
+    for (size_t i = 0; i < n; i++) {
+        float result[12];
+        multiplyOne(weights, m, i, result);
+        for (int c = 0; c < 12; c++)
+            out[c][i] = result[c];
+    }
+}
+
+void BatchMath::multiplyScalar(const glm::mat4& a, const AffineArrays& m, const uint32_t* indices, AffineArrays& out,
+                               size_t n) {
+    out.resize(std::max(out.size(), n));
+    float weights[3][4];
+    for (int row = 0; row < 3; row++)
+        for (int k = 0; k < 4; k++)
+            weights[row][k] = a[k][row];
+    for (size_t i = 0; i < n; i++) {
+        float result[12];
+        multiplyOne(weights, m, indices[i], result);
+        for (int c = 0; c < 12; c++)
+            out[c][i] = result[c];
+    }
+}
+
+void BatchMath::inverseScalar(const AffineArrays& m, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    for (size_t i = 0; i < n; i++) {
+        float l[3][3], t[3];
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                l[row][column] = m[row * 4 + column][i];
+            t[row] = m[row * 4 + 3][i];
+        }
+        // inverse of the 3x3 part: transposed cofactors over the determinant
+        float c[3][3];
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++) {
+                int r0 = (row + 1) % 3, r1 = (row + 2) % 3, c0 = (column + 1) % 3, c1 = (column + 2) % 3;
+                c[row][column] = l[r0][c0] * l[r1][c1] - l[r0][c1] * l[r1][c0];
+            }
+        }
+        float inverseDeterminant = 1.0f / (l[0][0] * c[0][0] + l[0][1] * c[0][1] + l[0][2] * c[0][2]);
+        for (int row = 0; row < 3; row++) {
+            float translation = 0.0f;
+            for (int column = 0; column < 3; column++) {
+                float value = c[column][row] * inverseDeterminant;
+                out[row * 4 + column][i] = value;
+                translation -= value * t[column];
+            }
+            out[row * 4 + 3][i] = translation;
+        }
+    }
+}
+
+void BatchMath::transformBoxesScalar(const AffineArrays& m, const BoxArrays& boxes, BoxArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    for (size_t i = 0; i < n; i++) {
+        float center[3], extent[3];
+        for (int axis = 0; axis < 3; axis++) {
+            center[axis] = 0.5f * (boxes[MIN_X + axis][i] + boxes[MAX_X + axis][i]);
+            extent[axis] = 0.5f * (boxes[MAX_X + axis][i] - boxes[MIN_X + axis][i]);
+        }
+        for (int row = 0; row < 3; row++) {
+            float worldCenter = m[row * 4 + 3][i], worldExtent = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                worldCenter += m[row * 4 + k][i] * center[k];
+                worldExtent += std::fabs(m[row * 4 + k][i]) * extent[k];
+            }
+            out[MIN_X + row][i] = worldCenter - worldExtent;
+            out[MAX_X + row][i] = worldCenter + worldExtent;
+        }
+    }
+}
+
+void BatchMath::fromTransformsScalar(const TransformArrays& transforms, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    for (size_t i = 0; i < n; i++) {
+        float x = transforms[ROTATION_X][i], y = transforms[ROTATION_X + 1][i];
+        float z = transforms[ROTATION_X + 2][i], w = transforms[ROTATION_X + 3][i];
+        float rotation[3][3] = {
+            { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - w * z), 2.0f * (x * z + w * y) },
+            { 2.0f * (x * y + w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - w * x) },
+            { 2.0f * (x * z - w * y), 2.0f * (y * z + w * x), 1.0f - 2.0f * (x * x + y * y) },
+        };
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                out[row * 4 + column][i] = rotation[row][column] * transforms[SCALE_X + column][i];
+            out[row * 4 + 3][i] = transforms[POSITION_X + row][i];
+        }
+    }
+}
+
+#ifdef BATCH_MATH_SSE
+
+// Four objects per iteration; the arrays are aligned and padded, so the
+// last iteration may run into the padding
+
+namespace {
+
+// a * m for four matrices, with the rows of a broadcast in weights
+inline void multiply4(const __m128 weights[3][4], const __m128 input[12], __m128 result[12]) {
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            __m128 sum = _mm_mul_ps(weights[row][0], input[column]);
+            sum = _mm_add_ps(sum, _mm_mul_ps(weights[row][1], input[4 + column]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(weights[row][2], input[8 + column]));
+            if (column == 3)
+                sum = _mm_add_ps(sum, weights[row][3]);
+            result[row * 4 + column] = sum;
+        }
+    }
+}
+
+}
+
+void BatchMath::multiply(const glm::mat4& a, const AffineArrays& m, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    __m128 weights[3][4];
+    for (int row = 0; row < 3; row++)
+        for (int k = 0; k < 4; k++)
+            weights[row][k] = _mm_set1_ps(a[k][row]);
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 input[12];
+        for (int c = 0; c < 12; c++)
+            input[c] = _mm_load_ps(m[c] + i);
+        __m128 result[12];
+        multiply4(weights, input, result);
+        for (int c = 0; c < 12; c++)
+            _mm_store_ps(out[c] + i, result[c]);
+    }
+}
+
+void BatchMath::multiply(const glm::mat4& a, const AffineArrays& m, const uint32_t* indices, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    __m128 weights[3][4];
+    for (int row = 0; row < 3; row++)
+        for (int k = 0; k < 4; k++)
+            weights[row][k] = _mm_set1_ps(a[k][row]);
+    for (size_t i = 0; i < n; i += 4) {
+        // the indices are not padded: the last group repeats the last one
+        size_t j[4];
+        for (int lane = 0; lane < 4; lane++)
+            j[lane] = indices[std::min(i + lane, n - 1)];
+        __m128 input[12];
+        for (int c = 0; c < 12; c++)
+            input[c] = _mm_setr_ps(m[c][j[0]], m[c][j[1]], m[c][j[2]], m[c][j[3]]);
+        __m128 result[12];
+        multiply4(weights, input, result);
+        for (int c = 0; c < 12; c++)
+            _mm_store_ps(out[c] + i, result[c]);
+    }
+}
+
+void BatchMath::inverse(const AffineArrays& m, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 l[3][3], t[3];
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                l[row][column] = _mm_load_ps(m[row * 4 + column] + i);
+            t[row] = _mm_load_ps(m[row * 4 + 3] + i);
+        }
+        __m128 c[3][3];
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++) {
+                int r0 = (row + 1) % 3, r1 = (row + 2) % 3, c0 = (column + 1) % 3, c1 = (column + 2) % 3;
+                c[row][column] = _mm_sub_ps(_mm_mul_ps(l[r0][c0], l[r1][c1]), _mm_mul_ps(l[r0][c1], l[r1][c0]));
+            }
+        }
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l[0][0], c[0][0]), _mm_mul_ps(l[0][1], c[0][1])),
+                                        _mm_mul_ps(l[0][2], c[0][2]));
+        __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+        for (int row = 0; row < 3; row++) {
+            __m128 translation = _mm_setzero_ps();
+            for (int column = 0; column < 3; column++) {
+                __m128 value = _mm_mul_ps(c[column][row], inverseDeterminant);
+                _mm_store_ps(out[row * 4 + column] + i, value);
+                translation = _mm_sub_ps(translation, _mm_mul_ps(value, t[column]));
+            }
+            _mm_store_ps(out[row * 4 + 3] + i, translation);
+        }
+    }
+}
+
+void BatchMath::transformBoxes(const AffineArrays& m, const BoxArrays& boxes, BoxArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 center[3], extent[3];
+        for (int axis = 0; axis < 3; axis++) {
+            __m128 lo = _mm_load_ps(boxes[MIN_X + axis] + i);
+            __m128 hi = _mm_load_ps(boxes[MAX_X + axis] + i);
+            center[axis] = _mm_mul_ps(half, _mm_add_ps(lo, hi));
+            extent[axis] = _mm_mul_ps(half, _mm_sub_ps(hi, lo));
+        }
+        __m128 lo[3], hi[3];
+        for (int row = 0; row < 3; row++) {
+            __m128 worldCenter = _mm_load_ps(m[row * 4 + 3] + i);
+            __m128 worldExtent = _mm_setzero_ps();
+            for (int k = 0; k < 3; k++) {
+                __m128 element = _mm_load_ps(m[row * 4 + k] + i);
+                worldCenter = _mm_add_ps(worldCenter, _mm_mul_ps(element, center[k]));
+                worldExtent = _mm_add_ps(worldExtent, _mm_mul_ps(_mm_and_ps(element, absMask), extent[k]));
+            }
+            lo[row] = _mm_sub_ps(worldCenter, worldExtent);
+            hi[row] = _mm_add_ps(worldCenter, worldExtent);
+        }
+        for (int row = 0; row < 3; row++) {
+            _mm_store_ps(out[MIN_X + row] + i, lo[row]);
+            _mm_store_ps(out[MAX_X + row] + i, hi[row]);
+        }
+    }
+}
+
+void BatchMath::fromTransforms(const TransformArrays& transforms, AffineArrays& out, size_t n) {
+    out.resize(std::max(out.size(), n));
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 x = _mm_load_ps(transforms[ROTATION_X] + i);
+        __m128 y = _mm_load_ps(transforms[ROTATION_X + 1] + i);
+        __m128 z = _mm_load_ps(transforms[ROTATION_X + 2] + i);
+        __m128 w = _mm_load_ps(transforms[ROTATION_X + 3] + i);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+        __m128 rotation[3][3] = {
+            { _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_sub_ps(xy, wz)),
+              _mm_mul_ps(two, _mm_add_ps(xz, wy)) },
+            { _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))),
+              _mm_mul_ps(two, _mm_sub_ps(yz, wx)) },
+            { _mm_mul_ps(two, _mm_sub_ps(xz, wy)), _mm_mul_ps(two, _mm_add_ps(yz, wx)),
+              _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))) },
+        };
+        __m128 scale[3];
+        for (int column = 0; column < 3; column++)
+            scale[column] = _mm_load_ps(transforms[SCALE_X + column] + i);
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                _mm_store_ps(out[row * 4 + column] + i, _mm_mul_ps(rotation[row][column], scale[column]));
+            _mm_store_ps(out[row * 4 + 3] + i, _mm_load_ps(transforms[POSITION_X + row] + i));
+        }
+    }
+}
+
+#else
+
+void BatchMath::multiply(const glm::mat4& a, const AffineArrays& m, AffineArrays& out, size_t n) {
+    multiplyScalar(a, m, out, n);
+}
+
+void BatchMath::multiply(const glm::mat4& a, const AffineArrays& m, const uint32_t* indices, AffineArrays& out, size_t n) {
+    multiplyScalar(a, m, indices, out, n);
+}
+
+void BatchMath::inverse(const AffineArrays& m, AffineArrays& out, size_t n) {
+    inverseScalar(m, out, n);
+}
+
+void BatchMath::transformBoxes(const AffineArrays& m, const BoxArrays& boxes, BoxArrays& out, size_t n) {
+    transformBoxesScalar(m, boxes, out, n);
+}
+
+void BatchMath::fromTransforms(const TransformArrays& transforms, AffineArrays& out, size_t n) {
+    fromTransformsScalar(transforms, out, n);
+}
+
+#endif
+
+namespace {
+
+template <int Components>
+float maxDifference(const FloatArrays<Components>& a, const FloatArrays<Components>& b, size_t n) {
+    float difference = 0.0f;
+    for (int c = 0; c < Components; c++)
+        for (size_t i = 0; i < n; i++)
+            difference = std::max(difference, std::fabs(a[c][i] - b[c][i]));
+    return difference;
+}
+
+// Best of a few runs of body, in nanoseconds per object
+template <typename Function>
+double timePerObject(size_t n, Function&& body) {
+    double best = 1e30;
+    for (int run = 0; run < 10; run++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best / n;
+}
+
+void report(const char* name, double nanoseconds) {
+    std::cout << "  " << name << ": " << nanoseconds << " ns per object, "
+              << 1000.0 / nanoseconds << " M objects/s" << std::endl;
+}
+
+}
+
+int BatchMath::benchmark() {
+    const size_t n = 100000;
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> spread(-100.0f, 100.0f), unit(-1.0f, 1.0f), scale(0.5f, 2.0f);
+
+    // Random rigid-plus-scale placements, both as glm matrices and as arrays
+    TransformArrays transforms;
+    transforms.resize(n);
+    BoxArrays boxes;
+    boxes.resize(n);
+    std::vector<glm::mat4> matrices(n);
+    for (size_t i = 0; i < n; i++) {
+        glm::vec3 position(spread(random), spread(random), spread(random));
+        glm::quat rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+        glm::vec3 scaling(scale(random), scale(random), scale(random));
+        for (int axis = 0; axis < 3; axis++) {
+            transforms[POSITION_X + axis][i] = position[axis];
+            transforms[SCALE_X + axis][i] = scaling[axis];
+            boxes[MIN_X + axis][i] = -unit(random) - 1.0f;
+            boxes[MAX_X + axis][i] = unit(random) + 1.0f;
+        }
+        transforms[ROTATION_X][i] = rotation.x;
+        transforms[ROTATION_X + 1][i] = rotation.y;
+        transforms[ROTATION_X + 2][i] = rotation.z;
+        transforms[ROTATION_X + 3][i] = rotation.w;
+        matrices[i] = glm::scale(glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation), scaling);
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 4.0f, 15.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<glm::mat4> products(n);
+    AffineArrays models, reference, result;
+
+    std::cout << "Batch math benchmark: " << n << " objects" << std::endl;
+    std::cout << " position, rotation and scale to matrix" << std::endl;
+    report("glm::mat4 one by one", timePerObject(n, [&]() {
+        for (size_t i = 0; i < n; i++) {
+            glm::vec3 position(transforms[POSITION_X][i], transforms[POSITION_X + 1][i], transforms[POSITION_X + 2][i]);
+            glm::quat rotation(transforms[ROTATION_X + 3][i], transforms[ROTATION_X][i], transforms[ROTATION_X + 1][i],
+                               transforms[ROTATION_X + 2][i]);
+            glm::vec3 scaling(transforms[SCALE_X][i], transforms[SCALE_X + 1][i], transforms[SCALE_X + 2][i]);
+            products[i] = glm::scale(glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation), scaling);
+        }
+    }));
+    report("scalar arrays       ", timePerObject(n, [&]() { fromTransformsScalar(transforms, reference, n); }));
+    report("SSE arrays          ", timePerObject(n, [&]() { fromTransforms(transforms, models, n); }));
+    std::cout << "  max difference " << maxDifference(reference, models, n) << std::endl;
+
+    std::cout << " view * model" << std::endl;
+    report("glm::mat4 one by one", timePerObject(n, [&]() {
+        for (size_t i = 0; i < n; i++)
+            products[i] = view * matrices[i];
+    }));
+#ifdef BATCH_MATH_SSE
+    report("glm SSE (simd/matrix)", timePerObject(n, [&]() {
+        glm_vec4 a[4];
+        for (int column = 0; column < 4; column++)
+            a[column] = _mm_loadu_ps(&view[column][0]);
+        for (size_t i = 0; i < n; i++) {
+            glm_vec4 b[4], product[4];
+            for (int column = 0; column < 4; column++)
+                b[column] = _mm_loadu_ps(&matrices[i][column][0]);
+            glm_mat4_mul(a, b, product);
+            for (int column = 0; column < 4; column++)
+                _mm_storeu_ps(&products[i][column][0], product[column]);
+        }
+    }));
+#endif
+    report("scalar arrays       ", timePerObject(n, [&]() { multiplyScalar(view, models, reference, n); }));
+    report("SSE arrays          ", timePerObject(n, [&]() { multiply(view, models, result, n); }));
+    std::cout << "  max difference " << maxDifference(reference, result, n) << std::endl;
+
+    // every other matrix, as for the visible objects of a scene
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < n; i += 2)
+        indices.push_back(static_cast<uint32_t>(i));
+    std::cout << " view * model, every other model" << std::endl;
+    report("scalar arrays       ", timePerObject(indices.size(), [&]() {
+        multiplyScalar(view, models, indices.data(), reference, indices.size());
+    }));
+    report("SSE arrays          ", timePerObject(indices.size(), [&]() {
+        multiply(view, models, indices.data(), result, indices.size());
+    }));
+    std::cout << "  max difference " << maxDifference(reference, result, indices.size()) << std::endl;
+
+    std::cout << " inverse" << std::endl;
+    report("glm::inverse        ", timePerObject(n, [&]() {
+        for (size_t i = 0; i < n; i++)
+            products[i] = glm::inverse(matrices[i]);
+    }));
+    report("scalar arrays       ", timePerObject(n, [&]() { inverseScalar(models, reference, n); }));
+    report("SSE arrays          ", timePerObject(n, [&]() { inverse(models, result, n); }));
+    std::cout << "  max difference " << maxDifference(reference, result, n) << std::endl;
+
+    std::cout << " world space boxes" << std::endl;
+    BoxArrays referenceBoxes, resultBoxes;
+    report("scalar arrays       ", timePerObject(n, [&]() { transformBoxesScalar(models, boxes, referenceBoxes, n); }));
+    report("SSE arrays          ", timePerObject(n, [&]() { transformBoxes(models, boxes, resultBoxes, n); }));
+    std::cout << "  max difference " << maxDifference(referenceBoxes, resultBoxes, n) << std::endl;
+    return 0;
+}
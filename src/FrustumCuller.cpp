@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include "FrustumCuller.h"
+#ifdef FRUSTUM_CULLER_SSE
+#include <cstring>
+#include <emmintrin.h>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLER_AVX 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#endif
+
+#if defined(FRUSTUM_CULLER_AVX) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUM_CULLER_AVX_TARGET __attribute__((target("avx")))
+#else
+#define FRUSTUM_CULLER_AVX_TARGET
+#endif
+
+namespace {
+
+// Plane coefficients as separate arrays, to broadcast or gather them
+struct Planes {
+    float x[6], y[6], z[6], w[6];
+
+    explicit Planes(const Frustum& frustum) {
+        for (int p = 0; p < 6; p++) {
+            x[p] = frustum.planes[p].x;
+            y[p] = frustum.planes[p].y;
+            z[p] = frustum.planes[p].z;
+            w[p] = frustum.planes[p].w;
+        }
+    }
+};
+
+#ifdef FRUSTUM_CULLER_SSE
+// The planes that rejected four objects last frame, as four plane vectors
+// transposed to x, y, z, w of each lane
+inline void gatherPlanes(const __m128* plane, const uint8_t* last, __m128& x, __m128& y, __m128& z, __m128& w) {
+    x = plane[last[0]];
+    y = plane[last[1]];
+    z = plane[last[2]];
+    w = plane[last[3]];
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+}
+
+// The lanes of the set bits of every 8-bit mask, in order, and their count
+struct LanePack {
+    alignas(16) int32_t lanes[256][8];
+    int count[256];
+
+    LanePack() {
+        for (int mask = 0; mask < 256; mask++) {
+            count[mask] = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                lanes[mask][lane] = 0;
+                if (mask & (1 << lane))
+                    lanes[mask][count[mask]++] = lane;
+            }
+        }
+    }
+};
+const LanePack lanePack;
+
+// Appends the objects first .. first + lanes - 1 that are set in keepMask
+// to survivors[n ..], without a branch per object; returns the new n.
+// Writes lanes entries, so survivors needs room for them past n.
+inline size_t appendSurvivors(uint32_t* survivors, size_t n, size_t first, int lanes, int keepMask) {
+    const __m128i base = _mm_set1_epi32(static_cast<int>(first));
+    for (int lane = 0; lane < lanes; lane += 4) {
+        __m128i packed = _mm_load_si128(reinterpret_cast<const __m128i*>(&lanePack.lanes[keepMask][lane]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(survivors + n + lane), _mm_add_epi32(base, packed));
+    }
+    return n + lanePack.count[keepMask];
+}
+
+// Drops the padding lanes of the last group from survivors[0 .. n), and
+// repeats the last survivor up to a multiple of lanes, so that steps 2 and
+// 3 only see whole groups (a repeated object gets the same result twice)
+inline size_t padSurvivors(uint32_t* survivors, size_t n, size_t count, size_t lanes) {
+    while (n > 0 && survivors[n - 1] >= count)
+        n--;
+    for (size_t k = n; n > 0 && k % lanes != 0; k++)
+        survivors[k] = survivors[n - 1];
+    return n;
+}
+
+// Writes the results of steps 2 and 3 for the objects j[0 .. lanes)
+inline void storeResults(FrustumCuller& culler, const uint32_t* j, int lanes, int outsideMask, const int32_t* planeOf) {
+    for (int lane = 0; lane < lanes; lane++) {
+        bool out = (outsideMask >> lane) & 1;
+        culler.visible[j[lane]] = out ? 0 : 1;
+        culler.lastPlane[j[lane]] = out ? static_cast<uint8_t>(planeOf[lane]) : culler.lastPlane[j[lane]];
+    }
+}
+
+inline __m128 gather4(const std::vector<float>& array, const uint32_t* j) {
+    return _mm_setr_ps(array[j[0]], array[j[1]], array[j[2]], array[j[3]]);
+}
+
+size_t cullSse(FrustumCuller& culler, const Planes& planes, uint32_t* survivors) {
+    // the planes as (x, y, z, w) vectors for step 1, and broadcast
+    __m128 plane[6], px[6], py[6], pz[6], pw[6];
+    __m128i index[6];
+    for (int p = 0; p < 6; p++) {
+        plane[p] = _mm_setr_ps(planes.x[p], planes.y[p], planes.z[p], planes.w[p]);
+        px[p] = _mm_set1_ps(planes.x[p]);
+        py[p] = _mm_set1_ps(planes.y[p]);
+        pz[p] = _mm_set1_ps(planes.z[p]);
+        pw[p] = _mm_set1_ps(planes.w[p]);
+        index[p] = _mm_set1_epi32(p);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    const size_t count = culler.size();
+
+    // 1. the planes that rejected the objects last frame
+    size_t n = 0;
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 x, y, z, w;
+        gatherPlanes(plane, &culler.lastPlane[i], x, y, z, w);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_loadu_ps(&culler.centerX[i])),
+                                         _mm_mul_ps(y, _mm_loadu_ps(&culler.centerY[i]))),
+                              _mm_add_ps(_mm_mul_ps(z, _mm_loadu_ps(&culler.centerZ[i])), w));
+        int rejectedMask = _mm_movemask_ps(_mm_cmplt_ps(d, _mm_sub_ps(zero, _mm_loadu_ps(&culler.radius[i]))));
+        std::memset(&culler.visible[i], 0, 4);
+        n = appendSurvivors(survivors, n, i, 4, rejectedMask ^ 0xF);
+    }
+    n = padSurvivors(survivors, n, count, 4);
+
+    for (size_t k = 0; k < n; k += 4) {
+        const uint32_t* j = survivors + k;
+        __m128 cx = gather4(culler.centerX, j);
+        __m128 cy = gather4(culler.centerY, j);
+        __m128 cz = gather4(culler.centerZ, j);
+        __m128 r = gather4(culler.radius, j);
+        __m128 negR = _mm_sub_ps(zero, r);
+
+        // 2. spheres against every plane; rejected keeps the first plane
+        //    that rejected each lane
+        __m128 outside = zero;
+        __m128 straddle = zero;
+        __m128i rejected = _mm_setzero_si128();
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+                                  _mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+            __m128i first = _mm_castps_si128(_mm_andnot_ps(outside, _mm_cmplt_ps(d, negR)));
+            rejected = _mm_or_si128(rejected, _mm_and_si128(first, index[p]));
+            outside = _mm_or_ps(outside, _mm_castsi128_ps(first));
+            straddle = _mm_or_ps(straddle, _mm_cmplt_ps(d, r));
+        }
+
+        // 3. boxes, for the spheres that cross a plane; the corner furthest
+        //    along a plane normal is the same for all lanes, so it is picked
+        //    by a scalar branch
+        if (_mm_movemask_ps(_mm_andnot_ps(outside, straddle)) != 0) {
+            __m128 lx = gather4(culler.minX, j), hx = gather4(culler.maxX, j);
+            __m128 ly = gather4(culler.minY, j), hy = gather4(culler.maxY, j);
+            __m128 lz = gather4(culler.minZ, j), hz = gather4(culler.maxZ, j);
+            for (int p = 0; p < 6; p++) {
+                __m128 x = planes.x[p] >= 0.0f ? hx : lx;
+                __m128 y = planes.y[p] >= 0.0f ? hy : ly;
+                __m128 z = planes.z[p] >= 0.0f ? hz : lz;
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                      _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+                __m128i first = _mm_castps_si128(_mm_andnot_ps(outside, _mm_cmplt_ps(d, zero)));
+                rejected = _mm_or_si128(rejected, _mm_and_si128(first, index[p]));
+                outside = _mm_or_ps(outside, _mm_castsi128_ps(first));
+            }
+        }
+
+        alignas(16) int32_t planeOf[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(planeOf), rejected);
+        storeResults(culler, j, 4, _mm_movemask_ps(outside), planeOf);
+    }
+
+    size_t visibleCount = 0;
+    for (size_t k = 0; k < n; k++)
+        visibleCount += culler.visible[survivors[k]];
+    return visibleCount;
+}
+#endif
+
+#ifdef FRUSTUM_CULLER_AVX
+// The planes that rejected eight objects last frame, as x, y, z, w of each
+// lane: vpermilps picks planes 0 .. 3 from low (x, y, z, w of planes 0 .. 3,
+// in both halves), or 4 and 5 from high, chosen by bit 2 of the plane
+FRUSTUM_CULLER_AVX_TARGET
+inline void gatherPlanes8(const __m256* low, const __m256* high, const uint8_t* last, __m256* xyzw) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(last)), zero);
+    __m128i first = _mm_unpacklo_epi16(words, zero), second = _mm_unpackhi_epi16(words, zero);
+    __m256i select = _mm256_insertf128_si256(_mm256_castsi128_si256(first), second, 1);
+    __m256 fromHigh = _mm256_castsi256_ps(_mm256_insertf128_si256(
+        _mm256_castsi128_si256(_mm_srai_epi32(_mm_slli_epi32(first, 29), 31)),
+        _mm_srai_epi32(_mm_slli_epi32(second, 29), 31), 1));
+    for (int c = 0; c < 4; c++)
+        xyzw[c] = _mm256_or_ps(_mm256_andnot_ps(fromHigh, _mm256_permutevar_ps(low[c], select)),
+                               _mm256_and_ps(fromHigh, _mm256_permutevar_ps(high[c], select)));
+}
+
+FRUSTUM_CULLER_AVX_TARGET
+inline __m256 gather8(const std::vector<float>& array, const uint32_t* j) {
+    return _mm256_setr_ps(array[j[0]], array[j[1]], array[j[2]], array[j[3]],
+                          array[j[4]], array[j[5]], array[j[6]], array[j[7]]);
+}
+
+// cullSse() with eight objects per instruction
+FRUSTUM_CULLER_AVX_TARGET
+size_t cullAvx(FrustumCuller& culler, const Planes& planes, uint32_t* survivors) {
+    __m256 low[4], high[4];
+    const float* components[4] = { planes.x, planes.y, planes.z, planes.w };
+    for (int c = 0; c < 4; c++) {
+        const float* v = components[c];
+        low[c] = _mm256_setr_ps(v[0], v[1], v[2], v[3], v[0], v[1], v[2], v[3]);
+        high[c] = _mm256_setr_ps(v[4], v[5], v[4], v[5], v[4], v[5], v[4], v[5]);
+    }
+    __m256 px[6], py[6], pz[6], pw[6], index[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm256_set1_ps(planes.x[p]);
+        py[p] = _mm256_set1_ps(planes.y[p]);
+        pz[p] = _mm256_set1_ps(planes.z[p]);
+        pw[p] = _mm256_set1_ps(planes.w[p]);
+        index[p] = _mm256_castsi256_ps(_mm256_set1_epi32(p));
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    const size_t count = culler.size();
+
+    // 1. the planes that rejected the objects last frame
+    size_t n = 0;
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 plane[4];
+        gatherPlanes8(low, high, &culler.lastPlane[i], plane);
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[0], _mm256_loadu_ps(&culler.centerX[i])),
+                                               _mm256_mul_ps(plane[1], _mm256_loadu_ps(&culler.centerY[i]))),
+                                 _mm256_add_ps(_mm256_mul_ps(plane[2], _mm256_loadu_ps(&culler.centerZ[i])), plane[3]));
+        __m256 negR = _mm256_sub_ps(zero, _mm256_loadu_ps(&culler.radius[i]));
+        int rejectedMask = _mm256_movemask_ps(_mm256_cmp_ps(d, negR, _CMP_LT_OQ));
+        std::memset(&culler.visible[i], 0, 8);
+        n = appendSurvivors(survivors, n, i, 8, rejectedMask ^ 0xFF);
+    }
+    n = padSurvivors(survivors, n, count, 8);
+
+    for (size_t k = 0; k < n; k += 8) {
+        const uint32_t* j = survivors + k;
+        __m256 cx = gather8(culler.centerX, j);
+        __m256 cy = gather8(culler.centerY, j);
+        __m256 cz = gather8(culler.centerZ, j);
+        __m256 r = gather8(culler.radius, j);
+        __m256 negR = _mm256_sub_ps(zero, r);
+
+        // 2. spheres against every plane
+        __m256 outside = zero;
+        __m256 straddle = zero;
+        __m256 rejected = zero; // plane indices, as int bits
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy)),
+                                     _mm256_add_ps(_mm256_mul_ps(pz[p], cz), pw[p]));
+            __m256 first = _mm256_andnot_ps(outside, _mm256_cmp_ps(d, negR, _CMP_LT_OQ));
+            rejected = _mm256_or_ps(rejected, _mm256_and_ps(first, index[p]));
+            outside = _mm256_or_ps(outside, first);
+            straddle = _mm256_or_ps(straddle, _mm256_cmp_ps(d, r, _CMP_LT_OQ));
+        }
+
+        // 3. boxes, for the spheres that cross a plane
+        if (_mm256_movemask_ps(_mm256_andnot_ps(outside, straddle)) != 0) {
+            __m256 lx = gather8(culler.minX, j), hx = gather8(culler.maxX, j);
+            __m256 ly = gather8(culler.minY, j), hy = gather8(culler.maxY, j);
+            __m256 lz = gather8(culler.minZ, j), hz = gather8(culler.maxZ, j);
+            for (int p = 0; p < 6; p++) {
+                __m256 x = planes.x[p] >= 0.0f ? hx : lx;
+                __m256 y = planes.y[p] >= 0.0f ? hy : ly;
+                __m256 z = planes.z[p] >= 0.0f ? hz : lz;
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                                         _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+                __m256 first = _mm256_andnot_ps(outside, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+                rejected = _mm256_or_ps(rejected, _mm256_and_ps(first, index[p]));
+                outside = _mm256_or_ps(outside, first);
+            }
+        }
+
+        alignas(32) int32_t planeOf[8];
+        _mm256_store_ps(reinterpret_cast<float*>(planeOf), rejected);
+        storeResults(culler, j, 8, _mm256_movemask_ps(outside), planeOf);
+    }
+
+    size_t visibleCount = 0;
+    for (size_t k = 0; k < n; k++)
+        visibleCount += culler.visible[survivors[k]];
+    return visibleCount;
+}
+#endif
+
+}
+
+bool FrustumCuller::avxSupported() {
+#if !defined(FRUSTUM_CULLER_AVX)
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+#else
+    static const bool supported = __builtin_cpu_supports("avx");
+    return supported;
+#endif
+}
+
+void FrustumCuller::resize(size_t n) {
+    // padded to a multiple of eight so that SIMD groups never run past the end
+    size_t padded = (n + 7) & ~size_t(7);
+    for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &radius,
+                                       &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+        array->resize(padded, 0.0f);
+    lastPlane.resize(padded, 0);
+    survivors_.resize(padded);
+    boundsVersion.resize(padded, 0);
+    visible.resize(padded, 0);
+    count_ = n;
+}
+
+void FrustumCuller::setBounds(size_t i, const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 center = glm::vec3(model * glm::vec4(0.5f * (boundsMin + boundsMax), 1.0f));
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                  std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    centerX[i] = center.x;
+    centerY[i] = center.y;
+    centerZ[i] = center.z;
+    radius[i] = 0.5f * glm::length(boundsMax - boundsMin) * scale;
+
+    // box around the transformed box (Arvo)
+    glm::vec3 lo = glm::vec3(model[3]);
+    glm::vec3 hi = lo;
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            float a = model[column][row] * boundsMin[column];
+            float b = model[column][row] * boundsMax[column];
+            lo[row] += std::min(a, b);
+            hi[row] += std::max(a, b);
+        }
+    }
+    minX[i] = lo.x; minY[i] = lo.y; minZ[i] = lo.z;
+    maxX[i] = hi.x; maxY[i] = hi.y; maxZ[i] = hi.z;
+}
+
+void FrustumCuller::updateBounds(size_t i, uint64_t version, const glm::mat4& model, const glm::vec3& boundsMin,
+                                 const glm::vec3& boundsMax) {
+    if (boundsVersion[i] == version)
+        return;
+    boundsVersion[i] = version;
+    setBounds(i, model, boundsMin, boundsMax);
+}
+
+size_t FrustumCuller::cull(const Frustum& frustum) {
+#ifdef FRUSTUM_CULLER_SSE
+    const Planes planes(frustum);
+#ifdef FRUSTUM_CULLER_AVX
+    if (useAvx && avxSupported())
+        return cullAvx(*this, planes, survivors_.data());
+#endif
+    return cullSse(*this, planes, survivors_.data());
+#else
+    return cullScalar(frustum);
+#endif
+}
+
+size_t FrustumCuller::cullScalar(const Frustum& frustum) {
+    // the same sums as the SSE path, so both round alike
+    const Planes planes(frustum);
+    auto distance = [&planes](int p, float x, float y, float z) {
+        return (planes.x[p] * x + planes.y[p] * y) + (planes.z[p] * z + planes.w[p]);
+    };
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < count_; i++) {
+        float x = centerX[i], y = centerY[i], z = centerZ[i], r = radius[i];
+        int p = lastPlane[i];
+        bool outside = distance(p, x, y, z) < -r;
+        bool straddle = false;
+        for (p = 0; p < 6 && !outside; p++) {
+            float d = distance(p, x, y, z);
+            outside = d < -r;
+            straddle = straddle || d < r;
+            if (outside)
+                lastPlane[i] = static_cast<uint8_t>(p);
+        }
+        for (p = 0; p < 6 && straddle && !outside; p++) {
+            float bx = planes.x[p] >= 0.0f ? maxX[i] : minX[i];
+            float by = planes.y[p] >= 0.0f ? maxY[i] : minY[i];
+            float bz = planes.z[p] >= 0.0f ? maxZ[i] : minZ[i];
+            outside = distance(p, bx, by, bz) < 0.0f;
+            if (outside)
+                lastPlane[i] = static_cast<uint8_t>(p);
+        }
+        visible[i] = outside ? 0 : 1;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+
+int FrustumCuller::benchmark() {
+    const size_t count = 100000;
+    const int frames = 100;
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> spread(-100.0f, 100.0f), size(0.1f, 4.0f), angle(0.0f, 6.2832f);
+
+    // random boxes, turned and scaled
+    FrustumCuller culler;
+    culler.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(spread(random), spread(random), spread(random)));
+        model = glm::rotate(model, angle(random), glm::normalize(glm::vec3(spread(random), spread(random), 1.0f)));
+        model = glm::scale(model, glm::vec3(size(random)));
+        glm::vec3 half(size(random), size(random), size(random));
+        culler.setBounds(i, model, -half, half);
+    }
+    FrustumCuller sse = culler, reference = culler;
+    sse.useAvx = false;
+    bool avx = avxSupported();
+
+    // a camera that turns around the center and looks outwards
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+    double avxMilliseconds = 0.0, sseMilliseconds = 0.0, scalarMilliseconds = 0.0;
+    size_t visibleCount = 0, mismatches = 0, mismatchedFrames = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        float turn = 6.2832f * frame / frames;
+        glm::vec3 eye(10.0f * std::sin(turn), 5.0f * std::sin(3.0f * turn), 10.0f * std::cos(turn));
+        Frustum frustum;
+        frustum.update(projection * glm::lookAt(eye, 2.0f * eye, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        auto start = std::chrono::steady_clock::now();
+        if (avx)
+            culler.cull(frustum);
+        auto afterAvx = std::chrono::steady_clock::now();
+        visibleCount += sse.cull(frustum);
+        auto afterSse = std::chrono::steady_clock::now();
+        reference.cullScalar(frustum);
+        auto end = std::chrono::steady_clock::now();
+        avxMilliseconds += std::chrono::duration<double, std::milli>(afterAvx - start).count();
+        sseMilliseconds += std::chrono::duration<double, std::milli>(afterSse - afterAvx).count();
+        scalarMilliseconds += std::chrono::duration<double, std::milli>(end - afterSse).count();
+
+        size_t frameMismatches = 0;
+        for (size_t i = 0; i < count; i++) {
+            frameMismatches += (sse.visible[i] != reference.visible[i]);
+            frameMismatches += avx && (culler.visible[i] != reference.visible[i]);
+        }
+        mismatches += frameMismatches;
+        mismatchedFrames += (frameMismatches > 0);
+    }
+
+    std::cout << "Frustum culling: " << count << " objects, " << frames << " frames, "
+              << visibleCount / frames << " visible on average" << std::endl;
+#ifdef FRUSTUM_CULLER_SSE
+    if (avx)
+        std::cout << "  AVX:    " << avxMilliseconds / frames << " ms per frame" << std::endl;
+    else
+        std::cout << "  AVX:    not supported by this CPU" << std::endl;
+    std::cout << "  SSE:    " << sseMilliseconds / frames << " ms per frame" << std::endl;
+#else
+    std::cout << "  (no SSE: both runs are scalar) " << sseMilliseconds / frames << " ms per frame" << std::endl;
+#endif
+    std::cout << "  scalar: " << scalarMilliseconds / frames << " ms per frame" << std::endl;
+    std::cout << "  " << mismatches << " results differ, in " << mismatchedFrames << " of " << frames << " frames"
+              << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
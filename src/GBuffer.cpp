@@ -0,0 +1,78 @@
+#include <iostream>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GBuffer.h"
+#include "GLState.h"
+
+bool GBuffer::resize(int width, int height) {
+    if (framebuffer_ && width == width_ && height == height_)
+        return valid_;
+    release();
+    width_ = width;
+    height_ = height;
+
+    static const GLenum internalFormats[3] = { GL_RG16, GL_RGBA8, GL_DEPTH_COMPONENT24 };
+    static const GLenum formats[3] = { GL_RG, GL_RGBA, GL_DEPTH_COMPONENT };
+    static const GLenum types[3] = { GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT };
+    static const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glGenTextures(3, textures_);
+    for (int k = 0; k < 3; k++) {
+        // read with texelFetch only; no mipmaps, so no mipmap filter
+        GLState::bindTexture(0, GL_TEXTURE_2D, textures_[k]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[k], width, height, 0, formats[k], types[k], NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[k], GL_TEXTURE_2D, textures_[k], 0);
+    }
+    GLState::bindTexture(0, GL_TEXTURE_2D, 0);
+    static const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    valid_ = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    if (!valid_)
+        std::cerr << "G-buffer of " << width << " x " << height << " is not complete; deferred shading is off." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return valid_;
+}
+
+void GBuffer::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_); // the same size as the viewport
+
+    // the clears follow the masks, so open them first
+    static const GLfloat zero[4] = {};
+    static const GLfloat farDepth = 1.0f;
+    GLState::colorMask(true);
+    GLState::depthMask(true);
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void GBuffer::unbind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GBuffer::bindTextures(GLuint firstUnit) const {
+    for (GLuint k = 0; k < 3; k++)
+        GLState::bindTexture(firstUnit + k, GL_TEXTURE_2D, textures_[k]);
+}
+
+void GBuffer::release() {
+    if (textures_[0]) {
+        // forget the units they are bound to
+        glDeleteTextures(3, textures_);
+        GLState::invalidate();
+    }
+    if (framebuffer_)
+        glDeleteFramebuffers(1, &framebuffer_);
+    for (GLuint& texture : textures_)
+        texture = 0;
+    framebuffer_ = 0;
+    valid_ = false;
+}
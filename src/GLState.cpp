@@ -0,0 +1,216 @@
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GLState.h"
+
+namespace {
+
+const uint32_t unknown = 0xFFFFFFFFu;
+
+// Tracked buffer targets; other targets are always issued
+const GLenum bufferTargets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+                                 GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_DRAW_INDIRECT_BUFFER };
+const int bufferTargetCount = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+const int elementSlot = 1;
+const GLuint maxUniformBindings = 16;
+const GLuint maxTextureUnits = 16;
+
+struct BufferRange {
+    uint32_t buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct State {
+    uint32_t program;
+    uint32_t vao;
+    uint32_t buffers[bufferTargetCount];
+    BufferRange uniformRanges[maxUniformBindings];
+    uint32_t polygonMode;
+    uint32_t depthTest, blend, cullFace;
+    uint32_t depthMask, depthFunc;
+    uint32_t colorMask;
+    uint32_t blendSource, blendDestination;
+    uint32_t activeUnit;
+    uint32_t textures[maxTextureUnits]; // GL_TEXTURE_2D of each unit
+};
+
+State unknownState() {
+    State state;
+    state.program = state.vao = unknown;
+    for (uint32_t& buffer : state.buffers)
+        buffer = unknown;
+    for (BufferRange& range : state.uniformRanges)
+        range = { unknown, 0, 0 };
+    state.polygonMode = unknown;
+    state.depthTest = state.blend = state.cullFace = unknown;
+    state.depthMask = state.depthFunc = unknown;
+    state.colorMask = unknown;
+    state.blendSource = state.blendDestination = unknown;
+    state.activeUnit = unknown;
+    for (uint32_t& texture : state.textures)
+        texture = unknown;
+    return state;
+}
+
+State state = unknownState();
+
+int bufferSlot(GLenum target) {
+    for (int i = 0; i < bufferTargetCount; i++)
+        if (bufferTargets[i] == target)
+            return i;
+    return -1;
+}
+
+uint32_t* capabilitySlot(GLenum capability) {
+    switch (capability) {
+    case GL_DEPTH_TEST: return &state.depthTest;
+    case GL_BLEND: return &state.blend;
+    case GL_CULL_FACE: return &state.cullFace;
+    default: return nullptr;
+    }
+}
+
+}
+
+size_t GLState::issued_ = 0;
+size_t GLState::skipped_ = 0;
+
+bool GLState::change(uint32_t& cached, uint32_t value) {
+    if (cached == value) {
+        skipped_++;
+        return false;
+    }
+    cached = value;
+    issued_++;
+    return true;
+}
+
+void GLState::useProgram(GLuint program) {
+    if (change(state.program, program))
+        glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (change(state.vao, vao)) {
+        glBindVertexArray(vao);
+        state.buffers[elementSlot] = unknown; // part of the vertex array
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    int slot = bufferSlot(target);
+    if (slot < 0) {
+        issued_++;
+        glBindBuffer(target, buffer);
+    }
+    else if (change(state.buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (target != GL_UNIFORM_BUFFER || index >= maxUniformBindings) {
+        issued_++;
+        glBindBufferRange(target, index, buffer, offset, size);
+        if (bufferSlot(target) >= 0)
+            state.buffers[bufferSlot(target)] = buffer;
+        return;
+    }
+    BufferRange& range = state.uniformRanges[index];
+    if (range.buffer == buffer && range.offset == offset && range.size == size) {
+        skipped_++;
+        return;
+    }
+    range = { buffer, offset, size };
+    issued_++;
+    glBindBufferRange(target, index, buffer, offset, size);
+    state.buffers[bufferSlot(GL_UNIFORM_BUFFER)] = buffer; // also the generic binding
+}
+
+void GLState::polygonMode(GLenum mode) {
+    if (change(state.polygonMode, mode))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLState::enable(GLenum capability, bool enabled) {
+    uint32_t* cached = capabilitySlot(capability);
+    if (cached && !change(*cached, enabled ? 1 : 0))
+        return;
+    if (!cached)
+        issued_++;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::depthMask(bool write) {
+    if (change(state.depthMask, write ? 1 : 0))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::colorMask(bool write) {
+    if (change(state.colorMask, write ? 1 : 0)) {
+        GLboolean value = write ? GL_TRUE : GL_FALSE;
+        glColorMask(value, value, value, value);
+    }
+}
+
+void GLState::depthFunc(GLenum func) {
+    if (change(state.depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination) {
+    if (state.blendSource == source && state.blendDestination == destination) {
+        skipped_++;
+        return;
+    }
+    state.blendSource = source;
+    state.blendDestination = destination;
+    issued_++;
+    glBlendFunc(source, destination);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (change(state.activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    if (target != GL_TEXTURE_2D || unit >= maxTextureUnits) {
+        issued_++;
+        glBindTexture(target, texture);
+    }
+    else if (change(state.textures[unit], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::deleteBuffers(GLsizei n, const GLuint* buffers) {
+    // GL unbinds them everywhere in this context; their names may come back
+    for (GLsizei i = 0; i < n; i++) {
+        for (uint32_t& bound : state.buffers)
+            if (bound == buffers[i])
+                bound = unknown;
+        for (BufferRange& range : state.uniformRanges)
+            if (range.buffer == buffers[i])
+                range.buffer = unknown;
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    for (GLsizei i = 0; i < n; i++) {
+        if (state.vao == arrays[i]) {
+            state.vao = unknown;
+            state.buffers[elementSlot] = unknown;
+        }
+    }
+    glDeleteVertexArrays(n, arrays);
+}
+
+void GLState::invalidate() {
+    state = unknownState();
+}
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cstring>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GLState.h"
+#include "GeometryPool.h"
+
+namespace {
+
+// Smallest storages, in vertices and indices
+const uint32_t minVertexCapacity = 1 << 16;
+const uint32_t minIndexCapacity = 1 << 18;
+
+size_t indexSize(GLenum type) {
+    return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+bool sameLayout(const MeshView& a, const MeshView& b) {
+    if (a.streamCount != b.streamCount || a.attribCount != b.attribCount || a.indexType != b.indexType)
+        return false;
+    for (uint32_t i = 0; i < a.streamCount; i++)
+        if (a.strides[i] != b.strides[i])
+            return false;
+    return std::memcmp(a.attribs, b.attribs, a.attribCount * sizeof(VertexAttrib)) == 0;
+}
+
+}
+
+bool GeometryPool::RangeAllocator::allocate(uint32_t size, uint32_t& offset) {
+    for (auto it = free.begin(); it != free.end(); ++it) {
+        if (it->second < size)
+            continue;
+        offset = it->first;
+        uint32_t rest = it->second - size;
+        free.erase(it);
+        if (rest > 0)
+            free[offset + size] = rest;
+        return true;
+    }
+    return false;
+}
+
+void GeometryPool::RangeAllocator::deallocate(uint32_t offset, uint32_t size) {
+    auto it = free.emplace(offset, size).first;
+
+    // merge with the following and the preceding free range
+    auto next = std::next(it);
+    if (next != free.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        free.erase(next);
+    }
+    if (it != free.begin()) {
+        auto previous = std::prev(it);
+        if (previous->first + previous->second == it->first) {
+            previous->second += it->second;
+            free.erase(it);
+        }
+    }
+}
+
+void GeometryPool::RangeAllocator::grow(uint32_t newCapacity) {
+    if (newCapacity > capacity)
+        deallocate(capacity, newCapacity - capacity);
+    capacity = newCapacity;
+}
+
+bool GeometryPool::supported() {
+#ifdef __APPLE__
+    return false;
+#else
+    // without base instance every command would read the first instance
+    return (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+#endif
+}
+
+bool GeometryPool::add(Obj& mesh) {
+    if (contains(mesh))
+        return true;
+    const MeshView& layout = mesh.layout;
+    if (!mesh.ready || mesh.vao == 0 || layout.streamCount == 0 || mesh.buffers.size() != layout.streamCount + 1)
+        return false;
+
+    uint32_t vertexCount = static_cast<uint32_t>(layout.vertexCount);
+    uint32_t indexCount = static_cast<uint32_t>(layout.indexCount);
+    uint32_t s = findStorage(layout);
+    Storage* storage = &storages_[s];
+
+    // grow the storage until both ranges fit
+    uint32_t baseVertex = 0, firstIndex = 0;
+    while (!storage->vertices.allocate(vertexCount, baseVertex)) {
+        resize(*storage, std::max(storage->vertices.capacity * 2, storage->vertices.capacity + vertexCount),
+               storage->indices.capacity);
+    }
+    while (!storage->indices.allocate(indexCount, firstIndex)) {
+        resize(*storage, storage->vertices.capacity,
+               std::max(storage->indices.capacity * 2, storage->indices.capacity + indexCount));
+    }
+
+    // GPU to GPU copies of the streams and the indices
+    for (uint32_t i = 0; i <= layout.streamCount; i++) {
+        bool isIndices = (i == layout.streamCount);
+        size_t elementSize = isIndices ? indexSize(layout.indexType) : layout.strides[i];
+        size_t offset = isIndices ? firstIndex : baseVertex;
+        size_t size = isIndices ? layout.indexBytes() : layout.streamBytes(i);
+        GLState::bindBuffer(GL_COPY_READ_BUFFER, mesh.buffers[i]);
+        GLState::bindBuffer(GL_COPY_WRITE_BUFFER, storage->buffers[i]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset * elementSize, size);
+    }
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    uint32_t slot;
+    if (!freeSlots_.empty()) {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(entries_.size());
+        entries_.emplace_back();
+    }
+    entries_[slot] = { s, baseVertex, vertexCount, firstIndex, indexCount, &mesh };
+    mesh.pool = this;
+    mesh.poolSlot = slot;
+    return true;
+}
+
+void GeometryPool::remove(Obj& mesh) {
+    if (!contains(mesh))
+        return;
+    PoolEntry& entry = entries_[mesh.poolSlot];
+    Storage& storage = storages_[entry.storage];
+    storage.vertices.deallocate(entry.baseVertex, entry.vertexCount);
+    storage.indices.deallocate(entry.firstIndex, entry.indexCount);
+    entry.mesh = nullptr;
+    freeSlots_.push_back(mesh.poolSlot);
+    mesh.pool = nullptr;
+    mesh.poolSlot = 0;
+}
+
+size_t GeometryPool::capacityBytes() const {
+    size_t bytes = 0;
+    for (const Storage& storage : storages_) {
+        for (uint32_t i = 0; i < storage.layout.streamCount; i++)
+            bytes += size_t(storage.vertices.capacity) * storage.layout.strides[i];
+        bytes += size_t(storage.indices.capacity) * indexSize(storage.layout.indexType);
+    }
+    return bytes;
+}
+
+void GeometryPool::release() {
+    for (PoolEntry& entry : entries_) {
+        if (entry.mesh) {
+            entry.mesh->pool = nullptr;
+            entry.mesh->poolSlot = 0;
+        }
+    }
+    for (Storage& storage : storages_) {
+        if (!storage.buffers.empty())
+            GLState::deleteBuffers(static_cast<GLsizei>(storage.buffers.size()), storage.buffers.data());
+        if (storage.vao)
+            GLState::deleteVertexArrays(1, &storage.vao);
+    }
+    storages_.clear();
+    entries_.clear();
+    freeSlots_.clear();
+}
+
+uint32_t GeometryPool::findStorage(const MeshView& layout) {
+    for (size_t i = 0; i < storages_.size(); i++)
+        if (sameLayout(storages_[i].layout, layout))
+            return static_cast<uint32_t>(i);
+
+    Storage storage;
+    storage.layout = layout;
+    storages_.push_back(storage);
+    resize(storages_.back(), minVertexCapacity, minIndexCapacity);
+    return static_cast<uint32_t>(storages_.size() - 1);
+}
+
+void GeometryPool::resize(Storage& storage, uint32_t vertexCapacity, uint32_t indexCapacity) {
+    const MeshView& layout = storage.layout;
+    std::vector<GLuint> buffers(layout.streamCount + 1);
+    glGenBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+
+    // new buffers with the old contents at the same offsets
+    for (uint32_t i = 0; i <= layout.streamCount; i++) {
+        bool isIndices = (i == layout.streamCount);
+        size_t elementSize = isIndices ? indexSize(layout.indexType) : layout.strides[i];
+        size_t oldSize = elementSize * (isIndices ? storage.indices.capacity : storage.vertices.capacity);
+        size_t newSize = elementSize * (isIndices ? indexCapacity : vertexCapacity);
+        GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+        if (oldSize > 0) {
+            GLState::bindBuffer(GL_COPY_READ_BUFFER, storage.buffers[i]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        }
+    }
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!storage.buffers.empty())
+        GLState::deleteBuffers(static_cast<GLsizei>(storage.buffers.size()), storage.buffers.data());
+    storage.buffers = buffers;
+    storage.vertices.grow(vertexCapacity);
+    storage.indices.grow(indexCapacity);
+
+    // the vertex array refers to the buffers by name, so it is rebuilt
+    if (storage.vao == 0)
+        glGenVertexArrays(1, &storage.vao);
+    GLState::bindVertexArray(storage.vao);
+    for (uint32_t i = 0; i < layout.attribCount; i++) {
+        const VertexAttrib& attrib = layout.attribs[i];
+        GLState::bindBuffer(GL_ARRAY_BUFFER, storage.buffers[attrib.stream]);
+        glEnableVertexAttribArray(attrib.location);
+        glVertexAttribPointer(attrib.location, attrib.size, attrib.type, attrib.normalized,
+                              layout.strides[attrib.stream], (void*)(uintptr_t)attrib.offset);
+    }
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, storage.buffers[layout.streamCount]);
+    GLState::bindVertexArray(0);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,59 @@
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GpuTimer.h"
+
+void GpuTimer::begin() {
+    if (queries_[0] == 0)
+        glGenQueries(static_cast<GLsizei>(latency), queries_);
+
+    // oldest first, so the newest result that has arrived is kept
+    for (size_t k = 0; k < latency; k++) {
+        size_t i = (next_ + k) % latency;
+        if (!pending_[i])
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries_[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(queries_[i], GL_QUERY_RESULT, &result);
+        pending_[i] = false;
+        result_ = result;
+        hasResult_ = true;
+    }
+
+    active_ = !pending_[next_];
+    if (active_)
+        glBeginQuery(target_, queries_[next_]);
+}
+
+void GpuTimer::end() {
+    if (!active_)
+        return;
+    glEndQuery(target_);
+    pending_[next_] = true;
+    next_ = (next_ + 1) % latency;
+    active_ = false;
+}
+
+void GpuTimer::discard() {
+    // a query that is begun again replaces its pending result
+    for (bool& pending : pending_)
+        pending = false;
+    hasResult_ = false;
+    result_ = 0;
+}
+
+void GpuTimer::release() {
+    if (queries_[0])
+        glDeleteQueries(static_cast<GLsizei>(latency), queries_);
+    for (size_t i = 0; i < latency; i++) {
+        queries_[i] = 0;
+        pending_[i] = false;
+    }
+    hasResult_ = false;
+}
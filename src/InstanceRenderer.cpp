@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstddef>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GLState.h"
+#include "InstanceRenderer.h"
+
+void InstanceRenderer::begin() {
+    entries_.clear();
+    groups_.clear();
+}
+
+void InstanceRenderer::add(Obj* mesh, size_t lod, const glm::mat4& model, bool highlighted, float depth) {
+    Entry entry;
+    entry.mesh = mesh;
+    entry.lod = lod;
+    entry.depth = depth;
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 4; column++)
+            entry.data.rows[row][column] = model[column][row];
+    entry.data.highlight = highlighted ? 1.0f : 0.0f;
+    for (int k = 0; k < 3; k++) {
+        entry.data.positionScale[k] = mesh->positionScale[k];
+        entry.data.positionBias[k] = mesh->positionBias[k];
+    }
+    entries_.push_back(entry);
+}
+
+void InstanceRenderer::upload() {
+    groups_.clear();
+    if (entries_.empty())
+        return;
+
+    // group the instances of each mesh and level, nearest first (for
+    // early-Z); the sort is stable so equal depths keep their order
+    order_.resize(entries_.size());
+    for (size_t i = 0; i < order_.size(); i++)
+        order_[i] = static_cast<uint32_t>(i);
+    std::stable_sort(order_.begin(), order_.end(), [this](uint32_t a, uint32_t b) {
+        const Entry& x = entries_[a];
+        const Entry& y = entries_[b];
+        if (x.mesh != y.mesh)
+            return std::less<Obj*>()(x.mesh, y.mesh);
+        return x.lod != y.lod ? x.lod < y.lod : x.depth < y.depth;
+    });
+
+    staging_.resize(entries_.size());
+    for (size_t i = 0; i < order_.size(); i++) {
+        const Entry& entry = entries_[order_[i]];
+        staging_[i] = entry.data;
+        if (groups_.empty() || groups_.back().mesh != entry.mesh || groups_.back().lod != entry.lod)
+            groups_.push_back({ entry.mesh, entry.lod, i, 0, entry.depth });
+        groups_.back().count++;
+    }
+
+    // orphan the old storage so the driver does not wait for the last frame
+    if (buffer_ == 0)
+        glGenBuffers(1, &buffer_);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer_);
+    if (staging_.size() > capacity_)
+        capacity_ = std::max(staging_.size(), capacity_ * 2);
+    glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, staging_.size() * sizeof(InstanceData), staging_.data());
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceRenderer::draw(const InstanceGroup& group) {
+    Obj& mesh = *group.mesh;
+    GLState::bindVertexArray(mesh.vao);
+
+    // per-instance attributes, for this group only
+    setAttributes(group.first, false);
+    mesh.drawLodInstanced(group.lod, static_cast<GLsizei>(group.count));
+
+    // leave the vertex array as regular draws expect it
+    for (GLuint location = modelLocation; location <= highlightLocation; location++)
+        glDisableVertexAttribArray(location);
+}
+
+size_t InstanceRenderer::drawIndirect(const GeometryPool& pool) {
+    size_t drawCalls = 0;
+
+    // one command per group, ordered by storage; the groups of meshes that
+    // are not pooled are drawn one by one
+    commands_.clear();
+    storageEnd_.assign(pool.storageCount(), 0);
+    for (uint32_t storage = 0; storage < pool.storageCount(); storage++) {
+        for (const InstanceGroup& group : groups_) {
+            if (!pool.contains(*group.mesh) || pool.entry(*group.mesh).storage != storage)
+                continue;
+            const PoolEntry& entry = pool.entry(*group.mesh);
+            const MeshLod& lod = group.mesh->lods[std::min(group.lod, group.mesh->lods.size() - 1)];
+            commands_.push_back({ lod.count, static_cast<GLuint>(group.count), entry.firstIndex + lod.first,
+                                  static_cast<GLint>(entry.baseVertex), static_cast<GLuint>(group.first) });
+        }
+        storageEnd_[storage] = commands_.size();
+    }
+    for (const InstanceGroup& group : groups_) {
+        if (!pool.contains(*group.mesh)) {
+            draw(group);
+            drawCalls++;
+        }
+    }
+    if (commands_.empty())
+        return drawCalls;
+
+    if (indirectBuffer_ == 0)
+        glGenBuffers(1, &indirectBuffer_);
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+    if (commands_.size() > indirectCapacity_)
+        indirectCapacity_ = std::max(commands_.size(), indirectCapacity_ * 2);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity_ * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands_.size() * sizeof(DrawElementsIndirectCommand), commands_.data());
+
+    size_t begin = 0;
+    for (uint32_t storage = 0; storage < pool.storageCount(); storage++) {
+        size_t end = storageEnd_[storage];
+        if (end == begin)
+            continue;
+        GLState::bindVertexArray(pool.vertexArray(storage));
+        setAttributes(0, true); // baseInstance selects each command's slice
+        glMultiDrawElementsIndirect(GL_TRIANGLES, pool.indexType(storage),
+                                    (void*)(uintptr_t)(begin * sizeof(DrawElementsIndirectCommand)),
+                                    static_cast<GLsizei>(end - begin), 0);
+        drawCalls++;
+        begin = end;
+    }
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return drawCalls;
+}
+
+void InstanceRenderer::setAttributes(size_t first, bool withDecoding) {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer_);
+    size_t base = first * sizeof(InstanceData);
+    auto attribute = [base](GLuint location, GLint size, size_t offset) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(uintptr_t)(base + offset));
+        glVertexAttribDivisor(location, 1);
+    };
+    for (GLuint row = 0; row < 3; row++)
+        attribute(modelLocation + row, 4, offsetof(InstanceData, rows) + row * 4 * sizeof(float));
+    attribute(highlightLocation, 1, offsetof(InstanceData, highlight));
+    if (withDecoding) {
+        attribute(positionScaleLocation, 3, offsetof(InstanceData, positionScale));
+        attribute(positionBiasLocation, 3, offsetof(InstanceData, positionBias));
+    }
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceRenderer::setDefaults() {
+    glVertexAttrib4f(modelLocation + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(modelLocation + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(modelLocation + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+    glVertexAttrib1f(highlightLocation, 0.0f);
+    glVertexAttrib3f(positionScaleLocation, 1.0f, 1.0f, 1.0f);
+    glVertexAttrib3f(positionBiasLocation, 0.0f, 0.0f, 0.0f);
+}
+
+void InstanceRenderer::release() {
+    if (buffer_)
+        GLState::deleteBuffers(1, &buffer_);
+    buffer_ = 0;
+    capacity_ = 0;
+    if (indirectBuffer_)
+        GLState::deleteBuffers(1, &indirectBuffer_);
+    indirectBuffer_ = 0;
+    indirectCapacity_ = 0;
+}
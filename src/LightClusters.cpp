@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GLState.h"
+#include "LightClusters.h"
+#include "Parallel.h"
+
+void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, float fovy, float aspect,
+                          float nearDist, float farDist) {
+    auto start = std::chrono::steady_clock::now();
+    float logRatio = std::log(farDist / nearDist);
+    depthScale_ = slices / logRatio;
+    depthBias_ = -std::log(nearDist) * depthScale_;
+    float tanHalfY = std::tan(glm::radians(fovy) * 0.5f);
+    float tanHalfX = tanHalfY * aspect;
+    auto sliceOf = [this](float depth) {
+        float slice = std::floor(std::log(depth) * depthScale_ + depthBias_);
+        return static_cast<uint32_t>(std::min(std::max(slice, 0.0f), slices - 1.0f));
+    };
+
+    // Lights in view space, and the slices their spheres reach (none for
+    // lights beyond the near or far plane)
+    viewLights_.resize(lights.size());
+    lights_.resize(2 * lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        const PointLight& light = lights[i];
+        ViewLight& viewLight = viewLights_[i];
+        viewLight.position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        viewLight.radius = light.radius;
+        lights_[2 * i] = glm::vec4(viewLight.position, light.radius);
+        lights_[2 * i + 1] = glm::vec4(light.color, 0.0f);
+
+        float depth = -viewLight.position.z;
+        if (depth + light.radius < nearDist || depth - light.radius > farDist) {
+            viewLight.firstSlice = 1;
+            viewLight.lastSlice = 0;
+            continue;
+        }
+        viewLight.firstSlice = sliceOf(std::max(depth - light.radius, nearDist));
+        viewLight.lastSlice = sliceOf(std::min(depth + light.radius, farDist));
+    }
+
+    // every bands-th slice per thread: the lights are usually bunched in
+    // a few neighboring slices, which this spreads over the threads
+    unsigned int bands = std::min<unsigned int>(resolveThreadCount(threads), slices);
+    if (lights.size() < 64)
+        bands = 1; // not worth starting threads
+    parallelFor(bands, [&](unsigned int band) {
+        for (uint32_t slice = band; slice < slices; slice += bands)
+            binSlice(slice, nearDist, farDist, tanHalfX, tanHalfY);
+    });
+
+    // the lists of all slices, one after the other
+    const uint32_t cells = tilesX * tilesY;
+    grid_.resize(2 * clusterCount);
+    indices_.clear();
+    for (uint32_t slice = 0; slice < slices; slice++) {
+        const Slice& work = slices_[slice];
+        uint32_t offset = static_cast<uint32_t>(indices_.size());
+        for (uint32_t cell = 0; cell < cells; cell++) {
+            grid_[2 * (slice * cells + cell)] = offset;
+            grid_[2 * (slice * cells + cell) + 1] = work.counts[cell];
+            offset += work.counts[cell];
+        }
+        indices_.insert(indices_.end(), work.sorted.begin(), work.sorted.end());
+    }
+    binMilliseconds_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusters::binSlice(uint32_t slice, float nearDist, float farDist, float tanHalfX, float tanHalfY) {
+    Slice& work = slices_[slice];
+    work.cells.clear();
+    work.lights.clear();
+    float sliceNear = std::max(nearDist, std::exp((slice - depthBias_) / depthScale_));
+    float sliceFar = std::min(farDist, std::exp((slice + 1 - depthBias_) / depthScale_));
+
+    // Tiles covered by [center - extent, center + extent] at depths
+    // [near, far]: x / depth is monotonic in both, so the corners bound it
+    auto tileRange = [](float center, float extent, float front, float back, float tanHalf, uint32_t tiles,
+                        uint32_t& first, uint32_t& last) {
+        float lo = std::min((center - extent) / front, (center - extent) / back);
+        float hi = std::max((center + extent) / front, (center + extent) / back);
+        float a = (lo / tanHalf + 1.0f) * 0.5f * tiles;
+        float b = (hi / tanHalf + 1.0f) * 0.5f * tiles;
+        if (b < 0.0f || a >= tiles)
+            return false;
+        first = static_cast<uint32_t>(std::max(a, 0.0f));
+        last = static_cast<uint32_t>(std::min(b, tiles - 1.0f));
+        return true;
+    };
+
+    for (uint32_t i = 0; i < viewLights_.size(); i++) {
+        const ViewLight& light = viewLights_[i];
+        if (slice < light.firstSlice || slice > light.lastSlice)
+            continue;
+
+        // the widest cross-section of the sphere inside the slice
+        float depth = -light.position.z;
+        float front = std::max(sliceNear, depth - light.radius);
+        float back = std::min(sliceFar, depth + light.radius);
+        float distance = depth < front ? front - depth : (depth > back ? depth - back : 0.0f);
+        float extent = std::sqrt(std::max(light.radius * light.radius - distance * distance, 0.0f));
+
+        uint32_t x0, x1, y0, y1;
+        if (!tileRange(light.position.x, extent, front, back, tanHalfX, tilesX, x0, x1) ||
+            !tileRange(light.position.y, extent, front, back, tanHalfY, tilesY, y0, y1))
+            continue;
+        for (uint32_t y = y0; y <= y1; y++) {
+            for (uint32_t x = x0; x <= x1; x++) {
+                work.cells.push_back(y * tilesX + x);
+                work.lights.push_back(i);
+            }
+        }
+    }
+
+    // counting sort by cell, sized from the exact counts (every light of a
+    // cell is kept); the lights of a cell stay in index order
+    const uint32_t cells = tilesX * tilesY;
+    uint32_t offsets[cells];
+    std::fill(work.counts, work.counts + cells, 0u);
+    for (uint32_t cell : work.cells)
+        work.counts[cell]++;
+    uint32_t total = 0;
+    for (uint32_t cell = 0; cell < cells; cell++) {
+        offsets[cell] = total;
+        total += work.counts[cell];
+    }
+    work.sorted.resize(total);
+    for (size_t k = 0; k < work.cells.size(); k++)
+        work.sorted[offsets[work.cells[k]]++] = work.lights[k];
+}
+
+void LightClusters::upload() {
+    const void* data[3] = { grid_.data(), indices_.data(), lights_.data() };
+    size_t bytes[3] = { grid_.size() * sizeof(uint32_t), indices_.size() * sizeof(uint32_t),
+                        lights_.size() * sizeof(glm::vec4) };
+    static const GLenum formats[3] = { GL_RG32UI, GL_R32UI, GL_RGBA32F };
+    for (int k = 0; k < 3; k++) {
+        bool created = (buffers_[k] == 0);
+        if (created) {
+            glGenBuffers(1, &buffers_[k]);
+            glGenTextures(1, &textures_[k]);
+        }
+
+        // orphan the old storage, as for the instance buffer; never empty,
+        // so the texture always has a store
+        GLState::bindBuffer(GL_TEXTURE_BUFFER, buffers_[k]);
+        if (std::max(bytes[k], sizeof(glm::vec4)) > capacities_[k] || created)
+            capacities_[k] = std::max(std::max(bytes[k], sizeof(glm::vec4)), capacities_[k] * 2);
+        glBufferData(GL_TEXTURE_BUFFER, capacities_[k], NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[k], data[k]);
+        GLState::bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        if (created) {
+            GLState::bindTexture(0, GL_TEXTURE_BUFFER, textures_[k]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[k], buffers_[k]);
+            GLState::bindTexture(0, GL_TEXTURE_BUFFER, 0);
+        }
+    }
+}
+
+void LightClusters::bind(GLuint firstUnit) const {
+    for (GLuint k = 0; k < 3; k++)
+        GLState::bindTexture(firstUnit + k, GL_TEXTURE_BUFFER, textures_[k]);
+}
+
+void LightClusters::release() {
+    for (int k = 0; k < 3; k++) {
+        if (textures_[k])
+            glDeleteTextures(1, &textures_[k]);
+        if (buffers_[k])
+            GLState::deleteBuffers(1, &buffers_[k]);
+        textures_[k] = 0;
+        buffers_[k] = 0;
+        capacities_[k] = 0;
+    }
+}
+
+int LightClusters::benchmark() {
+    // the default camera of the viewer, looking into a box of lights
+    const float fovy = 30.0f, aspect = 4.0f / 3.0f, nearDist = 0.01f, farDist = 100.0f;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 15.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> spread(-10.0f, 10.0f), radius(0.5f, 3.0f), unit(0.0f, 1.0f);
+
+    std::cout << "Light clusters benchmark: " << tilesX << " x " << tilesY << " x " << slices << " clusters" << std::endl;
+    const size_t counts[] = { 16, 64, 256, 1024, 4096, 16384 };
+    for (size_t count : counts) {
+        std::vector<PointLight> lights(count);
+        for (PointLight& light : lights)
+            light = { glm::vec3(spread(random), spread(random), spread(random)), radius(random),
+                      glm::vec3(unit(random), unit(random), unit(random)) };
+
+        LightClusters clusters;
+        double best[2] = { 1e30, 1e30 }; // one thread, all threads
+        for (int mode = 0; mode < 2; mode++) {
+            clusters.threads = (mode == 0) ? 1 : 0;
+            for (int run = 0; run < 10; run++) {
+                clusters.build(lights, view, fovy, aspect, nearDist, farDist);
+                best[mode] = std::min(best[mode], clusters.binMilliseconds());
+            }
+        }
+
+        size_t used = 0, most = 0;
+        for (uint32_t c = 0; c < clusterCount; c++) {
+            uint32_t n = clusters.grid()[2 * c + 1];
+            used += (n > 0);
+            most = std::max<size_t>(most, n);
+        }
+        std::cout << "  " << count << " lights: " << best[0] << " ms (1 thread), " << best[1] << " ms ("
+                  << resolveThreadCount(0) << " threads), " << clusters.indices().size() << " indices, "
+                  << (used ? static_cast<double>(clusters.indices().size()) / used : 0.0)
+                  << " lights per lit cluster (at most " << most << ")" << std::endl;
+    }
+    return 0;
+}
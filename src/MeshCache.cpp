@@ -0,0 +1,256 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "MeshCache.h"
+
+namespace {
+
+const char cacheMagic[8] = "MESHBIN";
+
+inline uint64_t alignOffset(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+// Checks that [offset, offset + size) lies inside a file of fileSize bytes
+inline bool inFile(uint64_t offset, uint64_t size, uint64_t fileSize) {
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+// Records the new modification time of a source whose contents did not
+// change, so the next load can skip hashing it. The header has a fixed
+// size, so this is a write in place; if it fails the hash is just
+// checked again next time.
+void touch(const std::string& path, int64_t sourceTime) {
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (file == NULL)
+        return;
+    if (fseek(file, static_cast<long>(offsetof(MeshCacheHeader, sourceTime)), SEEK_SET) != 0 ||
+        fwrite(&sourceTime, sizeof(sourceTime), 1, file) != 1)
+        std::cerr << "Cannot update mesh cache: " << path << std::endl;
+    fclose(file);
+}
+
+// Checksum of a cache file: the header, without the checksum itself and
+// the source time (rewritten in place by touch), and the payload
+uint64_t checksum(const MeshCacheHeader& header, const char* payload, size_t size) {
+    MeshCacheHeader hashed = header;
+    hashed.payloadHash = 0;
+    hashed.sourceTime = 0;
+    uint64_t parts[2] = { MeshCache::hash(&hashed, sizeof(hashed)), MeshCache::hash(payload, size) };
+    return MeshCache::hash(parts, sizeof(parts));
+}
+
+bool reject(MeshCacheEntry& entry) {
+    entry.file.close();
+    entry.view = MeshView();
+    return false;
+}
+
+}
+
+std::string MeshCache::cachePath(const char* sourcePath) {
+    return std::string(sourcePath) + ".meshbin";
+}
+
+uint64_t MeshCache::hash(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const uint64_t k0 = 0x9e3779b97f4a7c15ull;
+    const uint64_t k1 = 0xff51afd7ed558ccdull;
+    uint64_t h = 0xcbf29ce484222325ull ^ (size * k0);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        w *= k1;
+        w ^= w >> 31;
+        h = (h ^ w) * k0;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+
+    h ^= h >> 33;
+    h *= k1;
+    h ^= h >> 33;
+    return h;
+}
+
+bool MeshCache::sourceInfo(const char* sourcePath, MeshSourceInfo& info) {
+    std::error_code error;
+    std::filesystem::path path(sourcePath);
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+    info.size = size;
+    info.time = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+bool MeshCache::load(const char* sourcePath, uint32_t processing, MeshCacheEntry& entry) {
+    MeshSourceInfo info;
+    if (!sourceInfo(sourcePath, info))
+        return false;
+    if (!entry.file.open(cachePath(sourcePath).c_str()))
+        return false;
+
+    const MappedFile& file = entry.file;
+    if (file.size() < sizeof(MeshCacheHeader))
+        return reject(entry);
+    MeshCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != version ||
+        header.headerSize != sizeof(MeshCacheHeader) || header.fileSize != file.size() ||
+        header.processing != processing)
+        return reject(entry);
+
+    // Stale: the source changed size, or changed time and contents
+    if (header.sourceSize != info.size)
+        return reject(entry);
+    if (header.sourceTime != info.time) {
+        MappedFile source;
+        if (!source.open(sourcePath) || hash(source.data(), source.size()) != header.sourceHash)
+            return reject(entry);
+        touch(cachePath(sourcePath), info.time);
+    }
+
+    // Corrupt: checksum or layout do not add up
+    const char* payload = file.data() + sizeof(MeshCacheHeader);
+    if (checksum(header, payload, file.size() - sizeof(MeshCacheHeader)) != header.payloadHash)
+        return reject(entry);
+    if (header.streamCount > MeshView::maxStreams || header.attribCount > MeshView::maxAttribs)
+        return reject(entry);
+    if (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT)
+        return reject(entry);
+
+    MeshView& view = entry.view;
+    view.vertexCount = static_cast<size_t>(header.vertexCount);
+    view.streamCount = header.streamCount;
+    for (uint32_t i = 0; i < header.streamCount; i++) {
+        if (header.strides[i] == 0 || header.vertexCount > UINT64_MAX / header.strides[i] ||
+            !inFile(header.streamOffsets[i], header.vertexCount * header.strides[i], header.fileSize))
+            return reject(entry);
+        view.streams[i] = file.data() + header.streamOffsets[i];
+        view.strides[i] = header.strides[i];
+    }
+    view.attribCount = header.attribCount;
+    for (uint32_t i = 0; i < header.attribCount; i++) {
+        const VertexAttrib& attrib = header.attribs[i];
+        if (attrib.stream >= header.streamCount || attrib.offset >= header.strides[attrib.stream])
+            return reject(entry);
+        view.attribs[i] = attrib;
+    }
+    view.indexType = header.indexType;
+    view.indexCount = static_cast<size_t>(header.indexCount);
+    if (header.indexCount > UINT64_MAX / 4 || !inFile(header.indexOffset, view.indexBytes(), header.fileSize))
+        return reject(entry);
+    view.indices = file.data() + header.indexOffset;
+    if (header.lodCount > MeshView::maxLods)
+        return reject(entry);
+    view.lodCount = header.lodCount;
+    for (uint32_t i = 0; i < header.lodCount; i++) {
+        const MeshLod& lod = header.lods[i];
+        if (lod.first > header.indexCount || lod.count > header.indexCount - lod.first)
+            return reject(entry);
+        view.lods[i] = lod;
+    }
+    if (header.meshletCount > UINT64_MAX / sizeof(Meshlet) ||
+        !inFile(header.meshletOffset, header.meshletCount * sizeof(Meshlet), header.fileSize))
+        return reject(entry);
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(file.data() + header.meshletOffset);
+    for (uint64_t i = 0; i < header.meshletCount; i++) {
+        if (meshlets[i].first > header.indexCount || meshlets[i].count > header.indexCount - meshlets[i].first)
+            return reject(entry);
+    }
+    view.meshlets = meshlets;
+    view.meshletCount = static_cast<size_t>(header.meshletCount);
+    view.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    view.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    view.positionScale = glm::vec3(header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+    view.positionBias = glm::vec3(header.positionBias[0], header.positionBias[1], header.positionBias[2]);
+    return true;
+}
+
+bool MeshCache::save(const char* sourcePath, const MeshSourceInfo& info, uint32_t processing,
+                     const MeshView& mesh) {
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = version;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.sourceSize = info.size;
+    header.sourceTime = info.time;
+    header.sourceHash = info.hash;
+    header.processing = processing;
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = mesh.boundsMin[i];
+        header.boundsMax[i] = mesh.boundsMax[i];
+        header.positionScale[i] = mesh.positionScale[i];
+        header.positionBias[i] = mesh.positionBias[i];
+    }
+    header.vertexCount = mesh.vertexCount;
+    header.streamCount = mesh.streamCount;
+    header.attribCount = mesh.attribCount;
+    for (uint32_t i = 0; i < mesh.attribCount; i++)
+        header.attribs[i] = mesh.attribs[i];
+    header.indexCount = mesh.indexCount;
+    header.indexType = mesh.indexType;
+    header.lodCount = mesh.lodCount;
+    for (uint32_t i = 0; i < mesh.lodCount; i++)
+        header.lods[i] = mesh.lods[i];
+
+    // Lay out the blocks after the header
+    uint64_t offset = sizeof(MeshCacheHeader);
+    for (uint32_t i = 0; i < mesh.streamCount; i++) {
+        offset = alignOffset(offset);
+        header.strides[i] = mesh.strides[i];
+        header.streamOffsets[i] = offset;
+        offset += mesh.streamBytes(i);
+    }
+    offset = alignOffset(offset);
+    header.indexOffset = offset;
+    offset += mesh.indexBytes();
+    offset = alignOffset(offset);
+    header.meshletOffset = offset;
+    header.meshletCount = mesh.meshletCount;
+    offset += mesh.meshletCount * sizeof(Meshlet);
+    header.fileSize = offset;
+
+    std::vector<char> bytes(static_cast<size_t>(header.fileSize), 0);
+    for (uint32_t i = 0; i < mesh.streamCount; i++)
+        memcpy(bytes.data() + header.streamOffsets[i], mesh.streams[i], mesh.streamBytes(i));
+    memcpy(bytes.data() + header.indexOffset, mesh.indices, mesh.indexBytes());
+    if (mesh.meshletCount > 0)
+        memcpy(bytes.data() + header.meshletOffset, mesh.meshlets, mesh.meshletCount * sizeof(Meshlet));
+    header.payloadHash = checksum(header, bytes.data() + sizeof(MeshCacheHeader), bytes.size() - sizeof(MeshCacheHeader));
+    memcpy(bytes.data(), &header, sizeof(header));
+
+    // Write to a temporary file first so that a crash never leaves a torn cache
+    std::string path = cachePath(sourcePath);
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    written = (fclose(file) == 0) && written;
+    std::error_code error;
+    if (written)
+        std::filesystem::rename(temporary, path, error);
+    if (!written || error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "MeshData.h"
+
+namespace {
+
+// Open-addressing hash table from a (position, normal) pair to a vertex
+class VertexTable {
+public:
+    explicit VertexTable(size_t expected) {
+        size_t capacity = 1024;
+        while (capacity < expected * 2)
+            capacity *= 2;
+        keys_.assign(capacity, emptyKey);
+        values_.resize(capacity);
+    }
+
+    // Returns the vertex of key, inserting next if it is not there yet
+    unsigned int findOrInsert(uint64_t key, unsigned int next) {
+        if ((size_ + 1) * 2 > keys_.size())
+            grow();
+        size_t mask = keys_.size() - 1;
+        for (size_t slot = hash(key) & mask; ; slot = (slot + 1) & mask) {
+            if (keys_[slot] == key)
+                return values_[slot];
+            if (keys_[slot] == emptyKey) {
+                keys_[slot] = key;
+                values_[slot] = next;
+                size_++;
+                return next;
+            }
+        }
+    }
+
+private:
+    static constexpr uint64_t emptyKey = ~0ull;
+
+    static size_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+
+    void grow() {
+        std::vector<uint64_t> keys(keys_.size() * 2, emptyKey);
+        std::vector<unsigned int> values(keys.size());
+        size_t mask = keys.size() - 1;
+        for (size_t i = 0; i < keys_.size(); i++) {
+            if (keys_[i] == emptyKey)
+                continue;
+            size_t slot = hash(keys_[i]) & mask;
+            while (keys[slot] != emptyKey)
+                slot = (slot + 1) & mask;
+            keys[slot] = keys_[i];
+            values[slot] = values_[i];
+        }
+        keys_.swap(keys);
+        values_.swap(values);
+    }
+
+    std::vector<uint64_t> keys_;
+    std::vector<unsigned int> values_;
+    size_t size_ = 0;
+};
+
+// Welds n corners. corner(i, p, q) gives the (position, normal) key of
+// corner i, and values(p, q, position, normal) the attributes of a key.
+template <typename CornerFunction, typename ValueFunction>
+void weldCorners(MeshData& mesh, size_t n, size_t expected, CornerFunction corner, ValueFunction values) {
+    // Most meshes have about as many unique corners as positions
+    VertexTable table(expected);
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.positions.reserve(expected);
+    mesh.normals.reserve(expected);
+    mesh.indices.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t p, q;
+        corner(i, p, q);
+        uint64_t key = (static_cast<uint64_t>(p) << 32) | q;
+        unsigned int next = static_cast<unsigned int>(mesh.positions.size());
+        unsigned int vertex = table.findOrInsert(key, next);
+        if (vertex == next) {
+            glm::vec3 position, normal;
+            values(p, q, position, normal);
+            mesh.positions.push_back(position);
+            mesh.normals.push_back(normal);
+        }
+        mesh.indices[i] = vertex;
+    }
+}
+
+}
+
+void MeshData::weld(const ObjData& data) {
+    weldCorners(*this, data.positionIndices.size(), std::max(data.positions.size(), data.normals.size()),
+        [&data](size_t i, uint32_t& p, uint32_t& q) {
+            p = data.positionIndices[i];
+            q = data.normalIndices[i];
+        },
+        [&data](uint32_t p, uint32_t q, glm::vec3& position, glm::vec3& normal) {
+            position = data.positions[p];
+            normal = data.normals[q];
+        });
+}
+
+void MeshData::weld(const MeshCorner* corners, size_t n) {
+    // Corner i is the first one with its key when it becomes a vertex,
+    // so the values are looked up through the first corner's index
+    const MeshCorner* current = nullptr;
+    weldCorners(*this, n, n / 3,
+        [corners, &current](size_t i, uint32_t& p, uint32_t& q) {
+            current = &corners[i];
+            p = current->position;
+            q = current->normal;
+        },
+        [&current](uint32_t, uint32_t, glm::vec3& position, glm::vec3& normal) {
+            position = current->p;
+            normal = current->n;
+        });
+}
+
+void MeshData::finalize() {
+    boundsMin = glm::vec3(0.0f);
+    boundsMax = glm::vec3(0.0f);
+    if (!positions.empty()) {
+        boundsMin = boundsMax = positions[0];
+        for (const glm::vec3& p : positions) {
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+    }
+
+    shortIndices.clear();
+    if (positions.size() <= 0x10000)
+        shortIndices.assign(indices.begin(), indices.end());
+    packedPositions.clear();
+    packedNormals.clear();
+    positionScale = glm::vec3(1.0f);
+    positionBias = glm::vec3(0.0f);
+}
+
+void MeshData::quantize() {
+    quantize(boundsMin, boundsMax);
+}
+
+void MeshData::quantize(const glm::vec3& lo, const glm::vec3& hi) {
+    positionBias = lo;
+    positionScale = hi - lo;
+    glm::vec3 toUnit;
+    for (int i = 0; i < 3; i++)
+        toUnit[i] = positionScale[i] > 0.0f ? 1.0f / positionScale[i] : 0.0f;
+
+    packedPositions.resize(positions.size());
+    packedNormals.resize(positions.size());
+    for (size_t v = 0; v < positions.size(); v++) {
+        PackedPosition& out = packedPositions[v];
+        glm::vec3 unit = glm::clamp((positions[v] - lo) * toUnit, 0.0f, 1.0f);
+        for (int i = 0; i < 3; i++)
+            out.position[i] = static_cast<uint16_t>(unit[i] * 65535.0f + 0.5f);
+        out.position[3] = 0;
+
+        // 10 bits per signed component, w = 0
+        glm::vec3 n = normals[v];
+        float length = glm::length(n);
+        n = length > 0.0f ? n / length : glm::vec3(0.0f);
+        uint32_t bits = 0;
+        for (int i = 0; i < 3; i++) {
+            int32_t q = static_cast<int32_t>(std::lround(glm::clamp(n[i], -1.0f, 1.0f) * 511.0f));
+            bits |= (static_cast<uint32_t>(q) & 0x3ffu) << (10 * i);
+        }
+        packedNormals[v] = bits;
+    }
+}
+
+MeshView MeshData::view() const {
+    MeshView v;
+    v.vertexCount = positions.size();
+    if (!packedPositions.empty()) {
+        v.streamCount = 2;
+        v.streams[0] = packedPositions.data();
+        v.strides[0] = sizeof(PackedPosition);
+        v.streams[1] = packedNormals.data();
+        v.strides[1] = sizeof(uint32_t);
+        v.attribCount = 2;
+        v.attribs[0] = { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0 };
+        v.attribs[1] = { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 1, 0 };
+        v.positionScale = positionScale;
+        v.positionBias = positionBias;
+    }
+    else {
+        v.streamCount = 2;
+        v.streams[0] = positions.data();
+        v.strides[0] = sizeof(glm::vec3);
+        v.streams[1] = normals.data();
+        v.strides[1] = sizeof(glm::vec3);
+        v.attribCount = 2;
+        v.attribs[0] = { 0, 3, GL_FLOAT, GL_FALSE, 0, 0 };
+        v.attribs[1] = { 1, 3, GL_FLOAT, GL_FALSE, 1, 0 };
+    }
+
+    v.indexCount = indices.size();
+    v.lodCount = static_cast<uint32_t>(std::min<size_t>(lods.size(), MeshView::maxLods));
+    for (uint32_t i = 0; i < v.lodCount; i++)
+        v.lods[i] = lods[i];
+    v.meshlets = meshlets.data();
+    v.meshletCount = meshlets.size();
+    if (!shortIndices.empty() || indices.empty()) {
+        v.indices = shortIndices.data();
+        v.indexType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        v.indices = indices.data();
+        v.indexType = GL_UNSIGNED_INT;
+    }
+    v.boundsMin = boundsMin;
+    v.boundsMax = boundsMax;
+    return v;
+}
+
+size_t MeshView::vertexBytes() const {
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < streamCount; i++)
+        bytes += streamBytes(i);
+    return bytes;
+}
+
+size_t MeshView::indexBytes() const {
+    return indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+}
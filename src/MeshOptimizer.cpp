@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+namespace {
+
+// Forsyth's scoring constants; the modelled cache is larger than the
+// hardware FIFO so the order also works well on GPUs with bigger caches.
+constexpr int scoreCacheSize = 32;
+constexpr float cacheDecayPower = 1.5f;
+constexpr float lastTriangleScore = 0.75f;
+constexpr float valenceBoostScale = 2.0f;
+constexpr float valenceBoostPower = 0.5f;
+constexpr unsigned int valenceTableSize = 64;
+
+struct ScoreTables {
+    float cache[scoreCacheSize];
+    float valence[valenceTableSize];
+
+    ScoreTables() {
+        for (int i = 0; i < scoreCacheSize; i++) {
+            if (i < 3)
+                cache[i] = lastTriangleScore;
+            else
+                cache[i] = std::pow(1.0f - float(i - 3) / float(scoreCacheSize - 3), cacheDecayPower);
+        }
+        valence[0] = 0.0f;
+        for (unsigned int i = 1; i < valenceTableSize; i++)
+            valence[i] = valenceBoostScale * std::pow(float(i), -valenceBoostPower);
+    }
+
+    float vertexScore(int cachePosition, unsigned int remaining) const {
+        if (remaining == 0)
+            return -1.0f; // no triangle left to draw with this vertex
+        float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        if (remaining < valenceTableSize)
+            return score + valence[remaining];
+        return score + valenceBoostScale * std::pow(float(remaining), -valenceBoostPower);
+    }
+};
+
+// Triangles using each vertex, as one flat array with per-vertex offsets
+struct Adjacency {
+    std::vector<unsigned int> counts;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+
+    Adjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount)
+        : counts(vertexCount, 0), offsets(vertexCount, 0), triangles(indexCount) {
+        for (size_t i = 0; i < indexCount; i++)
+            counts[indices[i]]++;
+        unsigned int offset = 0;
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v] = offset;
+            offset += counts[v];
+        }
+        std::vector<unsigned int> fill(offsets);
+        for (size_t i = 0; i < indexCount; i++)
+            triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+};
+
+// FIFO cache simulation: a vertex is cached while fewer than cacheSize
+// misses happened since its own miss
+struct FifoCache {
+    std::vector<size_t> stamps;
+    size_t time;
+    unsigned int size;
+
+    FifoCache(size_t vertexCount, unsigned int cacheSize)
+        : stamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+    // Returns true on a miss
+    bool access(unsigned int v) {
+        if (time - stamps[v] > size) {
+            stamps[v] = time++;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() { time += size + 1; }
+};
+
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const unsigned int* indices, size_t indexCount,
+                                                   size_t vertexCount, unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0)
+        return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+        misses += cache.access(indices[i]);
+    stats.acmr = float(misses) / float(indexCount / 3);
+    stats.atvr = float(misses) / float(vertexCount);
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    static const ScoreTables tables;
+    Adjacency adjacency(indices, indexCount, vertexCount);
+
+    // counts doubles as the number of triangles still to emit per vertex
+    std::vector<unsigned int>& remaining = adjacency.counts;
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = tables.vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+                            vertexScores[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result(indexCount);
+    unsigned int cache[scoreCacheSize + 3];
+    unsigned int newCache[scoreCacheSize + 3];
+    int cacheCount = 0;
+    size_t inputCursor = 0; // restart point when the cache runs dry
+
+    size_t best = 0;
+    for (size_t t = 1; t < triangleCount; t++)
+        if (triangleScores[t] > triangleScores[best])
+            best = t;
+
+    for (size_t output = 0; output < triangleCount; output++) {
+        const unsigned int* triangle = indices + best * 3;
+        result[output * 3] = triangle[0];
+        result[output * 3 + 1] = triangle[1];
+        result[output * 3 + 2] = triangle[2];
+        emitted[best] = 1;
+
+        // the triangle's vertices go to the front of the cache
+        int newCount = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            bool repeated = (k > 0 && v == triangle[0]) || (k > 1 && v == triangle[1]);
+            if (!repeated) // degenerate triangles put a vertex in the cache once
+                newCache[newCount++] = v;
+
+            // drop the triangle from the vertex's list of pending triangles
+            unsigned int* list = &adjacency.triangles[adjacency.offsets[v]];
+            unsigned int count = remaining[v];
+            for (unsigned int j = 0; j < count; j++) {
+                if (list[j] == best) {
+                    list[j] = list[count - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache[newCount++] = v;
+        }
+        for (int i = scoreCacheSize; i < newCount; i++)
+            cachePosition[newCache[i]] = -1; // evicted
+        cacheCount = std::min(newCount, scoreCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        // rescore the cached vertices and their pending triangles
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            cachePosition[v] = i;
+            float delta = tables.vertexScore(i, remaining[v]) - vertexScores[v];
+            vertexScores[v] += delta;
+            const unsigned int* list = &adjacency.triangles[adjacency.offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+                triangleScores[list[j]] += delta;
+        }
+        for (int i = scoreCacheSize; i < newCount; i++) {
+            unsigned int v = newCache[i];
+            float delta = tables.vertexScore(-1, remaining[v]) - vertexScores[v];
+            vertexScores[v] += delta;
+            const unsigned int* list = &adjacency.triangles[adjacency.offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+                triangleScores[list[j]] += delta;
+        }
+
+        // next triangle: the best one touching the cache
+        float bestScore = -1.0f;
+        size_t candidate = triangleCount;
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            const unsigned int* list = &adjacency.triangles[adjacency.offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                if (triangleScores[list[j]] > bestScore) {
+                    bestScore = triangleScores[list[j]];
+                    candidate = list[j];
+                }
+            }
+        }
+        // dead end: continue with the next triangle in input order
+        if (candidate == triangleCount) {
+            while (inputCursor < triangleCount && emitted[inputCursor])
+                inputCursor++;
+            candidate = inputCursor;
+        }
+        if (candidate == triangleCount)
+            break;
+        best = candidate;
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned int* indices, size_t indexCount, const glm::vec3* positions,
+                                     size_t vertexCount, float threshold) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Hard boundaries: triangles whose three vertices all miss the cache,
+    // i.e. where the cache optimised order jumped to another part of the mesh.
+    const unsigned int cacheSize = 16;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int misses = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) +
+                     cache.access(indices[t * 3 + 2]);
+        if (misses == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    // Soft boundaries: inside a hard cluster, close a cluster (and flush the
+    // cache) as soon as its own ACMR is within threshold of the whole mesh,
+    // so that moving clusters around barely costs any cache efficiency.
+    float limit = analyzeVertexCache(indices, indexCount, vertexCount, cacheSize).acmr * threshold;
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t start = hard[h];
+        size_t misses = 0;
+        cache.clear();
+        clusters.push_back(start);
+        for (size_t t = start; t < hard[h + 1]; t++) {
+            misses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) +
+                      cache.access(indices[t * 3 + 2]);
+            if (t + 1 < hard[h + 1] && float(misses) <= limit * float(t + 1 - start)) {
+                start = t + 1;
+                misses = 0;
+                cache.clear();
+                clusters.push_back(start);
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+    size_t clusterCount = clusters.size() - 1;
+
+    // Area weighted centroid and normal of each cluster and of the mesh
+    std::vector<glm::vec3> centroids(clusterCount);
+    std::vector<glm::vec3> normals(clusterCount);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& d = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(n);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0f ? centroid / area : positions[indices[clusters[c] * 3]];
+        float length = glm::length(normal);
+        normals[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters facing away from the centre are the likely occluders: draw them first
+    std::vector<float> keys(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        keys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    for (size_t c : order)
+        result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData& mesh) {
+    size_t vertexCount = mesh.vertexCount();
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertexCount, unused);
+    unsigned int next = 0;
+    for (unsigned int& index : mesh.indices) {
+        if (remap[index] == unused)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    // vertices no triangle uses keep their relative order at the end
+    for (unsigned int& r : remap)
+        if (r == unused)
+            r = next++;
+
+    std::vector<glm::vec3> positions(vertexCount);
+    std::vector<glm::vec3> normals(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        positions[remap[v]] = mesh.positions[v];
+        normals[remap[v]] = mesh.normals[v];
+    }
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+}
+
+void MeshOptimizer::optimize(MeshData& mesh) {
+    optimizeVertexCache(mesh.indices.data(), mesh.indexCount(), mesh.vertexCount());
+    optimizeOverdraw(mesh.indices.data(), mesh.indexCount(), mesh.positions.data(), mesh.vertexCount());
+    optimizeVertexFetch(mesh);
+}
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+constexpr float MeshSimplifier::lodRatios[];
+
+namespace {
+
+// Sum of squared distances to a set of planes, weighted by triangle area
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    void addPlane(const glm::dvec3& n, double d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    // Weighted squared distance of p to the planes
+    double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double v = a00 * x * x + a11 * y * y + a22 * z * z +
+                   2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                   2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(v, 0.0);
+    }
+};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    float cost; // squared RMS distance
+};
+
+inline uint64_t edgeKey(unsigned int a, unsigned int b) {
+    return (uint64_t(a) << 32) | b;
+}
+
+// Locks the vertices that share their position with another vertex
+// (attribute seams) and the vertices on open borders
+void findLockedVertices(const glm::vec3* positions, size_t vertexCount, const std::vector<unsigned int>& indices,
+                        std::vector<char>& locked) {
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> first;
+    first.reserve(vertexCount);
+    std::vector<unsigned int> canonical(vertexCount);
+    locked.assign(vertexCount, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        auto inserted = first.emplace(positions[v], static_cast<unsigned int>(v));
+        canonical[v] = inserted.first->second;
+        if (!inserted.second) {
+            locked[v] = 1;
+            locked[canonical[v]] = 1;
+        }
+    }
+
+    // A directed edge without its reverse lies on a border
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = canonical[indices[i + k]];
+            unsigned int b = canonical[indices[i + (k + 1) % 3]];
+            edges.push_back(edgeKey(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (uint64_t edge : edges) {
+        unsigned int a = static_cast<unsigned int>(edge >> 32);
+        unsigned int b = static_cast<unsigned int>(edge);
+        if (!std::binary_search(edges.begin(), edges.end(), edgeKey(b, a)))
+            locked[a] = locked[b] = 1;
+    }
+    // seam vertices have to stay put together with their canonical vertex
+    for (size_t v = 0; v < vertexCount; v++)
+        if (locked[canonical[v]])
+            locked[v] = 1;
+}
+
+inline glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    return glm::cross(b - a, c - a);
+}
+
+}
+
+float MeshSimplifier::simplify(const glm::vec3* positions, size_t vertexCount, std::vector<unsigned int>& indices,
+                               size_t targetIndexCount) {
+    if (indices.size() <= targetIndexCount)
+        return 0.0f;
+
+    std::vector<char> locked;
+    findLockedVertices(positions, vertexCount, indices, locked);
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        glm::dvec3 n = glm::dvec3(triangleNormal(a, b, c));
+        double length = glm::length(n);
+        if (length <= 0.0)
+            continue;
+        n /= length;
+        double d = -glm::dot(n, glm::dvec3(a));
+        double area = 0.5 * length;
+        for (int k = 0; k < 3; k++)
+            quadrics[indices[i + k]].addPlane(n, d, area);
+    }
+
+    float maxCost = 0.0f;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<char> touched(vertexCount);
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+
+    // Every pass collapses the cheapest edges whose neighbourhoods do not
+    // overlap, then rebuilds the triangles, until the target is reached.
+    while (indices.size() > targetIndexCount) {
+        size_t triangleCount = indices.size() / 3;
+
+        // vertex -> triangles
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int v : indices)
+            adjacencyOffsets[v + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(indices.size());
+        {
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        // candidate collapses, one per edge in its cheaper direction
+        edges.clear();
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = indices[i + k];
+                unsigned int b = indices[i + (k + 1) % 3];
+                edges.push_back(a < b ? edgeKey(a, b) : edgeKey(b, a));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (uint64_t edge : edges) {
+            unsigned int a = static_cast<unsigned int>(edge >> 32);
+            unsigned int b = static_cast<unsigned int>(edge);
+            if (locked[a] && locked[b])
+                continue;
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            double scale = q.weight > 0.0 ? 1.0 / q.weight : 0.0;
+            double toB = locked[a] ? HUGE_VAL : q.evaluate(positions[b]) * scale;
+            double toA = locked[b] ? HUGE_VAL : q.evaluate(positions[a]) * scale;
+            if (toB <= toA)
+                collapses.push_back({ a, b, static_cast<float>(toB) });
+            else
+                collapses.push_back({ b, a, static_cast<float>(toA) });
+        }
+        std::sort(collapses.begin(), collapses.end(),
+            [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // a collapse removes about two triangles
+        size_t wanted = (indices.size() - targetIndexCount) / 6 + 1;
+        size_t done = 0;
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<unsigned int>(v);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        for (const Collapse& collapse : collapses) {
+            if (done >= wanted)
+                break;
+            unsigned int u = collapse.from, v = collapse.to;
+            if (touched[u] || touched[v])
+                continue;
+
+            // reject collapses that would flip a triangle around u
+            bool flips = false;
+            for (unsigned int j = adjacencyOffsets[u]; j < adjacencyOffsets[u + 1] && !flips; j++) {
+                const unsigned int* t = &indices[adjacency[j] * 3];
+                if (t[0] == v || t[1] == v || t[2] == v)
+                    continue; // this triangle disappears
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = positions[t[k]];
+                    q[k] = positions[t[k] == u ? v : t[k]];
+                }
+                glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+                glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            // lock the neighbourhood of u for the rest of the pass
+            for (unsigned int j = adjacencyOffsets[u]; j < adjacencyOffsets[u + 1]; j++) {
+                const unsigned int* t = &indices[adjacency[j] * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = 1;
+            }
+            touched[v] = 1;
+            remap[u] = v;
+            quadrics[v].add(quadrics[u]);
+            maxCost = std::max(maxCost, collapse.cost);
+            done++;
+        }
+        if (done == 0)
+            break; // every remaining edge is locked or would flip
+
+        // rebuild the triangles, dropping the collapsed ones
+        size_t out = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            unsigned int a = remap[indices[t * 3]];
+            unsigned int b = remap[indices[t * 3 + 1]];
+            unsigned int c = remap[indices[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            indices[out++] = a;
+            indices[out++] = b;
+            indices[out++] = c;
+        }
+        indices.resize(out);
+    }
+    return std::sqrt(maxCost);
+}
+
+void MeshSimplifier::buildLods(MeshData& mesh) {
+    mesh.lods.clear();
+    size_t fullCount = mesh.indices.size();
+    if (fullCount == 0)
+        return;
+    mesh.lods.push_back({ 0, static_cast<uint32_t>(fullCount), 0.0f });
+
+    std::vector<unsigned int> level(mesh.indices);
+    float error = 0.0f;
+    for (float ratio : lodRatios) {
+        if (mesh.lods.size() >= MeshView::maxLods)
+            break;
+        size_t previous = level.size();
+        size_t target = static_cast<size_t>(fullCount / 3 * ratio) * 3;
+        error += simplify(mesh.positions.data(), mesh.vertexCount(), level, target);
+        if (level.empty() || level.size() * 10 > previous * 9)
+            break;
+
+        std::vector<unsigned int> ordered(level);
+        MeshOptimizer::optimizeVertexCache(ordered.data(), ordered.size(), mesh.vertexCount());
+        MeshLod lod;
+        lod.first = static_cast<uint32_t>(mesh.indices.size());
+        lod.count = static_cast<uint32_t>(ordered.size());
+        lod.error = error;
+        mesh.indices.insert(mesh.indices.end(), ordered.begin(), ordered.end());
+        mesh.lods.push_back(lod);
+    }
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Meshlet.h"
+
+namespace {
+
+// Computes the bounds of the triangles [first, first + count) of indices
+Meshlet makeMeshlet(const MeshData& mesh, size_t first, size_t count) {
+    Meshlet meshlet;
+    meshlet.first = static_cast<uint32_t>(first);
+    meshlet.count = static_cast<uint32_t>(count);
+
+    // sphere around the center of the bounding box
+    glm::vec3 lo = mesh.positions[mesh.indices[first]];
+    glm::vec3 hi = lo;
+    for (size_t i = first; i < first + count; i++) {
+        lo = glm::min(lo, mesh.positions[mesh.indices[i]]);
+        hi = glm::max(hi, mesh.positions[mesh.indices[i]]);
+    }
+    glm::vec3 center = 0.5f * (lo + hi);
+    float radius = 0.0f;
+    for (size_t i = first; i < first + count; i++)
+        radius = std::max(radius, glm::length(mesh.positions[mesh.indices[i]] - center));
+
+    // cone around the average of the unit triangle normals
+    std::vector<glm::vec3> normals;
+    normals.reserve(count / 3);
+    glm::vec3 axis(0.0f);
+    for (size_t i = first; i + 2 < first + count; i += 3) {
+        const glm::vec3& a = mesh.positions[mesh.indices[i]];
+        glm::vec3 n = glm::cross(mesh.positions[mesh.indices[i + 1]] - a, mesh.positions[mesh.indices[i + 2]] - a);
+        float length = glm::length(n);
+        if (length > 0.0f) {
+            normals.push_back(n / length);
+            axis += n / length;
+        }
+    }
+    float cutoff = 1.0f;
+    float axisLength = glm::length(axis);
+    if (axisLength > 0.0f) {
+        axis /= axisLength;
+        float minDot = 1.0f;
+        for (const glm::vec3& n : normals)
+            minDot = std::min(minDot, glm::dot(n, axis));
+        if (minDot > 0.0f)
+            cutoff = std::sqrt(1.0f - minDot * minDot); // the cone is narrower than a half space
+    }
+
+    for (int k = 0; k < 3; k++) {
+        meshlet.center[k] = center[k];
+        meshlet.coneAxis[k] = axis[k];
+    }
+    meshlet.radius = radius;
+    meshlet.coneCutoff = cutoff;
+    return meshlet;
+}
+
+}
+
+void Meshlets::build(MeshData& mesh) {
+    mesh.meshlets.clear();
+    size_t end = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].first + mesh.lods[0].count;
+    size_t begin = mesh.lods.empty() ? 0 : mesh.lods[0].first;
+
+    // seen[v] == number when v is already part of meshlet number
+    std::vector<uint32_t> seen(mesh.vertexCount(), ~0u);
+    uint32_t number = 0;
+    auto newVertices = [&](size_t i) {
+        const unsigned int* t = &mesh.indices[i];
+        return (seen[t[0]] != number) +
+               (seen[t[1]] != number && t[1] != t[0]) +
+               (seen[t[2]] != number && t[2] != t[0] && t[2] != t[1]);
+    };
+
+    size_t first = begin;
+    unsigned int vertices = 0;
+    for (size_t i = begin; i + 2 < end; i += 3) {
+        if (vertices + newVertices(i) > maxVertices || (i - first) / 3 >= maxTriangles) {
+            mesh.meshlets.push_back(makeMeshlet(mesh, first, i - first));
+            first = i;
+            vertices = 0;
+            number++;
+        }
+        vertices += newVertices(i);
+        for (int k = 0; k < 3; k++)
+            seen[mesh.indices[i + k]] = number;
+    }
+    if (end > first)
+        mesh.meshlets.push_back(makeMeshlet(mesh, first, end - first));
+}
+
+bool Meshlets::isVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& eye) {
+    glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+    if (!frustum.isInFrustum(center, meshlet.radius))
+        return false;
+
+    // Backfacing when the eye sees every normal of the cone from behind,
+    // from every point of the sphere
+    if (meshlet.coneCutoff < 1.0f) {
+        glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+        glm::vec3 toCenter = center - eye;
+        if (glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+            return false;
+    }
+    return true;
+}
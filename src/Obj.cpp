@@ -6,8 +6,16 @@ that loads an obj file.
  vn nx ny nz
  f 123//456
  i.e. there is no texture.
+ The file is memory-mapped and tokenized by ObjParser,
+ and corners with the same position and normal are
+ welded into one vertex of a real index buffer.
+ The result is cached in a .meshbin file next to the
+ obj file (see MeshCache.h).
 *****************************************************/
 #include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -22,89 +30,322 @@ that loads an obj file.
 
 #include "Obj.h"
 #include "Geometry.h"
+#include "GeometryPool.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "ObjParser.h"
+#include "Parallel.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 
 void Obj::init(const char * filename){
-    std::vector< glm::vec3 > temp_vertices, vertices;
-    std::vector< glm::vec3 > temp_normals, normals;
-    std::vector< unsigned int > temp_vertexIndices, indices;
-    std::vector< unsigned int > temp_normalIndices;
+    ObjLoadResult result;
+    if( !load( filename, options, result ) )
+        exit(-1);
+    upload( result.view );
+}
+
+bool Obj::load(const char * filename, const ObjLoadOptions& options, ObjLoadResult& result){
+    // a valid cache is uploaded straight from its mapping
+    if( options.useCache && MeshCache::load( filename, options.processing(), result.cached ) ){
+        std::cout << "Loading " << MeshCache::cachePath( filename ) << "...done." << std::endl;
+        result.view = result.cached.view;
+        return true;
+    }
+
+    ObjData data;
     
     // load obj file
-    FILE * file = fopen( filename , "r" );
-    if( file == NULL ){
+    MappedFile file;
+    if( !file.open( filename ) ){
         std::cerr << "Cannot open file: " << filename << std::endl;
-        exit(-1);
+        return false;
     }
     std::cout << "Loading " << filename << "...";
-    while (!feof(file)){
-        char lineHeader[128];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break; // EOF = End Of File. Quit the loop.
-
-        // else : parse lineHeader
-        if ( strcmp( lineHeader, "v" ) == 0 ){
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-            temp_vertices.push_back(vertex);
-        }else if ( strcmp( lineHeader, "vn" ) == 0 ){
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-            temp_normals.push_back(normal);
-        }else if ( strcmp( lineHeader, "f" ) == 0 ){
-            //std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], normalIndex[3];
-            fscanf(file, "%d//%d %d//%d %d//%d\n", &vertexIndex[0], &normalIndex[0], &vertexIndex[1], &normalIndex[1], &vertexIndex[2], &normalIndex[2] );
-            temp_vertexIndices.push_back(vertexIndex[0]);
-            temp_vertexIndices.push_back(vertexIndex[1]);
-            temp_vertexIndices.push_back(vertexIndex[2]);
-            temp_normalIndices.push_back(normalIndex[0]);
-            temp_normalIndices.push_back(normalIndex[1]);
-            temp_normalIndices.push_back(normalIndex[2]);
-        }
+    auto start = std::chrono::steady_clock::now();
+    unsigned int threads = resolveThreadCount( options.parseThreads );
+    if( !ObjParser::parse( file.data(), file.data() + file.size(), data, threads ) ){
+        std::cerr << "Malformed obj file: " << filename << std::endl;
+        return false;
     }
-    std::cout << "done." << std::endl;
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    double megabytes = file.size() / (1024.0 * 1024.0);
+    std::cout << "done (" << megabytes << " MB in " << seconds * 1000.0 << " ms, "
+              << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s, "
+              << threads << " threads)." << std::endl;
     
-    // post processing
+    // post processing: merge corners that share position and normal
     std::cout << "Processing data...";
-    unsigned int n = temp_vertexIndices.size(); // #(triangles)*3
-    vertices.resize(n);
-    normals.resize(n);
-    indices.resize(n);
-    for (unsigned int i = 0; i<n; i++){
-        indices[i] = i;
-        vertices[i] = temp_vertices[ temp_vertexIndices[i] - 1 ];
-        normals[i] = temp_normals[ temp_normalIndices[i] - 1 ];
+    MeshData& mesh = result.mesh;
+    mesh.weld(data);
+    std::cout << "done (" << data.positionIndices.size() << " vertices welded to "
+              << mesh.vertexCount() << ")." << std::endl;
+    
+    // reorder triangles and vertices for the post-transform cache, overdraw and fetches
+    if( options.optimize ){
+        std::cout << "Optimizing mesh...";
+        start = std::chrono::steady_clock::now();
+        VertexCacheStats before = MeshOptimizer::analyzeVertexCache( mesh.indices.data(), mesh.indexCount(), mesh.vertexCount() );
+        MeshOptimizer::optimize( mesh );
+        VertexCacheStats after = MeshOptimizer::analyzeVertexCache( mesh.indices.data(), mesh.indexCount(), mesh.vertexCount() );
+        seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        std::cout << "done (ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr
+                  << ", " << seconds * 1000.0 << " ms)." << std::endl;
+    }
+    
+    // coarser levels of detail, sharing the vertices
+    if( options.generateLods ){
+        std::cout << "Building LODs...";
+        start = std::chrono::steady_clock::now();
+        MeshSimplifier::buildLods( mesh );
+        seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        std::cout << "done (";
+        for( const MeshLod& lod : mesh.lods )
+            std::cout << lod.count / 3 << " triangles, error " << lod.error << "; ";
+        std::cout << seconds * 1000.0 << " ms)." << std::endl;
     }
-    std::cout << "done." << std::endl;
     
-    // setting up buffers
+    // culling clusters of the full level
+    if( options.buildMeshlets ){
+        Meshlets::build( mesh );
+        std::cout << "Built " << mesh.meshlets.size() << " meshlets." << std::endl;
+    }
+    mesh.finalize();
+    
+    // compact vertex layout
+    if( options.quantize ){
+        size_t floatBytes = mesh.view().vertexBytes();
+        mesh.quantize();
+        size_t packedBytes = mesh.view().vertexBytes();
+        std::cout << "Quantized vertices: " << floatBytes << " -> " << packedBytes << " bytes ("
+                  << (floatBytes - packedBytes) << " bytes saved)." << std::endl;
+    }
+    
+    // (re)build the cache for the next load
+    result.view = mesh.view();
+    MeshSourceInfo source;
+    if( options.useCache && MeshCache::sourceInfo( filename, source ) ){
+        source.hash = MeshCache::hash( file.data(), file.size() );
+        if( !MeshCache::save( filename, source, options.processing(), result.view ) )
+            std::cerr << "Cannot write mesh cache: " << MeshCache::cachePath( filename ) << std::endl;
+    }
+    return true;
+}
+
+void Obj::upload(const MeshView& mesh){
     std::cout << "Setting up buffers...";
+    setupBuffers(mesh, true);
+    ready = true;
+    std::cout << "done." << std::endl;
+}
+
+void Obj::beginUpload(const MeshView& mesh){
+    setupBuffers(mesh, false);
+    uploaded_ = 0;
+    ready = false;
+}
+
+bool Obj::continueUpload(const MeshView& mesh, size_t& budget){
+    // The streams and then the indices are copied as one sequence of bytes;
+    // uploaded_ is the position in that sequence.
+    size_t regionStart = 0;
+    for (unsigned int i = 0; i <= mesh.streamCount; i++){
+        bool isIndices = (i == mesh.streamCount);
+        size_t size = isIndices ? mesh.indexBytes() : mesh.streamBytes(i);
+        const char* source = static_cast<const char*>(isIndices ? mesh.indices : mesh.streams[i]);
+        if (uploaded_ < regionStart + size){
+            size_t offset = uploaded_ - regionStart;
+            size_t n = std::min(size - offset, budget);
+            if (n == 0)
+                return false;
+            
+            // GL_COPY_WRITE_BUFFER leaves the bindings of the vertex array alone
+            GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+            void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, n,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (target){
+                memcpy(target, source + offset, n);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            else {
+                glBufferSubData(GL_COPY_WRITE_BUFFER, offset, n, source + offset);
+            }
+            GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            uploaded_ += n;
+            budget -= n;
+            if (uploaded_ < regionStart + size)
+                return false;
+        }
+        regionStart += size;
+    }
+    ready = true;
+    return true;
+}
+
+void Obj::setupBuffers(const MeshView& mesh, bool withData){
     glGenVertexArrays(1, &vao );
-    buffers.resize(3);
-    glGenBuffers(3, buffers.data());
-    glBindVertexArray(vao);
-    
-    // 0th attribute: position
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, n*sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,(void*)0);
+    buffers.resize(mesh.streamCount + 1);
+    glGenBuffers(mesh.streamCount + 1, buffers.data());
+    GLState::bindVertexArray(vao);
     
-    // 1st attribute: normal
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, n*sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,0,(void*)0);
+    // vertex streams and the attributes stored in them
+    for (unsigned int i = 0; i < mesh.streamCount; i++){
+        GLState::bindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.streamBytes(i), withData ? mesh.streams[i] : NULL, GL_STATIC_DRAW);
+    }
+    for (unsigned int i = 0; i < mesh.attribCount; i++){
+        const VertexAttrib& attrib = mesh.attribs[i];
+        GLState::bindBuffer(GL_ARRAY_BUFFER, buffers[attrib.stream]);
+        glEnableVertexAttribArray(attrib.location);
+        glVertexAttribPointer(attrib.location, attrib.size, attrib.type, attrib.normalized,
+                              mesh.strides[attrib.stream], (void*)(uintptr_t)attrib.offset);
+    }
     
     // indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n*sizeof(indices[0]), &indices[0], GL_STATIC_DRAW);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[mesh.streamCount]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBytes(), withData ? mesh.indices : NULL, GL_STATIC_DRAW);
+    type = mesh.indexType;
     
-    count = n;
-    glBindVertexArray(0);
-    std::cout << "done." << std::endl;
+    lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+    if (lods.empty())
+        lods.push_back({ 0, static_cast<uint32_t>(mesh.indexCount), 0.0f });
+    count = lods[0].count;
+    meshlets.assign(mesh.meshlets, mesh.meshlets + mesh.meshletCount);
+    boundsMin = mesh.boundsMin;
+    boundsMax = mesh.boundsMax;
+    hasBounds = true;
+    positionScale = mesh.positionScale;
+    positionBias = mesh.positionBias;
+    setupOccluder(mesh);
+    layout = mesh;
+    std::fill(std::begin(layout.streams), std::end(layout.streams), nullptr);
+    layout.indices = nullptr;
+    layout.meshlets = nullptr;
+    GLState::bindVertexArray(0);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Obj::setupOccluder(const MeshView& mesh){
+    occluderPositions.clear();
+    occluderIndices.clear();
+    const MeshLod& lod = lods.back();
+    const VertexAttrib* position = nullptr;
+    for (unsigned int i = 0; i < mesh.attribCount; i++)
+        if (mesh.attribs[i].location == 0)
+            position = &mesh.attribs[i];
+    if (lod.count > maxOccluderIndices || !mesh.indices || !position || position->size < 3 ||
+        !(position->type == GL_FLOAT || (position->type == GL_UNSIGNED_SHORT && position->normalized)))
+        return;
+
+    // the vertices of the level, decoded and renumbered in order of use
+    std::vector<uint32_t> remap(mesh.vertexCount, UINT32_MAX);
+    const char* stream = static_cast<const char*>(mesh.streams[position->stream]);
+    for (uint32_t i = lod.first; i < lod.first + lod.count; i++){
+        uint32_t v = (mesh.indexType == GL_UNSIGNED_SHORT) ? static_cast<const GLushort*>(mesh.indices)[i]
+                                                          : static_cast<const GLuint*>(mesh.indices)[i];
+        if (remap[v] == UINT32_MAX){
+            remap[v] = static_cast<uint32_t>(occluderPositions.size());
+            const char* vertex = stream + size_t(v) * mesh.strides[position->stream] + position->offset;
+            glm::vec3 p;
+            if (position->type == GL_FLOAT)
+                memcpy(&p[0], vertex, sizeof(p));
+            else {
+                GLushort q[3];
+                memcpy(q, vertex, sizeof(q));
+                p = mesh.positionBias + glm::vec3(q[0], q[1], q[2]) / 65535.0f * mesh.positionScale;
+            }
+            occluderPositions.push_back(p);
+        }
+        occluderIndices.push_back(remap[v]);
+    }
+}
+
+void Obj::release(void){
+    if (pool)
+        pool->remove(*this);
+    Geometry::release();
+}
+
+size_t Obj::selectLod(const glm::mat4& modelview, const glm::mat4& projection, float viewportHeight,
+                      float maxErrorPixels) const {
+    if (lods.size() < 2)
+        return 0;
+
+    // distance to the nearest point of the bounding sphere
+    glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+    float radius = 0.5f * glm::length(boundsMax - boundsMin);
+    float scale = std::max(glm::length(glm::vec3(modelview[0])),
+                  std::max(glm::length(glm::vec3(modelview[1])), glm::length(glm::vec3(modelview[2]))));
+    float distance = -(modelview * glm::vec4(center, 1.0f)).z - radius * scale;
+    if (distance <= 0.0f)
+        return 0; // the camera is inside or behind the near side of the sphere
+
+    // object space length -> pixels at that distance
+    float pixelsPerUnit = scale * projection[1][1] * 0.5f * viewportHeight / distance;
+    size_t level = 0;
+    while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit <= maxErrorPixels)
+        level++;
+    return level;
+}
+
+void Obj::drawLod(size_t level){
+    if (lods.empty()){
+        draw();
+        return;
+    }
+    const MeshLod& lod = lods[std::min(level, lods.size() - 1)];
+    size_t indexSize = (type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    GLState::bindVertexArray(vao);
+    glDrawElements(mode, lod.count, type, (void*)(uintptr_t)(lod.first * indexSize));
+}
+
+void Obj::drawLodInstanced(size_t level, GLsizei instances){
+    const MeshLod& lod = lods[std::min(level, lods.size() - 1)];
+    size_t indexSize = (type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElementsInstanced(mode, lod.count, type, (void*)(uintptr_t)(lod.first * indexSize), instances);
+}
+
+size_t Obj::drawCulled(const glm::mat4& modelview, const glm::mat4& projection){
+    if (meshlets.empty()){
+        drawLod(0);
+        return 0;
+    }
+
+    // frustum and eye in object space
+    Frustum frustum;
+    frustum.update(projection * modelview);
+    glm::vec3 eye = glm::vec3(glm::inverse(modelview)[3]);
+
+    // surviving meshlets, merged into ranges where they are adjacent
+    size_t indexSize = (type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    size_t culled = 0;
+    uint32_t rangeEnd = UINT32_MAX;
+    drawCounts_.clear();
+    drawOffsets_.clear();
+    for (const Meshlet& meshlet : meshlets){
+        if (!Meshlets::isVisible(meshlet, frustum, eye)){
+            culled += meshlet.count / 3;
+            continue;
+        }
+        if (meshlet.first == rangeEnd)
+            drawCounts_.back() += meshlet.count;
+        else {
+            drawCounts_.push_back(meshlet.count);
+            drawOffsets_.push_back((const void*)(uintptr_t)(meshlet.first * indexSize));
+        }
+        rangeEnd = meshlet.first + meshlet.count;
+    }
+
+    if (!drawCounts_.empty()){
+        GLState::bindVertexArray(vao);
+        glMultiDrawElements(mode, drawCounts_.data(), type, drawOffsets_.data(),
+                            static_cast<GLsizei>(drawCounts_.size()));
+    }
+    return culled;
 }
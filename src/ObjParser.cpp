@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "ObjParser.h"
+#include "Parallel.h"
+
+namespace {
+
+enum RecordType { RECORD_OTHER, RECORD_POSITION, RECORD_NORMAL, RECORD_FACE };
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+inline const char* lineEnd(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol ? eol : end;
+}
+
+// Identifies the record on a line and advances p past its keyword
+inline RecordType recordType(const char*& p, const char* end) {
+    p = skipBlanks(p, end);
+    if (end - p < 2)
+        return RECORD_OTHER;
+    if (p[0] == 'v') {
+        if (isBlank(p[1])) {
+            p += 1;
+            return RECORD_POSITION;
+        }
+        if (p[1] == 'n' && end - p >= 3 && isBlank(p[2])) {
+            p += 2;
+            return RECORD_NORMAL;
+        }
+    }
+    else if (p[0] == 'f' && isBlank(p[1])) {
+        p += 1;
+        return RECORD_FACE;
+    }
+    return RECORD_OTHER;
+}
+
+// Number of corner tokens on the rest of a face line
+inline size_t countCorners(const char* p, const char* end) {
+    size_t n = 0;
+    for (;;) {
+        p = skipBlanks(p, end);
+        if (p >= end || *p == '#')
+            return n;
+        ++n;
+        while (p < end && !isBlank(*p))
+            ++p;
+    }
+}
+
+inline const char* parseInt(const char* p, const char* end, long long& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    if (p >= end || !isDigit(*p))
+        return nullptr;
+    long long v = 0;
+    while (p < end && isDigit(*p)) {
+        v = v * 10 + (*p - '0');
+        ++p;
+    }
+    value = negative ? -v : v;
+    return p;
+}
+
+// Parses a corner "v", "v/t", "v//n" or "v/t/n"
+inline const char* parseCorner(const char* p, const char* end, long long& v, long long& n) {
+    p = parseInt(p, end, v);
+    if (!p)
+        return nullptr;
+    n = 0;
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') {
+            long long t;
+            p = parseInt(p, end, t);
+            if (!p)
+                return nullptr;
+        }
+        if (p < end && *p == '/') {
+            p = parseInt(p + 1, end, n);
+            if (!p)
+                return nullptr;
+        }
+    }
+    return p;
+}
+
+// Converts a 1-based (or negative, relative) obj index to a 0-based one.
+// Invalid indices map to a value that validate() rejects.
+inline unsigned int resolveIndex(long long index, size_t definedSoFar) {
+    if (index > 0)
+        return static_cast<unsigned int>(index - 1);
+    if (index < 0 && static_cast<size_t>(-index) <= definedSoFar)
+        return static_cast<unsigned int>(definedSoFar + index);
+    return ~0u;
+}
+
+// Triangulates the rest of a face line as a fan around its first corner.
+// Returns the number of corners written, or -1 if the line is malformed.
+inline long long parseFace(const char* q, const char* eol, size_t v, size_t vn,
+                           unsigned int* positionIndices, unsigned int* normalIndices) {
+    unsigned int firstV = 0, firstN = 0, prevV = 0, prevN = 0;
+    long long c = 0;
+    for (int k = 0; ; k++) {
+        q = skipBlanks(q, eol);
+        if (q >= eol || *q == '#')
+            return c;
+        long long vi, ni;
+        q = parseCorner(q, eol, vi, ni);
+        if (!q || (q < eol && !isBlank(*q)))
+            return -1;
+        unsigned int curV = resolveIndex(vi, v);
+        unsigned int curN = resolveIndex(ni, vn);
+        if (k == 0) {
+            firstV = curV;
+            firstN = curN;
+        }
+        else if (k >= 2) {
+            positionIndices[c] = firstV;
+            positionIndices[c + 1] = prevV;
+            positionIndices[c + 2] = curV;
+            normalIndices[c] = firstN;
+            normalIndices[c + 1] = prevN;
+            normalIndices[c + 2] = curN;
+            c += 3;
+        }
+        prevV = curV;
+        prevN = curN;
+    }
+}
+
+inline const char* parseVec3(const char* p, const char* end, glm::vec3& v) {
+    for (int i = 0; i < 3; i++) {
+        p = ObjParser::parseFloat(skipBlanks(p, end), end, v[i]);
+        if (!p)
+            return nullptr;
+    }
+    return p;
+}
+
+}
+
+const char* ObjParser::parseFloat(const char* p, const char* end, float& value) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // Accumulate up to 19 significant digits; the rest only moves the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+    while (p < end && isDigit(*p)) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                ++digits;
+        }
+        else {
+            ++exponent;
+        }
+        ++p;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isDigit(*p)) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            }
+            ++p;
+        }
+    }
+    if (!any)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = (*q == '-');
+            ++q;
+        }
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            while (q < end && isDigit(*q)) {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+                ++q;
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0)
+        result = (exponent >= -22) ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        result = (exponent <= 22) ? result * powers[exponent] : result * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+ObjCounts ObjParser::count(const char* begin, const char* end) {
+    ObjCounts counts;
+    for (const char* p = begin; p < end; ) {
+        const char* eol = lineEnd(p, end);
+        const char* q = p;
+        switch (recordType(q, eol)) {
+        case RECORD_POSITION:
+            counts.positions++;
+            break;
+        case RECORD_NORMAL:
+            counts.normals++;
+            break;
+        case RECORD_FACE: {
+            size_t n = countCorners(q, eol);
+            if (n >= 3)
+                counts.corners += (n - 2) * 3;
+            break;
+        }
+        default:
+            break;
+        }
+        p = eol + 1;
+    }
+    return counts;
+}
+
+bool ObjParser::parseRange(const char* begin, const char* end, const ObjCounts& first, ObjData& out) {
+    size_t v = first.positions;
+    size_t vn = first.normals;
+    size_t c = first.corners;
+    glm::vec3* positions = out.positions.data();
+    glm::vec3* normals = out.normals.data();
+    unsigned int* positionIndices = out.positionIndices.data();
+    unsigned int* normalIndices = out.normalIndices.data();
+
+    for (const char* p = begin; p < end; ) {
+        const char* eol = lineEnd(p, end);
+        const char* q = p;
+        switch (recordType(q, eol)) {
+        case RECORD_POSITION:
+            if (!parseVec3(q, eol, positions[v++]))
+                return false;
+            break;
+        case RECORD_NORMAL:
+            if (!parseVec3(q, eol, normals[vn++]))
+                return false;
+            break;
+        case RECORD_FACE: {
+            long long n = parseFace(q, eol, v, vn, positionIndices + c, normalIndices + c);
+            if (n < 0)
+                return false;
+            c += n;
+            break;
+        }
+        default:
+            break;
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+const char* ObjParser::parseLine(const char* p, const char* end, const ObjCounts& defined, ObjLine& line) {
+    const char* eol = lineEnd(p, end);
+    const char* next = (eol < end) ? eol + 1 : end;
+    const char* q = p;
+    switch (recordType(q, eol)) {
+    case RECORD_POSITION:
+        line.type = ObjLine::POSITION;
+        return parseVec3(q, eol, line.value) ? next : nullptr;
+    case RECORD_NORMAL:
+        line.type = ObjLine::NORMAL;
+        return parseVec3(q, eol, line.value) ? next : nullptr;
+    case RECORD_FACE: {
+        line.type = ObjLine::FACE;
+        size_t n = countCorners(q, eol);
+        size_t corners = (n >= 3) ? (n - 2) * 3 : 0;
+        if (line.positionIndices.size() < corners) {
+            line.positionIndices.resize(corners);
+            line.normalIndices.resize(corners);
+        }
+        line.corners = static_cast<size_t>(parseFace(q, eol, defined.positions, defined.normals,
+                                                     line.positionIndices.data(), line.normalIndices.data()));
+        return (line.corners == corners) ? next : nullptr;
+    }
+    default:
+        line.type = ObjLine::OTHER;
+        return next;
+    }
+}
+
+bool ObjParser::validate(const ObjData& data, size_t first, size_t last) {
+    const size_t numPositions = data.positions.size();
+    const size_t numNormals = data.normals.size();
+    for (size_t i = first; i < last; i++) {
+        if (data.positionIndices[i] >= numPositions || data.normalIndices[i] >= numNormals)
+            return false;
+    }
+    return true;
+}
+
+bool ObjParser::parse(const char* begin, const char* end, ObjData& out, unsigned int threadCount) {
+    // Chunks smaller than this are not worth a thread
+    const size_t minChunkSize = 1 << 20;
+    const size_t size = end - begin;
+    unsigned int numChunks = static_cast<unsigned int>(
+        std::min<size_t>(resolveThreadCount(threadCount), std::max<size_t>(1, size / minChunkSize)));
+
+    // Split the buffer into chunks that start right after a newline
+    std::vector<const char*> bounds(numChunks + 1);
+    bounds[0] = begin;
+    bounds[numChunks] = end;
+    for (unsigned int i = 1; i < numChunks; i++) {
+        const char* p = std::max(begin + size / numChunks * i, bounds[i - 1]);
+        bounds[i] = (p < end) ? std::min(lineEnd(p, end) + 1, end) : end;
+    }
+
+    // Count the records of every chunk, then turn the counts into offsets
+    std::vector<ObjCounts> first(numChunks + 1);
+    parallelFor(numChunks, [&](unsigned int i) {
+        first[i + 1] = count(bounds[i], bounds[i + 1]);
+    });
+    for (unsigned int i = 1; i <= numChunks; i++) {
+        first[i].positions += first[i - 1].positions;
+        first[i].normals += first[i - 1].normals;
+        first[i].corners += first[i - 1].corners;
+    }
+
+    const ObjCounts& total = first[numChunks];
+    out.positions.resize(total.positions);
+    out.normals.resize(total.normals);
+    out.positionIndices.resize(total.corners);
+    out.normalIndices.resize(total.corners);
+
+    // Fill every chunk at its offsets. Indices can refer to vertices of
+    // other chunks, so they are validated once all chunks are done.
+    std::vector<char> ok(numChunks, 1);
+    parallelFor(numChunks, [&](unsigned int i) {
+        ok[i] = parseRange(bounds[i], bounds[i + 1], first[i], out);
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+        return false;
+    parallelFor(numChunks, [&](unsigned int i) {
+        ok[i] = validate(out, total.corners * i / numChunks, total.corners * (i + 1) / numChunks);
+    });
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OCCLUSION_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "Parallel.h"
+
+#if defined(OCCLUSION_AVX2) && (defined(__GNUC__) || defined(__clang__))
+#define OCCLUSION_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define OCCLUSION_AVX2_TARGET
+#endif
+
+namespace {
+
+// Smallest w of a vertex in front of the eye; nearer ones are dropped
+const float minW = 1e-3f;
+
+glm::vec2 toScreen(const glm::vec4& clip) {
+    return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * OcclusionCuller::width,
+                     (clip.y / clip.w * 0.5f + 0.5f) * OcclusionCuller::height);
+}
+
+#ifdef OCCLUSION_AVX2
+// For each mask of 8 lanes, the lanes that are set, packed to the front,
+// and their number
+struct LanePack {
+    alignas(32) int32_t lanes[256][8];
+    int count[256];
+
+    LanePack() {
+        for (int mask = 0; mask < 256; mask++) {
+            count[mask] = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                lanes[mask][lane] = 0;
+                if (mask & (1 << lane))
+                    lanes[mask][count[mask]++] = lane;
+            }
+        }
+    }
+};
+const LanePack lanePack;
+
+// Screen rectangles and nearest w of 8 boxes, grown one corner at a time
+struct Rects8 {
+    __m256 loX, loY, hiX, hiY, nearest, behind;
+};
+
+// Adds the corner whose clip space x, y and w are the sums of the terms of
+// its three coordinates, in the order of OcclusionCuller::boxVisible()
+OCCLUSION_AVX2_TARGET
+inline void addCorner(Rects8& rects, const __m256* x, const __m256* y, const __m256* z) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 w = _mm256_add_ps(_mm256_add_ps(x[2], y[2]), z[2]);
+    rects.behind = _mm256_or_ps(rects.behind, _mm256_cmp_ps(w, _mm256_set1_ps(minW), _CMP_LT_OQ));
+    rects.nearest = _mm256_min_ps(rects.nearest, w);
+    __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), w);
+    __m256 sx = _mm256_add_ps(_mm256_add_ps(x[0], y[0]), z[0]);
+    sx = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sx, inverse), half), half),
+                       _mm256_set1_ps(static_cast<float>(OcclusionCuller::width)));
+    __m256 sy = _mm256_add_ps(_mm256_add_ps(x[1], y[1]), z[1]);
+    sy = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sy, inverse), half), half),
+                       _mm256_set1_ps(static_cast<float>(OcclusionCuller::height)));
+    rects.loX = _mm256_min_ps(rects.loX, sx);
+    rects.loY = _mm256_min_ps(rects.loY, sy);
+    rects.hiX = _mm256_max_ps(rects.hiX, sx);
+    rects.hiY = _mm256_max_ps(rects.hiY, sy);
+}
+#endif
+
+}
+
+bool OcclusionCuller::avx2Supported() {
+#if !defined(OCCLUSION_AVX2)
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesAvx && (info[1] & (1 << 5));
+#else
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#endif
+}
+
+void OcclusionCuller::begin(const glm::mat4& viewProjection) {
+    viewProjection_ = viewProjection;
+    triangles_.clear();
+    depth_.assign(size_t(width) * height, FLT_MAX);
+    tileMax_.assign(size_t(tilesX) * tilesY, FLT_MAX);
+    tileMin_.assign(size_t(tilesX) * tilesY, FLT_MAX);
+}
+
+void OcclusionCuller::addOccluder(const glm::vec3* positions, const uint32_t* indices, size_t indexCount,
+                                  const glm::mat4& model) {
+    glm::mat4 transform = viewProjection_ * model;
+    uint32_t vertexCount = 0;
+    for (size_t i = 0; i < indexCount; i++)
+        vertexCount = std::max(vertexCount, indices[i] + 1);
+    clip_.resize(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        clip_[v] = transform * glm::vec4(positions[v], 1.0f);
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        const glm::vec4& c0 = clip_[indices[i]];
+        const glm::vec4& c1 = clip_[indices[i + 1]];
+        const glm::vec4& c2 = clip_[indices[i + 2]];
+        if (c0.w < minW || c1.w < minW || c2.w < minW)
+            continue; // dropping part of an occluder only hides less
+        glm::vec2 p[3] = { toScreen(c0), toScreen(c1), toScreen(c2) };
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (!(area > 0.0f))
+            continue; // back facing or degenerate
+
+        Triangle triangle;
+        for (int e = 0; e < 3; e++) {
+            const glm::vec2& a = p[e];
+            const glm::vec2& b = p[(e + 1) % 3];
+            triangle.a[e] = a.y - b.y;
+            triangle.b[e] = b.x - a.x;
+            triangle.c[e] = a.x * b.y - b.x * a.y;
+        }
+        triangle.depth = std::max(c0.w, std::max(c1.w, c2.w));
+        triangle.x0 = std::max(0, static_cast<int>(std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x)))));
+        triangle.y0 = std::max(0, static_cast<int>(std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y)))));
+        triangle.x1 = std::min(width - 1, static_cast<int>(std::floor(std::max(p[0].x, std::max(p[1].x, p[2].x)))));
+        triangle.y1 = std::min(height - 1, static_cast<int>(std::floor(std::max(p[0].y, std::max(p[1].y, p[2].y)))));
+        if (triangle.x0 <= triangle.x1 && triangle.y0 <= triangle.y1)
+            triangles_.push_back(triangle);
+    }
+}
+
+void OcclusionCuller::rasterize() {
+    // bands of whole tiles, one per thread
+    int bands = static_cast<int>(std::min<unsigned int>(resolveThreadCount(threads), tilesY));
+    if (triangles_.size() < 64)
+        bands = 1; // not worth starting threads
+    bool avx2 = useAvx2 && avx2Supported();
+    parallelFor(bands, [&](unsigned int band) {
+        int y0 = static_cast<int>(band * tilesY / bands) * tileSize;
+        int y1 = static_cast<int>((band + 1) * tilesY / bands) * tileSize;
+        if (avx2)
+            rasterizeBandAvx2(y0, y1);
+        else
+            rasterizeBand(y0, y1);
+    });
+}
+
+void OcclusionCuller::rasterizeBand(int y0, int y1) {
+    for (const Triangle& t : triangles_) {
+        int top = std::max(y0, t.y0), bottom = std::min(y1 - 1, t.y1);
+        for (int y = top; y <= bottom; y++) {
+            float py = y + 0.5f;
+            float* row = &depth_[size_t(y) * width];
+            for (int x = t.x0; x <= t.x1; x++) {
+                float px = x + 0.5f;
+                if (t.a[0] * px + t.b[0] * py + t.c[0] >= 0.0f &&
+                    t.a[1] * px + t.b[1] * py + t.c[1] >= 0.0f &&
+                    t.a[2] * px + t.b[2] * py + t.c[2] >= 0.0f)
+                    row[x] = std::min(row[x], t.depth);
+            }
+        }
+    }
+
+    // farthest and nearest depth of every tile in the band
+    for (int ty = y0 / tileSize; ty < y1 / tileSize; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            float farthest = 0.0f, nearest = FLT_MAX;
+            for (int y = ty * tileSize; y < (ty + 1) * tileSize; y++) {
+                for (int x = tx * tileSize; x < (tx + 1) * tileSize; x++) {
+                    farthest = std::max(farthest, depth_[size_t(y) * width + x]);
+                    nearest = std::min(nearest, depth_[size_t(y) * width + x]);
+                }
+            }
+            tileMax_[ty * tilesX + tx] = farthest;
+            tileMin_[ty * tilesX + tx] = nearest;
+        }
+    }
+}
+
+OCCLUSION_AVX2_TARGET
+void OcclusionCuller::rasterizeBandAvx2(int y0, int y1) {
+#ifdef OCCLUSION_AVX2
+    const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 empty = _mm256_set1_ps(FLT_MAX);
+    for (const Triangle& t : triangles_) {
+        int top = std::max(y0, t.y0), bottom = std::min(y1 - 1, t.y1);
+        if (top > bottom)
+            continue;
+        int left = t.x0 & ~7; // rows are 8-pixel aligned groups
+        __m256 a0 = _mm256_set1_ps(t.a[0]), a1 = _mm256_set1_ps(t.a[1]), a2 = _mm256_set1_ps(t.a[2]);
+        __m256 step0 = _mm256_set1_ps(8.0f * t.a[0]);
+        __m256 step1 = _mm256_set1_ps(8.0f * t.a[1]);
+        __m256 step2 = _mm256_set1_ps(8.0f * t.a[2]);
+        __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(left)), lane);
+        __m256 depth = _mm256_set1_ps(t.depth);
+        for (int y = top; y <= bottom; y++) {
+            float py = y + 0.5f;
+            __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), _mm256_set1_ps(t.b[0] * py + t.c[0]));
+            __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), _mm256_set1_ps(t.b[1] * py + t.c[1]));
+            __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), _mm256_set1_ps(t.b[2] * py + t.c[2]));
+            float* row = &depth_[size_t(y) * width];
+            for (int x = left; x <= t.x1; x += 8) {
+                __m256 inside = _mm256_cmp_ps(e0, zero, _CMP_GE_OQ);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(e1, zero, _CMP_GE_OQ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+                if (_mm256_movemask_ps(inside)) {
+                    __m256 old = _mm256_loadu_ps(row + x);
+                    _mm256_storeu_ps(row + x, _mm256_min_ps(old, _mm256_blendv_ps(empty, depth, inside)));
+                }
+                e0 = _mm256_add_ps(e0, step0);
+                e1 = _mm256_add_ps(e1, step1);
+                e2 = _mm256_add_ps(e2, step2);
+            }
+        }
+    }
+
+    // farthest and nearest depth of every tile in the band: a tile row is
+    // one vector
+    for (int ty = y0 / tileSize; ty < y1 / tileSize; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            __m256 farthest = zero, nearest = empty;
+            for (int y = ty * tileSize; y < (ty + 1) * tileSize; y++) {
+                __m256 row = _mm256_loadu_ps(&depth_[size_t(y) * width + tx * tileSize]);
+                farthest = _mm256_max_ps(farthest, row);
+                nearest = _mm256_min_ps(nearest, row);
+            }
+            __m128 m = _mm_max_ps(_mm256_castps256_ps128(farthest), _mm256_extractf128_ps(farthest, 1));
+            m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+            m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+            tileMax_[ty * tilesX + tx] = _mm_cvtss_f32(m);
+            m = _mm_min_ps(_mm256_castps256_ps128(nearest), _mm256_extractf128_ps(nearest, 1));
+            m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+            m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+            tileMin_[ty * tilesX + tx] = _mm_cvtss_f32(m);
+        }
+    }
+#else
+    rasterizeBand(y0, y1);
+#endif
+}
+
+size_t OcclusionCuller::cull(FrustumCuller& culler) {
+    // the objects that passed the frustum test
+    candidates_.resize(culler.size());
+    size_t count = 0;
+    for (size_t i = 0; i < culler.size(); i++) {
+        candidates_[count] = static_cast<uint32_t>(i);
+        count += culler.visible[i];
+    }
+    candidates_.resize(count);
+
+    size_t hidden = 0;
+    if (useAvx2 && avx2Supported()) {
+        // most boxes are decided by the tiles under their corners; the
+        // others are left for a look at the pixels
+        size_t undecided = 0;
+        hidden = cullAvx2(culler, undecided);
+        const ScreenRects& rects = undecided_;
+        for (size_t k = 0; k < undecided; k++) {
+            if (!rectVisible(rects.loX[k], rects.loY[k], rects.hiX[k], rects.hiY[k], rects.nearest[k])) {
+                culler.visible[rects.object[k]] = 0;
+                hidden++;
+            }
+        }
+        return hidden;
+    }
+    for (uint32_t i : candidates_) {
+        if (!boxVisible(culler, i)) {
+            culler.visible[i] = 0;
+            hidden++;
+        }
+    }
+    return hidden;
+}
+
+bool OcclusionCuller::boxVisible(const FrustumCuller& culler, size_t i) const {
+    // clip space corners as sums of the matrix columns scaled by the
+    // minimum or maximum of each coordinate
+    const glm::mat4& m = viewProjection_;
+    glm::vec4 xs[2] = { m[0] * culler.minX[i], m[0] * culler.maxX[i] };
+    glm::vec4 ys[2] = { m[1] * culler.minY[i], m[1] * culler.maxY[i] };
+    glm::vec4 zs[2] = { m[2] * culler.minZ[i] + m[3], m[2] * culler.maxZ[i] + m[3] };
+    float loX = FLT_MAX, loY = FLT_MAX, hiX = -FLT_MAX, hiY = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++) {
+        const glm::vec4& x = xs[corner & 1];
+        const glm::vec4& y = ys[(corner >> 1) & 1];
+        const glm::vec4& z = zs[corner >> 2];
+        float w = x.w + y.w + z.w;
+        if (w < minW)
+            return true; // reaches behind the eye
+        float inverse = 1.0f / w;
+        float sx = ((x.x + y.x + z.x) * inverse * 0.5f + 0.5f) * width;
+        float sy = ((x.y + y.y + z.y) * inverse * 0.5f + 0.5f) * height;
+        loX = std::min(loX, sx);
+        loY = std::min(loY, sy);
+        hiX = std::max(hiX, sx);
+        hiY = std::max(hiY, sy);
+        nearest = std::min(nearest, w);
+    }
+    return rectVisible(loX, loY, hiX, hiY, nearest);
+}
+
+OCCLUSION_AVX2_TARGET
+size_t OcclusionCuller::cullAvx2(FrustumCuller& culler, size_t& undecided) {
+#ifdef OCCLUSION_AVX2
+    // boxVisible() for 8 boxes at a time, gathered from the culler's arrays;
+    // the last group repeats the last box
+    size_t count = candidates_.size();
+    undecided = 0;
+    if (count == 0)
+        return 0;
+    candidates_.resize((count + 7) & ~size_t(7), candidates_.back());
+    // room for every box (only grown, so that it is not cleared each frame)
+    ScreenRects& rects = undecided_;
+    if (rects.object.size() < candidates_.size()) {
+        rects.object.resize(candidates_.size());
+        rects.loX.resize(candidates_.size());
+        rects.loY.resize(candidates_.size());
+        rects.hiX.resize(candidates_.size());
+        rects.hiY.resize(candidates_.size());
+        rects.nearest.resize(candidates_.size());
+    }
+
+    // the columns of the matrix, without the z row
+    __m256 m[4][3];
+    for (int column = 0; column < 4; column++) {
+        m[column][0] = _mm256_set1_ps(viewProjection_[column].x);
+        m[column][1] = _mm256_set1_ps(viewProjection_[column].y);
+        m[column][2] = _mm256_set1_ps(viewProjection_[column].w);
+    }
+    const __m256 lastX = _mm256_set1_ps(width - 1.0f), lastY = _mm256_set1_ps(height - 1.0f);
+    const __m256i row = _mm256_set1_epi32(tilesX), two = _mm256_set1_epi32(2);
+    const int tileShift = 3;
+    static_assert(tileSize == 1 << tileShift, "tiles are found by a shift");
+
+    size_t hidden = 0;
+    for (size_t k = 0; k < count; k += 8) {
+        // the terms of the minimum and maximum of each coordinate (written
+        // out, so that they stay in registers)
+        __m256i objects = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&candidates_[k]));
+        __m256 v = _mm256_i32gather_ps(culler.minX.data(), objects, 4);
+        __m256 x0[3] = { _mm256_mul_ps(m[0][0], v), _mm256_mul_ps(m[0][1], v), _mm256_mul_ps(m[0][2], v) };
+        v = _mm256_i32gather_ps(culler.maxX.data(), objects, 4);
+        __m256 x1[3] = { _mm256_mul_ps(m[0][0], v), _mm256_mul_ps(m[0][1], v), _mm256_mul_ps(m[0][2], v) };
+        v = _mm256_i32gather_ps(culler.minY.data(), objects, 4);
+        __m256 y0[3] = { _mm256_mul_ps(m[1][0], v), _mm256_mul_ps(m[1][1], v), _mm256_mul_ps(m[1][2], v) };
+        v = _mm256_i32gather_ps(culler.maxY.data(), objects, 4);
+        __m256 y1[3] = { _mm256_mul_ps(m[1][0], v), _mm256_mul_ps(m[1][1], v), _mm256_mul_ps(m[1][2], v) };
+        v = _mm256_i32gather_ps(culler.minZ.data(), objects, 4);
+        __m256 z0[3] = { _mm256_add_ps(_mm256_mul_ps(m[2][0], v), m[3][0]), _mm256_add_ps(_mm256_mul_ps(m[2][1], v), m[3][1]),
+                         _mm256_add_ps(_mm256_mul_ps(m[2][2], v), m[3][2]) };
+        v = _mm256_i32gather_ps(culler.maxZ.data(), objects, 4);
+        __m256 z1[3] = { _mm256_add_ps(_mm256_mul_ps(m[2][0], v), m[3][0]), _mm256_add_ps(_mm256_mul_ps(m[2][1], v), m[3][1]),
+                         _mm256_add_ps(_mm256_mul_ps(m[2][2], v), m[3][2]) };
+
+        Rects8 boxes = { _mm256_set1_ps(FLT_MAX), _mm256_set1_ps(FLT_MAX), _mm256_set1_ps(-FLT_MAX),
+                         _mm256_set1_ps(-FLT_MAX), _mm256_set1_ps(FLT_MAX), _mm256_setzero_ps() };
+        addCorner(boxes, x0, y0, z0);
+        addCorner(boxes, x1, y0, z0);
+        addCorner(boxes, x0, y1, z0);
+        addCorner(boxes, x1, y1, z0);
+        addCorner(boxes, x0, y0, z1);
+        addCorner(boxes, x1, y0, z1);
+        addCorner(boxes, x0, y1, z1);
+        addCorner(boxes, x1, y1, z1);
+
+        // The pixel rectangle, and the tiles under its corners: the box is
+        // visible if one of them is farther than the box everywhere, and
+        // hidden if it spans at most 2 x 2 tiles that are all nearer than
+        // the box everywhere
+        __m256 left = _mm256_max_ps(_mm256_floor_ps(boxes.loX), _mm256_setzero_ps());
+        __m256 top = _mm256_max_ps(_mm256_floor_ps(boxes.loY), _mm256_setzero_ps());
+        __m256 right = _mm256_min_ps(_mm256_floor_ps(boxes.hiX), lastX);
+        __m256 bottom = _mm256_min_ps(_mm256_floor_ps(boxes.hiY), lastY);
+        __m256 offScreen = _mm256_or_ps(_mm256_cmp_ps(left, right, _CMP_GT_OQ), _mm256_cmp_ps(top, bottom, _CMP_GT_OQ));
+        __m256i tx0 = _mm256_srli_epi32(_mm256_cvttps_epi32(_mm256_min_ps(left, lastX)), tileShift);
+        __m256i ty0 = _mm256_srli_epi32(_mm256_cvttps_epi32(_mm256_min_ps(top, lastY)), tileShift);
+        __m256i tx1 = _mm256_srli_epi32(_mm256_cvttps_epi32(_mm256_max_ps(right, _mm256_setzero_ps())), tileShift);
+        __m256i ty1 = _mm256_srli_epi32(_mm256_cvttps_epi32(_mm256_max_ps(bottom, _mm256_setzero_ps())), tileShift);
+        __m256i row0 = _mm256_mullo_epi32(ty0, row), row1 = _mm256_mullo_epi32(ty1, row);
+        __m256i tile00 = _mm256_add_epi32(row0, tx0), tile01 = _mm256_add_epi32(row0, tx1);
+        __m256i tile10 = _mm256_add_epi32(row1, tx0), tile11 = _mm256_add_epi32(row1, tx1);
+        __m256 farthest = _mm256_max_ps(_mm256_max_ps(_mm256_i32gather_ps(tileMax_.data(), tile00, 4),
+                                                      _mm256_i32gather_ps(tileMax_.data(), tile01, 4)),
+                                        _mm256_max_ps(_mm256_i32gather_ps(tileMax_.data(), tile10, 4),
+                                                      _mm256_i32gather_ps(tileMax_.data(), tile11, 4)));
+        __m256 farthestNearest = _mm256_max_ps(_mm256_max_ps(_mm256_i32gather_ps(tileMin_.data(), tile00, 4),
+                                                             _mm256_i32gather_ps(tileMin_.data(), tile01, 4)),
+                                               _mm256_max_ps(_mm256_i32gather_ps(tileMin_.data(), tile10, 4),
+                                                             _mm256_i32gather_ps(tileMin_.data(), tile11, 4)));
+        __m256i small = _mm256_and_si256(_mm256_cmpgt_epi32(two, _mm256_sub_epi32(tx1, tx0)),
+                                         _mm256_cmpgt_epi32(two, _mm256_sub_epi32(ty1, ty0)));
+        __m256 decided = _mm256_or_ps(_mm256_or_ps(boxes.behind, offScreen),
+                                      _mm256_cmp_ps(farthestNearest, boxes.nearest, _CMP_GE_OQ));
+        __m256 hiddenLanes = _mm256_and_ps(_mm256_castsi256_ps(small), _mm256_cmp_ps(farthest, boxes.nearest, _CMP_LT_OQ));
+        hiddenLanes = _mm256_andnot_ps(decided, hiddenLanes);
+        int hiddenMask = _mm256_movemask_ps(hiddenLanes);
+        int decidedMask = _mm256_movemask_ps(_mm256_or_ps(decided, hiddenLanes));
+
+        // the repeats of the last box count as decided and visible
+        int valid = count - k >= 8 ? 0xff : (1 << (count - k)) - 1;
+        hiddenMask &= valid;
+        int undecidedMask = ~decidedMask & valid;
+        for (int lane = 0; lane < 8; lane++)
+            culler.visible[candidates_[k + lane]] &= static_cast<uint8_t>(~(hiddenMask >> lane) & 1);
+        hidden += lanePack.count[hiddenMask];
+        // the undecided lanes, packed to the front and appended (writing
+        // all 8 lanes, without a branch per box)
+        __m256i pack = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanePack.lanes[undecidedMask]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&rects.object[undecided]), _mm256_permutevar8x32_epi32(objects, pack));
+        _mm256_storeu_ps(&rects.loX[undecided], _mm256_permutevar8x32_ps(boxes.loX, pack));
+        _mm256_storeu_ps(&rects.loY[undecided], _mm256_permutevar8x32_ps(boxes.loY, pack));
+        _mm256_storeu_ps(&rects.hiX[undecided], _mm256_permutevar8x32_ps(boxes.hiX, pack));
+        _mm256_storeu_ps(&rects.hiY[undecided], _mm256_permutevar8x32_ps(boxes.hiY, pack));
+        _mm256_storeu_ps(&rects.nearest[undecided], _mm256_permutevar8x32_ps(boxes.nearest, pack));
+        undecided += lanePack.count[undecidedMask];
+    }
+    return hidden;
+#else
+    undecided = 0;
+    return 0;
+#endif
+}
+
+bool OcclusionCuller::rectVisible(float loX, float loY, float hiX, float hiY, float nearest) const {
+    int x0 = std::max(0, static_cast<int>(std::floor(loX)));
+    int y0 = std::max(0, static_cast<int>(std::floor(loY)));
+    int x1 = std::min(width - 1, static_cast<int>(std::floor(hiX)));
+    int y1 = std::min(height - 1, static_cast<int>(std::floor(hiY)));
+    if (x0 > x1 || y0 > y1)
+        return true; // off screen: left to the frustum test
+
+    for (int ty = y0 / tileSize; ty <= y1 / tileSize; ty++) {
+        for (int tx = x0 / tileSize; tx <= x1 / tileSize; tx++) {
+            if (tileMax_[ty * tilesX + tx] < nearest)
+                continue; // the whole tile is nearer than the box
+            if (tileMin_[ty * tilesX + tx] >= nearest)
+                return true; // the whole tile is farther
+            int top = std::max(y0, ty * tileSize), bottom = std::min(y1, ty * tileSize + tileSize - 1);
+            int left = std::max(x0, tx * tileSize), right = std::min(x1, tx * tileSize + tileSize - 1);
+            for (int y = top; y <= bottom; y++)
+                for (int x = left; x <= right; x++)
+                    if (depth_[size_t(y) * width + x] >= nearest)
+                        return true;
+        }
+    }
+    return false;
+}
+
+int OcclusionCuller::benchmark() {
+    // unit box, counterclockwise from outside
+    const glm::vec3 box[8] = { { -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f },
+                               { -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f } };
+    const uint32_t faces[36] = { 0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+                                 2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5 };
+
+    // a row of walls in front of a field of small objects
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f) * view;
+    std::vector<glm::mat4> walls;
+    for (int i = -3; i <= 3; i++)
+        walls.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(i * 2.2f, 0.0f, 0.0f)), glm::vec3(2.0f, 6.0f, 0.5f)));
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> spread(-12.0f, 12.0f), distance(-40.0f, -1.0f);
+    std::vector<glm::mat4> objects;
+    for (int i = 0; i < 100000; i++)
+        objects.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(spread(random), 0.5f * spread(random), distance(random))));
+    // their world boxes, as the frustum culler keeps them, all in the frustum
+    FrustumCuller boxes;
+    boxes.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); i++)
+        boxes.setBounds(i, objects[i], glm::vec3(-0.25f), glm::vec3(0.25f));
+
+    std::cout << "Occlusion benchmark: " << walls.size() << " occluders, " << objects.size() << " objects, "
+              << width << "x" << height << " depth buffer" << std::endl;
+    const int frames = 20;
+    for (int mode = 0; mode < 2; mode++) {
+        OcclusionCuller culler;
+        culler.useAvx2 = (mode == 1);
+        if (culler.useAvx2 && !avx2Supported()) {
+            std::cout << "  AVX2: not supported by this CPU" << std::endl;
+            continue;
+        }
+        double rasterMs = 0.0, testMs = 0.0;
+        size_t occluded = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            std::fill(boxes.visible.begin(), boxes.visible.end(), 1);
+            auto start = std::chrono::steady_clock::now();
+            culler.begin(viewProjection);
+            for (const glm::mat4& wall : walls)
+                culler.addOccluder(box, faces, 36, wall);
+            culler.rasterize();
+            auto rasterized = std::chrono::steady_clock::now();
+            occluded = culler.cull(boxes);
+            auto tested = std::chrono::steady_clock::now();
+            rasterMs += std::chrono::duration<double, std::milli>(rasterized - start).count();
+            testMs += std::chrono::duration<double, std::milli>(tested - rasterized).count();
+        }
+        std::cout << "  " << (mode ? "AVX2  " : "scalar") << ": " << occluded << " occluded, raster "
+                  << rasterMs / frames << " ms, tests " << testMs / frames << " ms ("
+                  << testMs / frames * 1e6 / objects.size() << " ns per object) per frame" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "OcclusionQueries.h"
+
+bool OcclusionQueries::conservative() {
+#ifdef __APPLE__
+    return false;
+#else
+    return GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+#endif
+}
+
+void OcclusionQueries::beginFrame(size_t objectCount) {
+    frame_++;
+    issued_ = 0;
+    read_ = 0;
+
+    // results of objects that no longer exist, or moved to other
+    // indices, are dropped once they arrive
+    if (objectCount < slots_.size()) {
+        for (Slot& slot : slots_) {
+            if (slot.query)
+                free_.push_back(slot.query); // reading a reused query waits for the new result only
+        }
+        slots_.clear();
+    }
+    size_t first = slots_.size();
+    slots_.resize(objectCount);
+    for (size_t i = first; i < objectCount; i++)
+        reset(i);
+
+    // Read whatever has arrived; a result that is not available yet is
+    // left for a later frame
+    hidden_ = 0;
+    for (Slot& slot : slots_) {
+        if (slot.query) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(slot.query, GL_QUERY_RESULT, &samples);
+                free_.push_back(slot.query);
+                slot.query = 0;
+                slot.visible = (samples != 0);
+                if (slot.visible)
+                    slot.nextQuery = frame_ + static_cast<uint32_t>(std::max(interval, 1));
+                read_++;
+            }
+        }
+        if (!slot.visible)
+            hidden_++;
+    }
+}
+
+OcclusionQueries::Action OcclusionQueries::action(size_t i) const {
+    const Slot& slot = slots_[i];
+    if (slot.visible)
+        return (!slot.query && static_cast<int32_t>(frame_ - slot.nextQuery) >= 0) ? DRAW_QUERIED : DRAW;
+    return slot.query ? DRAW_CONDITIONAL : TEST_BOX;
+}
+
+void OcclusionQueries::reset(size_t i) {
+    Slot& slot = slots_[i];
+    slot.visible = true;
+    // spread the first queries of many new objects over the interval
+    slot.nextQuery = frame_ + static_cast<uint32_t>(i % static_cast<size_t>(std::max(interval, 1)));
+}
+
+void OcclusionQueries::beginQuery(size_t i) {
+    if (free_.empty()) {
+        // grow the pool by half, at least 64 queries
+        size_t count = std::max<size_t>(64, queries_.size() / 2);
+        size_t first = queries_.size();
+        queries_.resize(first + count);
+        glGenQueries(static_cast<GLsizei>(count), queries_.data() + first);
+        free_.insert(free_.end(), queries_.begin() + first, queries_.end());
+    }
+    Slot& slot = slots_[i];
+    if (slot.query)
+        free_.push_back(slot.query);
+    slot.query = free_.back();
+    free_.pop_back();
+#ifdef __APPLE__
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, slot.query);
+#else
+    glBeginQuery(conservative() ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED, slot.query);
+#endif
+    issued_++;
+}
+
+void OcclusionQueries::endQuery() {
+#ifdef __APPLE__
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+#else
+    glEndQuery(conservative() ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED);
+#endif
+}
+
+void OcclusionQueries::beginConditional(size_t i) const {
+    glBeginConditionalRender(slots_[i].query, GL_QUERY_BY_REGION_NO_WAIT);
+}
+
+void OcclusionQueries::endConditional() const {
+    glEndConditionalRender();
+}
+
+void OcclusionQueries::release() {
+    if (!queries_.empty())
+        glDeleteQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+    queries_.clear();
+    free_.clear();
+    slots_.clear();
+}
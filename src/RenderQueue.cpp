@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include "RenderQueue.h"
+
+uint64_t RenderQueue::makeKey(RenderPass pass, uint32_t shader, uint32_t mesh, float depth) {
+    const uint64_t depthMax = (1u << 24) - 1;
+    float clamped = std::min(std::max(depth, 0.0f), 1.0f); // also maps NaN to 0
+    uint64_t quantized = static_cast<uint64_t>(std::lround(clamped * depthMax));
+    uint64_t key = uint64_t(pass & 0x3) << 62;
+    if (pass == PASS_OPAQUE)
+        key |= uint64_t(shader & 0x3F) << 56 | uint64_t(mesh & 0xFFFF) << 40 | quantized << 16;
+    else
+        key |= (depthMax - quantized) << 38 | uint64_t(shader & 0x3F) << 32 | uint64_t(mesh & 0xFFFF) << 16;
+    return key;
+}
+
+void RenderQueue::clear() {
+    keys_.clear();
+    items_.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t item) {
+    keys_.push_back(key);
+    items_.push_back(item);
+}
+
+void RenderQueue::sort() {
+    size_t n = keys_.size();
+    if (n < 2)
+        return;
+    keyScratch_.resize(n);
+    itemScratch_.resize(n);
+
+    // all eight digit histograms in one pass
+    size_t counts[8][256] = {};
+    for (uint64_t key : keys_)
+        for (int digit = 0; digit < 8; digit++)
+            counts[digit][(key >> (digit * 8)) & 0xFF]++;
+
+    for (int digit = 0; digit < 8; digit++) {
+        size_t* count = counts[digit];
+        int shift = digit * 8;
+        if (count[(keys_[0] >> shift) & 0xFF] == n)
+            continue; // every key has the same digit
+
+        // scatter, in order, to the start of each bucket
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++) {
+            size_t c = count[bucket];
+            count[bucket] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t target = count[(keys_[i] >> shift) & 0xFF]++;
+            keyScratch_[target] = keys_[i];
+            itemScratch_[target] = items_[i];
+        }
+        keys_.swap(keyScratch_);
+        items_.swap(itemScratch_);
+    }
+}
+
+int RenderQueue::benchmark() {
+    const size_t count = 100000;
+    const int runs = 20;
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<uint32_t> order(count);
+    double radixMilliseconds = 0.0, stableMilliseconds = 0.0;
+    int mismatchedRuns = 0;
+
+    std::cout << "Render queue sort: " << count << " keys, " << runs << " runs" << std::endl;
+    for (int run = 0; run < runs; run++) {
+        // a few programs and meshes, as in a frame, and random depths
+        RenderQueue queue;
+        for (size_t i = 0; i < count; i++) {
+            RenderPass pass = unit(random) < 0.2f ? PASS_TRANSLUCENT : PASS_OPAQUE;
+            queue.push(makeKey(pass, 1 + random() % 4, 1 + random() % 64, unit(random)), static_cast<uint32_t>(i));
+        }
+        std::vector<uint64_t> keys = queue.keys_;
+
+        auto start = std::chrono::steady_clock::now();
+        queue.sort();
+        auto middle = std::chrono::steady_clock::now();
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+        auto end = std::chrono::steady_clock::now();
+        radixMilliseconds += std::chrono::duration<double, std::milli>(middle - start).count();
+        stableMilliseconds += std::chrono::duration<double, std::milli>(end - middle).count();
+
+        bool same = true;
+        for (size_t i = 0; i < count && same; i++)
+            same = (queue.item(i) == order[i] && queue.key(i) == keys[order[i]]);
+        mismatchedRuns += !same;
+    }
+    std::cout << "  radix sort:       " << radixMilliseconds / runs << " ms" << std::endl;
+    std::cout << "  std::stable_sort: " << stableMilliseconds / runs << " ms" << std::endl;
+    std::cout << "  " << mismatchedRuns << " of " << runs << " runs differ" << std::endl;
+    return mismatchedRuns == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "FrustumCuller.h"
+#include "Obj.h"
+#include "SceneStore.h"
+
+SceneHandle SceneStore::add(std::shared_ptr<Obj> mesh, const Transform& transform, uint8_t objectFlags) {
+    uint32_t slot;
+    if (freeSlots_.empty()) {
+        slot = static_cast<uint32_t>(indices_.size());
+        indices_.push_back(0);
+        generations_.push_back(1);
+    }
+    else {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+    indices_[slot] = static_cast<uint32_t>(size());
+    slots_.push_back(slot);
+
+    if (!mesh->hasBounds)
+        objectFlags |= BOUNDS_PENDING;
+    transforms.push_back(transform);
+    boundsMin.push_back(mesh->boundsMin);
+    boundsMax.push_back(mesh->boundsMax);
+    meshes.push_back(std::move(mesh));
+    lods.push_back(0);
+    flags.push_back(objectFlags);
+    worlds.resize(size());
+    worldVersions_.push_back(0);
+    return { slot, generations_[slot] };
+}
+
+bool SceneStore::remove(SceneHandle handle) {
+    size_t index = indexOf(handle);
+    if (index == npos)
+        return false;
+
+    // move the last object into the gap
+    size_t last = size() - 1;
+    if (index != last) {
+        transforms[index] = transforms[last];
+        boundsMin[index] = boundsMin[last];
+        boundsMax[index] = boundsMax[last];
+        meshes[index] = std::move(meshes[last]);
+        lods[index] = lods[last];
+        flags[index] = flags[last];
+        for (int c = 0; c < 12; c++)
+            worlds[c][index] = worlds[c][last];
+        worldVersions_[index] = worldVersions_[last];
+        slots_[index] = slots_[last];
+        indices_[slots_[index]] = static_cast<uint32_t>(index);
+    }
+    transforms.pop_back();
+    boundsMin.pop_back();
+    boundsMax.pop_back();
+    meshes.pop_back();
+    lods.pop_back();
+    flags.pop_back();
+    worlds.resize(size());
+    worldVersions_.pop_back();
+    slots_.pop_back();
+
+    // old handles of this slot stop working
+    generations_[handle.slot]++;
+    if (generations_[handle.slot] == 0)
+        generations_[handle.slot] = 1;
+    freeSlots_.push_back(handle.slot);
+    return true;
+}
+
+void SceneStore::clear() {
+    for (size_t i = size(); i-- > 0;)
+        remove(handle(i));
+}
+
+size_t SceneStore::updateWorlds() {
+    size_t updated = 0;
+    for (size_t i = 0; i < size(); i++) {
+        uint64_t version = transforms[i].version();
+        if (worldVersions_[i] != version) {
+            BatchMath::store(worlds, i, transforms[i].world());
+            worldVersions_[i] = version;
+            updated++;
+        }
+    }
+    return updated;
+}
+
+size_t SceneStore::indexOf(SceneHandle handle) const {
+    if (handle.slot >= indices_.size() || generations_[handle.slot] != handle.generation)
+        return npos;
+    return indices_[handle.slot];
+}
+
+SceneHandle SceneStore::handle(size_t index) const {
+    uint32_t slot = slots_[index];
+    return { slot, generations_[slot] };
+}
+
+namespace {
+
+// What a scene object used to be: a heap object with its own matrix,
+// bounds and buffer names, reached through a pointer
+struct HeapObject {
+    std::vector<GLuint> buffers = std::vector<GLuint>(3);
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::vec3 boundsMin = glm::vec3(-0.5f), boundsMax = glm::vec3(0.5f);
+    virtual ~HeapObject() {}
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int SceneStore::benchmark() {
+    const size_t count = 100000;
+    const int frames = 20;
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> spread(-100.0f, 100.0f);
+    glm::quat turn = glm::angleAxis(0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 turnMatrix = glm::mat4_cast(turn);
+
+    // Heap objects, allocated between other allocations (as a scene
+    // built up while loading would be) and visited in insertion order
+    std::vector<std::unique_ptr<HeapObject>> heapObjects;
+    std::vector<std::unique_ptr<char[]>> otherAllocations;
+    for (size_t i = 0; i < count; i++) {
+        otherAllocations.emplace_back(new char[64 + random() % 512]);
+        heapObjects.emplace_back(new HeapObject);
+        heapObjects.back()->model = glm::translate(glm::mat4(1.0f), glm::vec3(spread(random), spread(random), spread(random)));
+    }
+    std::shuffle(heapObjects.begin(), heapObjects.end(), random);
+
+    // The same objects in a store, below a root
+    std::shared_ptr<Obj> mesh = std::make_shared<Obj>();
+    mesh->ready = true;
+    mesh->hasBounds = true;
+    Transform root;
+    SceneStore scene;
+    for (size_t i = 0; i < count; i++) {
+        Transform transform(glm::vec3(spread(random), spread(random), spread(random)));
+        transform.setParent(&root);
+        scene.add(mesh, transform);
+    }
+
+    FrustumCuller culler;
+    culler.resize(count);
+    std::cout << "Scene benchmark: " << count << " objects, " << frames << " frames" << std::endl;
+
+    // A frame in which everything moves: new world matrices and bounds
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (size_t i = 0; i < count; i++) {
+            HeapObject& object = *heapObjects[i];
+            object.model = turnMatrix * object.model;
+            culler.setBounds(i, object.model, object.boundsMin, object.boundsMax);
+        }
+    }
+    std::cout << "  heap objects, all moving:  " << millisecondsSince(start) / frames << " ms per frame" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        root.rotate(turn);
+        for (size_t i = 0; i < scene.size(); i++) {
+            const Transform& transform = scene.transforms[i];
+            culler.updateBounds(i, transform.version(), transform.world(), scene.boundsMin[i], scene.boundsMax[i]);
+        }
+    }
+    std::cout << "  scene store, all moving:   " << millisecondsSince(start) / frames << " ms per frame" << std::endl;
+
+    // A frame in which nothing moves: only the version checks
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (size_t i = 0; i < scene.size(); i++) {
+            const Transform& transform = scene.transforms[i];
+            culler.updateBounds(i, transform.version(), transform.world(), scene.boundsMin[i], scene.boundsMax[i]);
+        }
+    }
+    std::cout << "  scene store, none moving:  " << millisecondsSince(start) / frames << " ms per frame" << std::endl;
+
+    // Removing random objects by handle, and adding them back
+    std::vector<SceneHandle> handles;
+    for (size_t i = 0; i < count; i += 10)
+        handles.push_back(scene.handle(i));
+    std::shuffle(handles.begin(), handles.end(), random);
+    start = std::chrono::steady_clock::now();
+    for (SceneHandle handle : handles)
+        scene.remove(handle);
+    double removeMs = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < handles.size(); i++)
+        scene.add(mesh, Transform());
+    double addMs = millisecondsSince(start);
+    std::cout << "  " << handles.size() << " removals: " << removeMs << " ms, " << handles.size() << " additions: "
+              << addMs << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+#include "StreamedObj.h"
+
+namespace {
+
+bool seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// Reads a text file in blocks of whole lines through a fixed-size buffer
+class LineReader {
+public:
+    explicit LineReader(size_t bufferSize) : buffer_(bufferSize) {}
+    ~LineReader() {
+        if (file_)
+            fclose(file_);
+    }
+
+    bool open(const char* filename) {
+        file_ = fopen(filename, "rb");
+        return file_ != NULL;
+    }
+
+    // Returns the next block of complete lines, or false at the end of the file
+    bool next(const char*& begin, const char*& end) {
+        // Move the partial line left over from the last block to the front
+        size_t kept = filled_ - consumed_;
+        memmove(buffer_.data(), buffer_.data() + consumed_, kept);
+        filled_ = kept;
+        consumed_ = 0;
+
+        for (;;) {
+            if (!eof_) {
+                if (filled_ == buffer_.size())
+                    buffer_.resize(buffer_.size() * 2); // a line longer than the buffer
+                size_t wanted = buffer_.size() - filled_;
+                size_t n = fread(buffer_.data() + filled_, 1, wanted, file_);
+                filled_ += n;
+                eof_ = (n < wanted);
+            }
+            size_t last = filled_;
+            while (last > 0 && buffer_[last - 1] != '\n')
+                last--;
+            if (last > 0 || eof_) {
+                consumed_ = (last > 0) ? last : filled_;
+                break;
+            }
+        }
+        begin = buffer_.data();
+        end = begin + consumed_;
+        return consumed_ > 0;
+    }
+
+private:
+    FILE* file_ = NULL;
+    std::vector<char> buffer_;
+    size_t filled_ = 0;   // valid bytes in the buffer
+    size_t consumed_ = 0; // bytes handed out by the last next()
+    bool eof_ = false;
+};
+
+// Array of T kept in a temporary file. It is written sequentially through
+// a bounded buffer, then read back through a direct-mapped page cache.
+template <typename T>
+class SpillArray {
+public:
+    ~SpillArray() {
+        if (file_)
+            fclose(file_);
+        std::error_code error;
+        if (!path_.empty())
+            std::filesystem::remove(path_, error);
+    }
+
+    bool create(const std::string& path, size_t bufferBytes) {
+        path_ = path;
+        file_ = fopen(path.c_str(), "w+b");
+        buffer_.reserve(std::max<size_t>(pageSize, bufferBytes / sizeof(T)));
+        return file_ != NULL;
+    }
+
+    void push(const T& value) {
+        buffer_.push_back(value);
+        size_++;
+        if (buffer_.size() == buffer_.capacity())
+            flush();
+    }
+
+    // Ends writing; reads then go through at most cacheBytes of pages
+    bool finish(size_t cacheBytes) {
+        flush();
+        std::vector<T>().swap(buffer_);
+        size_t slots = std::max<size_t>(1, cacheBytes / (pageSize * sizeof(T)));
+        pages_.resize(slots * pageSize);
+        tags_.assign(slots, SIZE_MAX);
+        return !failed_ && fflush(file_) == 0;
+    }
+
+    const T& operator[](size_t i) {
+        size_t page = i / pageSize;
+        size_t slot = page % tags_.size();
+        T* data = &pages_[slot * pageSize];
+        if (tags_[slot] != page) {
+            size_t n = std::min(pageSize, size_ - page * pageSize);
+            read(page * pageSize, n, data);
+            tags_[slot] = page;
+        }
+        return data[i % pageSize];
+    }
+
+    // Sequential read, bypassing the cache
+    bool read(size_t first, size_t n, T* out) {
+        if (!seekFile(file_, static_cast<uint64_t>(first) * sizeof(T)) || fread(out, sizeof(T), n, file_) != n)
+            failed_ = true;
+        return !failed_;
+    }
+
+    size_t size() const { return size_; }
+    bool failed() const { return failed_; }
+
+private:
+    static constexpr size_t pageSize = 4096; // elements per cache page
+
+    void flush() {
+        if (!buffer_.empty() && fwrite(buffer_.data(), sizeof(T), buffer_.size(), file_) != buffer_.size())
+            failed_ = true;
+        buffer_.clear();
+    }
+
+    std::string path_;
+    FILE* file_ = NULL;
+    std::vector<T> buffer_;   // pending writes
+    std::vector<T> pages_;    // cached pages, slot after slot
+    std::vector<size_t> tags_; // page held by each slot
+    size_t size_ = 0;
+    bool failed_ = false;
+};
+
+std::string temporaryBase() {
+    static int counter = 0;
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    return (directory / ("modelviewer-" + std::to_string(stamp) + "-" + std::to_string(counter++))).string();
+}
+
+bool failLoad(const char* message, const char* filename) {
+    std::cerr << message << ": " << filename << std::endl;
+    return false;
+}
+
+}
+
+size_t StreamedObj::peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);        // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+StreamedChunks::~StreamedChunks() {
+    if (writer)
+        fclose(writer);
+    if (reader)
+        fclose(reader); // before the removal, which fails on open files on Windows
+    std::error_code error;
+    if (!path.empty())
+        std::filesystem::remove(path, error);
+}
+
+bool StreamedObj::load(const char * filename, const ObjLoadOptions& options, ObjLoadResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    const size_t limit = std::max<size_t>(options.memoryLimitMB, 64) << 20;
+    std::cout << "Streaming " << filename << " (memory limit " << (limit >> 20) << " MB)..." << std::endl;
+
+    // How the limit is shared between the stages
+    const size_t lineBufferSize = std::min<size_t>(limit / 16, 64 << 20);
+    const size_t bytesPerCorner = sizeof(MeshCorner) + 64; // piece + welding tables + output
+    const size_t maxChunkCorners = std::max<size_t>(3, limit / 4 / bytesPerCorner / 3 * 3);
+
+    // The temporary files are removed on every return: the spill files with
+    // the arrays below, the processed chunks with result.chunks
+    std::string base = temporaryBase();
+    result.chunks = std::make_shared<StreamedChunks>();
+    auto fail = [&](const char* message) {
+        result.chunks.reset();
+        return failLoad(message, filename);
+    };
+    StreamedChunks& chunks = *result.chunks;
+    chunks.path = base + ".chunks";
+    chunks.writer = fopen(chunks.path.c_str(), "wb");
+    SpillArray<glm::vec3> positions, normals;
+    if (!chunks.writer || !positions.create(base + ".v", limit / 32) || !normals.create(base + ".vn", limit / 32))
+        return fail("Cannot create temporary files for");
+
+    // 1. counting pass: spill the vertex data, find the bounds
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    size_t corners = 0;
+    {
+        LineReader reader(lineBufferSize);
+        if (!reader.open(filename))
+            return fail("Cannot open file");
+        ObjLine line;
+        ObjCounts defined;
+        const char *begin, *end;
+        while (reader.next(begin, end)) {
+            for (const char* p = begin; p < end; ) {
+                p = ObjParser::parseLine(p, end, defined, line);
+                if (!p)
+                    return fail("Malformed obj file");
+                if (line.type == ObjLine::POSITION) {
+                    positions.push(line.value);
+                    lo = glm::min(lo, line.value);
+                    hi = glm::max(hi, line.value);
+                    defined.positions++;
+                }
+                else if (line.type == ObjLine::NORMAL) {
+                    normals.push(line.value);
+                    defined.normals++;
+                }
+                else if (line.type == ObjLine::FACE) {
+                    corners += line.corners;
+                }
+            }
+        }
+    }
+    if (!positions.finish(limit / 4) || !normals.finish(limit / 4))
+        return fail("Cannot write temporary files for");
+    if (positions.size() == 0)
+        lo = hi = glm::vec3(0.0f);
+
+    // 2. filling pass: sort the triangles into grid cells by their centroid.
+    // The grid is sized so that a cell roughly fills one draw chunk.
+    size_t wanted = (corners + maxChunkCorners - 1) / maxChunkCorners;
+    int grid = std::max(1, std::min(6, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(wanted))))));
+    size_t numBuckets = static_cast<size_t>(grid) * grid * grid;
+    std::vector<std::unique_ptr<SpillArray<MeshCorner>>> buckets(numBuckets);
+    for (size_t i = 0; i < numBuckets; i++) {
+        buckets[i] = std::make_unique<SpillArray<MeshCorner>>();
+        if (!buckets[i]->create(base + ".chunk" + std::to_string(i), limit / 8 / numBuckets))
+            return fail("Cannot create temporary files for");
+    }
+    {
+        LineReader reader(lineBufferSize);
+        if (!reader.open(filename))
+            return fail("Cannot open file");
+        glm::vec3 cellScale = static_cast<float>(grid) / glm::max(hi - lo, glm::vec3(1e-20f));
+        ObjLine line;
+        ObjCounts defined;
+        const char *begin, *end;
+        while (reader.next(begin, end)) {
+            for (const char* p = begin; p < end; ) {
+                p = ObjParser::parseLine(p, end, defined, line);
+                if (!p)
+                    return fail("Malformed obj file");
+                if (line.type == ObjLine::POSITION)
+                    defined.positions++;
+                else if (line.type == ObjLine::NORMAL)
+                    defined.normals++;
+                if (line.type != ObjLine::FACE)
+                    continue;
+
+                for (size_t t = 0; t < line.corners; t += 3) {
+                    MeshCorner triangle[3];
+                    for (int k = 0; k < 3; k++) {
+                        uint32_t v = line.positionIndices[t + k];
+                        uint32_t n = line.normalIndices[t + k];
+                        if (v >= positions.size() || n >= normals.size())
+                            return fail("Malformed obj file");
+                        triangle[k] = { v, n, positions[v], normals[n] };
+                    }
+                    glm::vec3 centroid = (triangle[0].p + triangle[1].p + triangle[2].p) / 3.0f;
+                    glm::ivec3 cell = glm::clamp(glm::ivec3((centroid - lo) * cellScale), glm::ivec3(0), glm::ivec3(grid - 1));
+                    SpillArray<MeshCorner>& bucket = *buckets[(cell.z * grid + cell.y) * grid + cell.x];
+                    for (int k = 0; k < 3; k++)
+                        bucket.push(triangle[k]);
+                }
+            }
+        }
+    }
+    if (positions.failed() || normals.failed())
+        return fail("Cannot read temporary files for");
+
+    // 3. weld every cell, in pieces of at most maxChunkCorners, and append
+    // the pieces to the chunk file: the streams, then the indices
+    std::vector<MeshCorner> piece;
+    MeshData mesh;
+    uint64_t offset = 0;
+    for (auto& bucket : buckets) {
+        if (!bucket->finish(0))
+            return fail("Cannot write temporary files for");
+        for (size_t first = 0; first < bucket->size(); first += maxChunkCorners) {
+            size_t n = std::min(maxChunkCorners, bucket->size() - first);
+            piece.resize(n);
+            if (!bucket->read(first, n, piece.data()))
+                return fail("Cannot read temporary files for");
+            mesh.weld(piece.data(), n);
+            if (options.optimize)
+                MeshOptimizer::optimize(mesh);
+            mesh.finalize();
+            if (options.quantize)
+                mesh.quantize(lo, hi); // one decoding for all the chunks
+
+            MeshView view = mesh.view();
+            for (unsigned int i = 0; i <= view.streamCount; i++) {
+                bool isIndices = (i == view.streamCount);
+                size_t size = isIndices ? view.indexBytes() : view.streamBytes(i);
+                if (size > 0 && fwrite(isIndices ? view.indices : view.streams[i], 1, size, chunks.writer) != size)
+                    return fail("Cannot write temporary files for");
+            }
+            chunks.offsets.push_back(offset);
+            offset += view.vertexBytes() + view.indexBytes();
+            view.meshlets = nullptr;
+            view.meshletCount = 0;
+            chunks.views.push_back(view);
+        }
+        bucket.reset(); // deletes the cell's file
+    }
+
+    // the upload reads the chunks back as it goes
+    bool written = (fclose(chunks.writer) == 0);
+    chunks.writer = NULL;
+    if (!written || !(chunks.reader = fopen(chunks.path.c_str(), "rb")))
+        return fail("Cannot read temporary files for");
+    chunks.boundsMin = lo;
+    chunks.boundsMax = hi;
+    if (options.quantize) {
+        chunks.positionScale = hi - lo;
+        chunks.positionBias = lo;
+    }
+    chunks.corners = corners;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Streamed " << corners / 3 << " triangles into " << chunks.views.size() << " chunks in "
+              << seconds << " s (peak RSS " << (peakResidentBytes() >> 20) << " MB)." << std::endl;
+    return true;
+}
+
+void StreamedObj::init(const char * filename) {
+    ObjLoadResult result;
+    if (!load(filename, options, result))
+        return; // stays not ready, and is drawn as a placeholder
+    size_t unlimited = SIZE_MAX;
+    beginUpload(result);
+    continueUpload(result, unlimited);
+}
+
+void StreamedObj::beginUpload(const ObjLoadResult& result) {
+    for (auto& chunk : chunks_)
+        chunk->release();
+    chunks_.clear();
+    ready = false;
+    const StreamedChunks& chunks = *result.chunks;
+    boundsMin = chunks.boundsMin;
+    boundsMax = chunks.boundsMax;
+    hasBounds = true;
+    positionScale = chunks.positionScale;
+    positionBias = chunks.positionBias;
+    count = static_cast<int>(std::min<size_t>(chunks.corners, INT_MAX));
+    chunkBytes_ = chunkRead_ = 0;
+}
+
+bool StreamedObj::continueUpload(const ObjLoadResult& result, size_t& budget) {
+    // One chunk after the other, each one as a mesh of its own. A chunk is
+    // read into buffer_ only as far as the budget lets it be uploaded: the
+    // upload copies the streams and then the indices, in the order of the
+    // file, so only one chunk is ever in memory.
+    const StreamedChunks& chunks = *result.chunks;
+    for (;;) {
+        if (chunks_.empty() || chunks_.back()->ready) {
+            size_t c = chunks_.size();
+            if (c == chunks.views.size())
+                break;
+            chunkView_ = chunks.views[c];
+            chunkBytes_ = chunkView_.vertexBytes() + chunkView_.indexBytes();
+            chunkRead_ = 0;
+            buffer_.resize(chunkBytes_);
+            const char* data = buffer_.data();
+            for (unsigned int i = 0; i < chunkView_.streamCount; i++) {
+                chunkView_.streams[i] = data;
+                data += chunkView_.streamBytes(i);
+            }
+            chunkView_.indices = data;
+            if (!seekFile(chunks.reader, chunks.offsets[c]))
+                return failUpload(chunks);
+            chunks_.push_back(std::make_unique<Obj>());
+            chunks_.back()->beginUpload(chunkView_);
+        }
+        size_t n = std::min(chunkBytes_ - chunkRead_, budget);
+        if (n > 0 && fread(buffer_.data() + chunkRead_, 1, n, chunks.reader) != n)
+            return failUpload(chunks);
+        chunkRead_ += n;
+        if (!chunks_.back()->continueUpload(chunkView_, budget))
+            return false;
+    }
+    std::vector<char>().swap(buffer_);
+    ready = true;
+    std::cout << "Uploaded " << chunks_.size() << " chunks (peak RSS " << (peakResidentBytes() >> 20) << " MB)."
+              << std::endl;
+    return true;
+}
+
+bool StreamedObj::failUpload(const StreamedChunks& chunks) {
+    std::cerr << "Cannot read temporary file " << chunks.path << "; the mesh is not shown." << std::endl;
+    std::vector<char>().swap(buffer_);
+    failed = true;
+    return true; // nothing more to upload
+}
+
+void StreamedObj::draw(void) {
+    for (auto& chunk : chunks_)
+        chunk->draw();
+}
+
+void StreamedObj::release(void) {
+    for (auto& chunk : chunks_)
+        chunk->release();
+    chunks_.clear();
+    Obj::release();
+}
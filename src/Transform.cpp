@@ -0,0 +1,86 @@
+#include "Transform.h"
+
+namespace {
+
+uint64_t lastVersion = 0;
+
+}
+
+void Transform::setPosition(const glm::vec3& position) {
+    position_ = position;
+    dirty_ = true;
+}
+
+void Transform::setRotation(const glm::quat& rotation) {
+    rotation_ = glm::normalize(rotation);
+    dirty_ = true;
+}
+
+void Transform::setScale(const glm::vec3& scale) {
+    scale_ = scale;
+    dirty_ = true;
+}
+
+void Transform::setParent(const Transform* parent) {
+    parent_ = parent;
+    dirty_ = true;
+}
+
+void Transform::translate(const glm::vec3& offset) {
+    position_ += rotation_ * (scale_ * offset);
+    dirty_ = true;
+}
+
+void Transform::rotate(const glm::quat& rotation) {
+    // renormalized, so that many small rotations keep it a rotation
+    rotation_ = glm::normalize(rotation_ * rotation);
+    dirty_ = true;
+}
+
+const glm::mat4& Transform::world() const {
+    update();
+    return world_;
+}
+
+const glm::mat3& Transform::normalMatrix() const {
+    update();
+    return normal_;
+}
+
+uint64_t Transform::version() const {
+    update();
+    return version_;
+}
+
+void Transform::update() const {
+    if (parent_) {
+        uint64_t parentVersion = parent_->version(); // brings the ancestors up to date
+        if (parentVersion != parentVersion_) {
+            parentVersion_ = parentVersion;
+            dirty_ = true;
+        }
+    }
+    if (!dirty_)
+        return;
+
+    // local = T * R * S, and its normal matrix R * S^-1
+    glm::mat3 rotation = glm::mat3_cast(rotation_);
+    glm::mat4 local(1.0f);
+    glm::mat3 localNormal;
+    for (int column = 0; column < 3; column++) {
+        local[column] = glm::vec4(rotation[column] * scale_[column], 0.0f);
+        localNormal[column] = rotation[column] / scale_[column];
+    }
+    local[3] = glm::vec4(position_, 1.0f);
+
+    if (parent_) {
+        world_ = parent_->world_ * local;
+        normal_ = parent_->normal_ * localNormal;
+    }
+    else {
+        world_ = local;
+        normal_ = localNormal;
+    }
+    version_ = ++lastVersion;
+    dirty_ = false;
+}
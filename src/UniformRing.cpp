@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "GLState.h"
+#include "UniformRing.h"
+
+void UniformRing::init(size_t bytesPerFrame) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment_ = std::max<size_t>(alignment, 16);
+    createBuffer(bytesPerFrame);
+}
+
+void UniformRing::createBuffer(size_t bytesPerFrame) {
+    // the fences of the old buffer do not protect the new one
+    for (GLsync& fence : fences_) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (buffer_) {
+        if (mapped_) {
+            GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        // deleting it would also unbind the ranges bound earlier this frame
+        retired_.push_back({ buffer_, 0 });
+    }
+
+    regionSize_ = (bytesPerFrame + alignment_ - 1) / alignment_ * alignment_;
+    size_t size = regionSize_ * frameCount;
+    mapped_ = nullptr;
+    glGenBuffers(1, &buffer_);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+#ifndef __APPLE__
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+        mapped_ = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    }
+#endif
+    if (!mapped_)
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    head_ = 0;
+}
+
+void UniformRing::beginFrame() {
+    region_ = (region_ + 1) % frameCount;
+    head_ = 0;
+    uploads_ = 0;
+
+    // wait until the GPU has read this region three frames ago
+    auto start = std::chrono::steady_clock::now();
+    if (GLsync fence = fences_[region_]) {
+        GLbitfield flags = 0;
+        while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        glDeleteSync(fence);
+        fences_[region_] = 0;
+    }
+    deleteRetired(false);
+    waitMilliseconds_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void UniformRing::upload(GLuint binding, const void* data, size_t size) {
+    if (head_ + size > regionSize_)
+        createBuffer(std::max(regionSize_ * 2, size * 2));
+
+    size_t offset = region_ * regionSize_ + head_;
+    if (mapped_) {
+        memcpy(mapped_ + offset, data, size);
+    }
+    else {
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    }
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_, offset, size);
+    head_ += (size + alignment_ - 1) / alignment_ * alignment_;
+    uploads_++;
+}
+
+void UniformRing::endFrame() {
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    for (RetiredBuffer& retired : retired_) {
+        if (!retired.fence)
+            retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void UniformRing::deleteRetired(bool wait) {
+    size_t kept = 0;
+    for (RetiredBuffer& retired : retired_) {
+        bool done = wait;
+        if (!done && retired.fence) {
+            GLenum status = glClientWaitSync(retired.fence, 0, 0);
+            done = (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED);
+        }
+        if (!done) {
+            retired_[kept++] = retired;
+            continue;
+        }
+        if (retired.fence)
+            glDeleteSync(retired.fence);
+        GLState::deleteBuffers(1, &retired.buffer);
+    }
+    retired_.resize(kept);
+}
+
+void UniformRing::release() {
+    deleteRetired(true); // glDeleteBuffers waits for the GPU itself
+    for (GLsync& fence : fences_) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (buffer_) {
+        if (mapped_) {
+            GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        GLState::deleteBuffers(1, &buffer_);
+    }
+    buffer_ = 0;
+    mapped_ = nullptr;
+    regionSize_ = 0;
+}
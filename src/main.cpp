@@ -1,5 +1,11 @@
-﻿#include <cstdlib>
+﻿#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <random>
 #include <GL/glew.h>
 #include <gtc/quaternion.hpp>
 #include <GL/freeglut.h>
@@ -12,7 +18,22 @@
 #include "Shader.h"
 #include "Cube.h"
 #include "Obj.h"
+#include "AssetManager.h"
+#include "BatchMath.h"
 #include "Camera.h"
+#include "FrustumCuller.h"
+#include "GBuffer.h"
+#include "GeometryPool.h"
+#include "GLState.h"
+#include "GpuTimer.h"
+#include "InstanceRenderer.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "RenderQueue.h"
+#include "SceneStore.h"
+#include "Transform.h"
+#include "UniformRing.h"
 #include "imgui.h"
 #include "imgui_impl_glut.h"
 #include "imgui_impl_opengl3.h"
@@ -22,6 +43,7 @@ static const int width = 800;
 static const int height = 600;
 static const char* title = "Model Viewer";
 static const glm::vec4 background(0.1f, 0.2f, 0.3f, 1.0f);
+static const float farPlane = 1000.0f;
 
 // Scene Objects
 static Cube cube;
@@ -33,41 +55,192 @@ static bool bWireframe = false;
 static bool objectLoaded = false;
 
 // Models in the scene
-Geometry* models[] = { &teapot, &bunny, &sphere };
+Obj* models[] = { &teapot, &bunny, &sphere };
 const char* modelNames[] = { "Teapot", "Bunny", "Sphere" }; // Names for UI
 int selectedModelIndex = -1; // No model selected by default
-std::vector<std::unique_ptr<Obj>> loadedModels;
+static SceneStore scene; // the models above, then the added ones
+static SceneHandle staticModels[std::size(models)];
+static SceneHandle selectedObject; // highlighted
+static AssetManager assets; // meshes shared by the loaded models
+static int loadPriority = 0; // the newest request is loaded first
+static float uploadBudgetMB = 8.0f; // GPU upload budget per frame
+static size_t loadsFailed = 0; // failures whose instances were removed
+static int viewportWidth = width;
+static int viewportHeight = height;
+static float lodBias = 0.0f; // allowed LOD error is 2^lodBias pixels
+static size_t trianglesDrawn = 0; // by the models, in the last frame
+static bool meshletCulling = true;
+static size_t trianglesCulled = 0; // by meshlet culling, in the last frame
+static FrustumCuller culler; // world bounds of the scene objects
+static size_t modelsVisible = 0;
+static double cullMilliseconds = 0.0;
+static AffineArrays visibleModelviews; // of the visible objects, batched
+static std::vector<uint32_t> visibleObjects;          // scene index of each entry
+static double modelviewMilliseconds = 0.0;
+// Occlusion culling on the CPU, with a depth buffer of the nearest
+// models, or on the GPU, with occlusion queries
+enum OcclusionMode { OCCLUSION_OFF, OCCLUSION_CPU, OCCLUSION_GPU, OCCLUSION_MODE_COUNT };
+static const char* occlusionModeNames[] = { "Off", "CPU rasterizer", "GPU queries" };
+static int occlusionMode = OCCLUSION_CPU;
+static OcclusionCuller occlusion;
+static OcclusionQueries queries; // per object of culler
+static int maxOccluders = 16;
+static size_t modelsOccluded = 0;
+static double occlusionMilliseconds = 0.0;
+static std::vector<std::pair<float, size_t>> occluderCandidates; // (depth, loaded model)
+static InstanceRenderer instances; // loaded models drawn with instancing
+static GeometryPool pool; // copies of the loaded meshes for indirect draws
+static UniformRing uniforms; // per-frame and per-draw uniform blocks
+static size_t glCallsIssued = 0;  // state calls that reached GL in the last frame
+static size_t glCallsSkipped = 0; // and the ones GLState found redundant
+
+// One entry of the render queue
+struct DrawItem {
+    enum Kind { STATIC_MODEL, PLACEHOLDER, LOADED_MODEL, INSTANCE_GROUP, INDIRECT } kind;
+    uint32_t index; // into scene or instances.groups()
+    OcclusionQueries::Action query; // for models, with GPU occlusion queries
+};
+static std::vector<DrawItem> drawItems; // the items of renderQueue
+static RenderQueue renderQueue;
+static double sortMilliseconds = 0.0;
+
+// Forward shading lights each fragment as it is drawn; deferred shading
+// draws the opaque models into the G-buffer and lights each pixel once
+enum ShadingPath { SHADING_FORWARD, SHADING_DEFERRED, SHADING_PATH_COUNT };
+static const char* shadingPathNames[] = { "Forward", "Deferred" };
+static int shadingPath = SHADING_FORWARD;
+static GBuffer gbuffer;
+static const GLuint gbufferUnit = 4; // first of its 3 textures, after the lights'
+static GLuint fullScreenVao = 0;     // no attributes: deferred.vert uses gl_VertexID
+// Opaque samples that pass the depth test, for the bandwidth estimates
+// (not with GPU occlusion queries, which use the same counters)
+static GpuTimer opaqueSamples(GL_SAMPLES_PASSED);
+static double frameMegabytes[SHADING_PATH_COUNT] = {}; // estimated framebuffer traffic
+
+// Depth pre-pass before the color pass, and the GPU time of both
+static bool depthPrePass = false;
+static GpuTimer prePassTimer, colorPassTimer;
+static double gpuMilliseconds[SHADING_PATH_COUNT][2] = {}; // without and with the pre-pass
+
+// Point lights, relative to the scene root, shaded with clustered
+// forward lighting
+static bool clusteredLighting = true;
+static int lightCount = 256;
+static std::vector<PointLight> lights;
+static LightClusters lightClusters;
+static const GLuint lightUnit = 1; // first of its 3 buffer textures (ImGui uses unit 0)
+// Light sweep: GPU time for each of these light counts, printed to the
+// console
+static const int sweepLightCounts[] = { 0, 64, 256, 1024, 4096 };
+static int sweepStep = -1; // into sweepLightCounts, -1 when not sweeping
+static int sweepFrame = 0, sweepSamples = 0, sweepSavedCount = 0;
+static double sweepGpuMilliseconds = 0.0, sweepBinMilliseconds = 0.0;
+
+// How the loaded models are submitted
+enum SubmitPath { SUBMIT_DIRECT, SUBMIT_INSTANCED, SUBMIT_INDIRECT, SUBMIT_PATH_COUNT };
+static const char* submitPathNames[] = { "One draw per model", "Instanced", "Multi-draw indirect" };
+static int submitPath = SUBMIT_INSTANCED;
+static size_t drawCalls[SUBMIT_PATH_COUNT] = {};         // last frame drawn with each path
+static double submitMilliseconds[SUBMIT_PATH_COUNT] = {}; // CPU time of those draw calls
 
 float lastMouseX = 0.0f, lastMouseY = 0.0f;
 float rotationSpeed = 0.5f;
 bool isRotating = false;
-glm::mat4 rotationMatrix = glm::mat4(1.0f);
+Transform sceneRoot; // parent of every model; carries the mouse rotation
 
 struct NormalShader : Shader
 {
-    glm::mat4 modelview = glm::mat4(1.0f);
-    GLuint modelview_loc;
+    // std140 layouts of the uniform blocks in projective.vert
+    struct FrameData {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 clusterScale;
+        glm::uvec4 clusterSize;
+    };
+    struct ObjectData {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+        glm::vec4 positionScale;
+        glm::vec4 positionBias;
+        glm::vec4 highlightColor;
+        glm::vec4 baseColor;
+        GLint isHighlighted;
+        GLint padding[3];
+    };
+    static const GLuint frameBinding = 0;
+    static const GLuint objectBinding = 1;
+
+    glm::mat4 view = glm::mat4(1.0f);
     glm::mat4 projection = glm::mat4(1.0f);
-    GLuint projection_loc;
-    GLuint isHighlighted_loc;
-    GLuint highlightColor_loc; // New uniform for highlight color
+    glm::vec4 clusterScale = glm::vec4(0.0f);  // LightClusters tiles and slices
+    glm::uvec4 clusterSize = glm::uvec4(0u);
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f); // inverse transpose of model
+    glm::vec3 positionScale = glm::vec3(1.0f); // decoding of quantized positions
+    glm::vec3 positionBias = glm::vec3(0.0f);
 
     void initUniforms() {
-        modelview_loc = glGetUniformLocation(program, "modelview");
-        projection_loc = glGetUniformLocation(program, "projection");
-        isHighlighted_loc = glGetUniformLocation(program, "isHighlighted");
-        highlightColor_loc = glGetUniformLocation(program, "highlightColor"); // Initialize highlight color uniform
+        GLuint frameIndex = glGetUniformBlockIndex(program, "FrameData");
+        if (frameIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, frameIndex, frameBinding);
+        GLuint objectIndex = glGetUniformBlockIndex(program, "ObjectData");
+        if (objectIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, objectIndex, objectBinding);
+
+        // the buffer textures of LightClusters (-1 in programs without them)
+        GLState::useProgram(program);
+        glUniform1i(glGetUniformLocation(program, "clusterGrid"), lightUnit);
+        glUniform1i(glGetUniformLocation(program, "clusterLights"), lightUnit + 1);
+        glUniform1i(glGetUniformLocation(program, "lightData"), lightUnit + 2);
+        // and those of the G-buffer
+        glUniform1i(glGetUniformLocation(program, "gbufferNormal"), gbufferUnit);
+        glUniform1i(glGetUniformLocation(program, "gbufferAlbedo"), gbufferUnit + 1);
+        glUniform1i(glGetUniformLocation(program, "gbufferDepth"), gbufferUnit + 2);
+    }
+
+    // Model and normal matrix of the transform about to be drawn
+    void setTransform(const Transform& transform) {
+        model = transform.world();
+        normalMatrix = transform.normalMatrix();
+    }
+    void setTransform(const glm::mat4& matrix) { // rotation, translation and uniform scale only
+        model = matrix;
+        normalMatrix = glm::mat3(matrix);
+    }
+
+    // Position decoding of the geometry about to be drawn
+    void setGeometry(const Geometry& geometry) {
+        positionScale = geometry.positionScale;
+        positionBias = geometry.positionBias;
     }
 
-    void setUniforms(bool isHighlighted = false, glm::vec3 highlightColor = glm::vec3(1.0f, 0.0f, 0.0f)) {
-        glUniformMatrix4fv(modelview_loc, 1, GL_FALSE, &modelview[0][0]);
-        glUniformMatrix4fv(projection_loc, 1, GL_FALSE, &projection[0][0]);
-        glUniform1i(isHighlighted_loc, static_cast<GLint>(isHighlighted));
-        glUniform3fv(highlightColor_loc, 1, &highlightColor[0]); // Set highlight color
+    // View and projection, once per frame
+    void setFrame() {
+        FrameData frame = { view, projection, clusterScale, clusterSize };
+        uniforms.upload(frameBinding, &frame, sizeof(frame));
+    }
+
+    // Model matrix, decoding and colors of one draw: one copy into the
+    // uniform ring and one glBindBufferRange. Colors with alpha below one
+    // belong in the translucent pass.
+    void setUniforms(bool isHighlighted = false, glm::vec4 highlightColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+                     glm::vec4 baseColor = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f)) {
+        ObjectData object = {};
+        object.model = model;
+        object.normalMatrix = glm::mat4(normalMatrix);
+        object.positionScale = glm::vec4(positionScale, 0.0f);
+        object.positionBias = glm::vec4(positionBias, 0.0f);
+        object.highlightColor = highlightColor;
+        object.baseColor = baseColor;
+        object.isHighlighted = static_cast<GLint>(isHighlighted);
+        uniforms.upload(objectBinding, &object, sizeof(object));
     }
 };
 
 static NormalShader shader;
+static NormalShader depthShader; // positions only, for the depth pre-pass
+static NormalShader gbufferShader; // the opaque draws of the deferred path
+static NormalShader deferredShader; // its full screen lighting pass
 // Initialize Models
 void initializeModels() {
     try {
@@ -95,6 +268,50 @@ glm::vec3 generateRandomPosition(float rangeMin, float rangeMax) {
     return glm::vec3(x, y, z);
 }
 
+// lightCount point lights around the built-in models; the same seed every
+// time, so a smaller count keeps a prefix of the same lights
+void placeLights() {
+    std::mt19937 random(167);
+    std::uniform_real_distribution<float> across(-10.0f, 10.0f), height(-3.0f, 5.0f), radius(1.5f, 4.0f), unit(0.0f, 1.0f);
+    lights.resize(static_cast<size_t>(lightCount));
+    for (PointLight& light : lights) {
+        glm::vec3 color(unit(random), unit(random), unit(random));
+        light = { glm::vec3(across(random), height(random), across(random)), radius(random),
+                  0.8f * color / std::max(color.r, std::max(color.g, color.b)) };
+    }
+}
+
+// One frame of the light sweep: after a few frames to settle, averages the
+// GPU time of 60 frames per light count, then moves on to the next count
+static void stepLightSweep() {
+    const int settleFrames = 10, measuredFrames = 60;
+    if (sweepStep < 0)
+        return;
+    if (++sweepFrame > settleFrames && colorPassTimer.hasResult()) {
+        sweepGpuMilliseconds += prePassTimer.milliseconds() + colorPassTimer.milliseconds();
+        sweepBinMilliseconds += lightClusters.binMilliseconds();
+        sweepSamples++;
+    }
+    if (sweepFrame < settleFrames + measuredFrames)
+        return;
+
+    if (sweepSamples > 0)
+        std::cout << "  " << lightCount << " lights: GPU " << sweepGpuMilliseconds / sweepSamples << " ms, binning "
+                  << sweepBinMilliseconds / sweepSamples << " ms, " << lightClusters.indices().size() << " indices"
+                  << std::endl;
+    if (++sweepStep == static_cast<int>(std::size(sweepLightCounts))) {
+        sweepStep = -1;
+        lightCount = sweepSavedCount;
+    }
+    else
+        lightCount = sweepLightCounts[sweepStep];
+    placeLights();
+    sweepFrame = sweepSamples = 0;
+    sweepGpuMilliseconds = sweepBinMilliseconds = 0.0;
+    prePassTimer.discard();
+    colorPassTimer.discard();
+}
+
 void initialize() {
     glClearColor(background[0], background[1], background[2], background[3]);
     glViewport(0, 0, width, height);
@@ -109,10 +326,35 @@ void initialize() {
 
     shader.read_source("shaders/projective.vert", "shaders/normal.frag");
     shader.compile();
-    glUseProgram(shader.program);
+    GLState::useProgram(shader.program);
     shader.initUniforms();
-
-    glEnable(GL_DEPTH_TEST);
+    depthShader.read_source("shaders/depth.vert", "shaders/depth.frag");
+    depthShader.compile();
+    depthShader.initUniforms();
+    gbufferShader.read_source("shaders/projective.vert", "shaders/gbuffer.frag");
+    gbufferShader.compile();
+    gbufferShader.initUniforms();
+    deferredShader.read_source("shaders/deferred.vert", "shaders/deferred.frag");
+    deferredShader.compile();
+    deferredShader.initUniforms();
+    glGenVertexArrays(1, &fullScreenVao);
+    GLState::useProgram(shader.program);
+    placeLights();
+    uniforms.init(256 * 1024); // grows when a frame needs more
+    InstanceRenderer::setDefaults();
+
+    GLState::enable(GL_DEPTH_TEST);
+
+    // The cube is the placeholder of models that are still loading
+    cube.init();
+
+    // Models are placed relative to the scene root, which the mouse turns;
+    // the built-in ones belong to this file, not to the scene
+    for (size_t i = 0; i < std::size(models); i++) {
+        Transform transform;
+        transform.setParent(&sceneRoot);
+        staticModels[i] = scene.add(std::shared_ptr<Obj>(models[i], [](Obj*) {}), transform, SceneStore::STATIC);
+    }
 
     // Initialize ImGui
     IMGUI_CHECKVERSION();
@@ -134,10 +376,12 @@ void initialize() {
 void reshape(int w, int h) {
     // Update the OpenGL viewport to match the new window size
     glViewport(0, 0, w, h);
+    viewportWidth = w;
+    viewportHeight = h;
 
     // Update the camera projection matrix to maintain the aspect ratio
     float aspect = static_cast<float>(w) / static_cast<float>(h);
-    camera.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+    camera.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, farPlane);
 
     // Update ImGui display size
     ImGui::GetIO().DisplaySize = ImVec2(w, h); // Update ImGui size
@@ -149,6 +393,71 @@ glm::vec3 cameraTarget(0.0f, 0.0f, 0.0f); // Camera target
 glm::vec3 cameraUp(0.0f, 1.0f, 0.0f); // Up direction
 glm::mat4 viewMatrix = glm::lookAt(cameraPosition, cameraTarget, cameraUp);
 
+// Adds an instance of the selected model at a random place in front of the camera
+void addModel(bool verbose = true) {
+    // Share the mesh of the selected model with earlier instances;
+    // new meshes load in the background, ahead of older requests
+    std::shared_ptr<Obj> mesh;
+    if (selectedModelIndex == 0) {
+        mesh = assets.acquireAsync("models/teapot.obj", ++loadPriority);
+    }
+    else if (selectedModelIndex == 1) {
+        mesh = assets.acquireAsync("models/bunny.obj", ++loadPriority);
+    }
+    else if (selectedModelIndex == 2) {
+        mesh = assets.acquireAsync("models/sphere.obj", ++loadPriority);
+    }
+
+    // Define the distance from the camera
+    float distanceFromCamera = 10.0f;
+
+    // Calculate the model's base position in front of the camera
+    glm::vec3 cameraForward = glm::normalize(cameraTarget - cameraPosition); // Forward direction
+    glm::vec3 basePosition = cameraPosition + cameraForward * distanceFromCamera;
+
+    // Add random offsets within the visible frustum
+    float frustumWidth = distanceFromCamera * tan(glm::radians(45.0f)); // Adjust based on your field of view
+    float frustumHeight = frustumWidth / (16.0f / 9.0f); // Adjust based on your aspect ratio
+
+    float randomOffsetX = (std::rand() % 200 - 100) / 100.0f * frustumWidth;
+    float randomOffsetY = (std::rand() % 200 - 100) / 100.0f * frustumHeight;
+    float randomOffsetZ = (std::rand() % 200) / 100.0f; // Random value between 0 and 2.0f
+
+    glm::vec3 randomOffset(randomOffsetX, randomOffsetY, randomOffsetZ);
+
+    // Set the model's position to the base position plus the random offset
+    glm::vec3 modelPosition = basePosition + randomOffset;
+
+    // Add the new model below the scene root, and select it
+    Transform transform(modelPosition);
+    transform.setParent(&sceneRoot);
+    if (mesh)
+        selectedObject = scene.add(std::move(mesh), transform);
+    if (verbose)
+        std::cout << "New model added at position: " << modelPosition.x << ", " << modelPosition.y << ", " << modelPosition.z << std::endl;
+}
+
+// Removes the objects i for which predicate(i) is true. The background
+// loads of meshes that no object uses any more are cancelled, so their
+// parsed data is freed now rather than when the load finishes.
+template <class Predicate>
+static void removeObjects(Predicate predicate) {
+    std::vector<std::shared_ptr<Obj>> loading;
+    scene.removeIf([&](size_t i) {
+        if (!predicate(i))
+            return false;
+        if (!scene.meshes[i]->ready)
+            loading.push_back(scene.meshes[i]);
+        return true;
+    });
+    std::sort(loading.begin(), loading.end());
+    loading.erase(std::unique(loading.begin(), loading.end()), loading.end());
+    for (const std::shared_ptr<Obj>& mesh : loading) {
+        if (mesh.use_count() == 1)
+            assets.loader.cancel(mesh.get());
+    }
+}
+
 void renderUI() {
     // Start a new frame for ImGui
     ImGui_ImplOpenGL3_NewFrame();
@@ -164,11 +473,13 @@ void renderUI() {
     // Combo box to select a model
     if (ImGui::Combo("Models", &selectedModelIndex, modelNames, IM_ARRAYSIZE(modelNames))) {
         std::cout << "Selected Model: " << modelNames[selectedModelIndex] << std::endl;
+        selectedObject = staticModels[selectedModelIndex];
     }
 
     // Button to deselect model
     if (ImGui::Button("Deselect")) {
         selectedModelIndex = -1;
+        selectedObject = SceneHandle();
         std::cout << "Model deselected." << std::endl;
     }
 
@@ -192,8 +503,8 @@ void renderUI() {
             float deltaY = mousePos.y - lastMouseY;
 
             // Apply rotation speed to delta movement
-            rotationMatrix = glm::rotate(rotationMatrix, glm::radians(-deltaX * rotationSpeed), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
-            rotationMatrix = glm::rotate(rotationMatrix, glm::radians(-deltaY * rotationSpeed), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around X-axis
+            sceneRoot.rotate(glm::angleAxis(glm::radians(-deltaX * rotationSpeed), glm::vec3(0.0f, 1.0f, 0.0f))); // Rotate around Y-axis
+            sceneRoot.rotate(glm::angleAxis(glm::radians(-deltaY * rotationSpeed), glm::vec3(1.0f, 0.0f, 0.0f))); // Rotate around X-axis
 
             // Update the last mouse position
             lastMouseX = mousePos.x;
@@ -208,48 +519,114 @@ void renderUI() {
     // Button to add a new model
     if (ImGui::Button("Add model")) {
         std::cout << "Add model button pressed." << std::endl;
+        addModel();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Add 1000")) {
+        // Stress test for instancing: many copies of the selected mesh
+        for (int i = 0; i < 1000; i++)
+            addModel(false);
+    }
 
-        // Create a new model based on the selected model index
-        std::unique_ptr<Obj> newModel = std::make_unique<Obj>();
-
-        // Initialize the new model based on selected index
-        if (selectedModelIndex == 0) {
-            newModel->init("models/teapot.obj");
-        }
-        else if (selectedModelIndex == 1) {
-            newModel->init("models/bunny.obj");
-        }
-        else if (selectedModelIndex == 2) {
-            newModel->init("models/sphere.obj");
-        }
-
-        // Define the distance from the camera
-        float distanceFromCamera = 10.0f;
-
-        // Calculate the model's base position in front of the camera
-        glm::vec3 cameraForward = glm::normalize(cameraTarget - cameraPosition); // Forward direction
-        glm::vec3 basePosition = cameraPosition + cameraForward * distanceFromCamera;
-
-        // Add random offsets within the visible frustum
-        float frustumWidth = distanceFromCamera * tan(glm::radians(45.0f)); // Adjust based on your field of view
-        float frustumHeight = frustumWidth / (16.0f / 9.0f); // Adjust based on your aspect ratio
-
-        float randomOffsetX = (std::rand() % 200 - 100) / 100.0f * frustumWidth;
-        float randomOffsetY = (std::rand() % 200 - 100) / 100.0f * frustumHeight;
-        float randomOffsetZ = (std::rand() % 200) / 100.0f; // Random value between 0 and 2.0f
-
-        glm::vec3 randomOffset(randomOffsetX, randomOffsetY, randomOffsetZ);
-
-        // Set the model's position to the base position plus the random offset
-        glm::vec3 modelPosition = basePosition + randomOffset;
-
-        // Set the model's transformation matrix
-        newModel->model = glm::translate(glm::mat4(1.0f), modelPosition);
-
-        // Add the new model to the list of loaded models
-        loadedModels.push_back(std::move(newModel));
-        selectedModelIndex = loadedModels.size() - 1; // Select the newly added model
-        std::cout << "New model added at position: " << modelPosition.x << ", " << modelPosition.y << ", " << modelPosition.z << std::endl;
+    // Button to remove all added models; unused meshes are freed with them
+    if (ImGui::Button("Clear models")) {
+        removeObjects([](size_t i) { return !(scene.flags[i] & SceneStore::STATIC); });
+        selectedModelIndex = -1;
+    }
+    ImGui::SameLine();
+    size_t selected = scene.indexOf(selectedObject);
+    if (ImGui::Button("Remove selected") && selected != SceneStore::npos && !(scene.flags[selected] & SceneStore::STATIC))
+        removeObjects([selected](size_t i) { return i == selected; }); // the handle stops working, and no other object is selected by accident
+    ImGui::Text("Instances: %d, meshes: %d", static_cast<int>(scene.size() - std::size(models)), static_cast<int>(assets.meshCount()));
+    if (selected != SceneStore::npos)
+        ImGui::Text("Selected: object %d (slot %d)", static_cast<int>(selected), static_cast<int>(selectedObject.slot));
+
+    // Background loading
+    ImGui::SliderFloat("Upload MB/frame", &uploadBudgetMB, 1.0f, 256.0f, "%.0f");
+    ImGui::Text("Pending loads: %d, failed: %d", static_cast<int>(assets.loader.pendingCount()),
+                static_cast<int>(assets.loader.failedCount()));
+    int memoryLimitMB = static_cast<int>(assets.options.memoryLimitMB);
+    if (ImGui::InputInt("Streaming limit (MB)", &memoryLimitMB, 64, 512))
+        assets.options.memoryLimitMB = static_cast<size_t>(std::max(64, memoryLimitMB));
+    ImGui::Checkbox("Compact vertices", &assets.options.quantize); // applies to meshes loaded from now on
+
+    // Levels of detail
+    ImGui::SliderFloat("LOD bias", &lodBias, -2.0f, 4.0f, "%.1f");
+    ImGui::Text("Triangles drawn: %d", static_cast<int>(trianglesDrawn));
+    ImGui::Text("Frustum: %d of %d visible (%.3f ms)", static_cast<int>(modelsVisible),
+                static_cast<int>(culler.size()), cullMilliseconds);
+    ImGui::Text("View * model: %d objects (%.3f ms)", static_cast<int>(visibleObjects.size()), modelviewMilliseconds);
+    if (!GeometryPool::supported() && submitPath == SUBMIT_INDIRECT)
+        submitPath = SUBMIT_INSTANCED; // needs OpenGL 4.3
+    ImGui::Combo("Submission", &submitPath, submitPathNames, GeometryPool::supported() ? SUBMIT_PATH_COUNT : SUBMIT_INDIRECT);
+    for (int path = 0; path < SUBMIT_PATH_COUNT; path++)
+        ImGui::Text("%s: %d draws, %.3f ms (%.3f ms per 1k)", submitPathNames[path], static_cast<int>(drawCalls[path]),
+                    submitMilliseconds[path], drawCalls[path] ? submitMilliseconds[path] * 1000.0 / drawCalls[path] : 0.0);
+    ImGui::Text("Render queue: %d draws, sorted in %.3f ms", static_cast<int>(renderQueue.size()), sortMilliseconds);
+    bool shadingChanged = ImGui::Combo("Shading", &shadingPath, shadingPathNames, SHADING_PATH_COUNT);
+    if (ImGui::Checkbox("Depth pre-pass", &depthPrePass) || shadingChanged) {
+        // the results in flight belong to the other mode
+        prePassTimer.discard();
+        colorPassTimer.discard();
+        opaqueSamples.discard();
+    }
+    ImGui::Text("GPU: pre-pass %.3f ms, color pass %.3f ms", prePassTimer.milliseconds(), colorPassTimer.milliseconds());
+    for (int path = 0; path < SHADING_PATH_COUNT; path++) {
+        double milliseconds = gpuMilliseconds[path][depthPrePass];
+        ImGui::Text("%s: GPU without pre-pass %.3f ms, with %.3f ms", shadingPathNames[path], gpuMilliseconds[path][0],
+                    gpuMilliseconds[path][1]);
+        ImGui::Text("  ~%.1f MB per frame, %.1f GB/s", frameMegabytes[path],
+                    milliseconds > 0.0 ? frameMegabytes[path] / milliseconds : 0.0);
+    }
+    if (occlusionMode == OCCLUSION_GPU)
+        ImGui::Text("(bandwidth estimates need GPU occlusion queries off)");
+
+    // Point lights
+    ImGui::Checkbox("Clustered lights", &clusteredLighting);
+    if (ImGui::SliderInt("Point lights", &lightCount, 0, 4096) && sweepStep < 0)
+        placeLights();
+    ImGui::Text("Lights binned in %.3f ms, %d indices in %d clusters", lightClusters.binMilliseconds(),
+                static_cast<int>(lightClusters.indices().size()), static_cast<int>(LightClusters::clusterCount));
+    if (ImGui::Button("Light sweep") && sweepStep < 0) {
+        // see stepLightSweep
+        std::cout << "Light sweep (" << shadingPathNames[shadingPath] << ", " << (depthPrePass ? "with" : "without")
+                  << " depth pre-pass):" << std::endl;
+        sweepSavedCount = lightCount;
+        sweepStep = 0;
+        sweepFrame = sweepSamples = 0;
+        sweepGpuMilliseconds = sweepBinMilliseconds = 0.0;
+        lightCount = sweepLightCounts[0];
+        placeLights();
+        prePassTimer.discard();
+        colorPassTimer.discard();
+    }
+    ImGui::Text("GL state calls: %d issued, %d skipped", static_cast<int>(glCallsIssued), static_cast<int>(glCallsSkipped));
+    ImGui::Text("Uniform ring (%s): %d blocks, %.0f of %.0f KB, wait %.3f ms",
+                uniforms.persistent() ? "mapped" : "copied", static_cast<int>(uniforms.uploads()),
+                uniforms.bytesUsed() / 1024.0, uniforms.bytesPerFrame() / 1024.0, uniforms.waitMilliseconds());
+    ImGui::Text("Instance groups: %d, pooled meshes: %d (%.1f MB)", static_cast<int>(instances.groups().size()),
+                static_cast<int>(pool.meshCount()), pool.capacityBytes() / (1024.0 * 1024.0));
+    ImGui::Combo("Occlusion culling", &occlusionMode, occlusionModeNames, OCCLUSION_MODE_COUNT);
+    if (occlusionMode == OCCLUSION_CPU) {
+        ImGui::SliderInt("Occluders", &maxOccluders, 1, 64);
+        if (OcclusionCuller::avx2Supported())
+            ImGui::Checkbox("AVX2 rasterizer", &occlusion.useAvx2);
+        ImGui::Text("Occluded: %d (%.3f ms, %d occluder triangles)", static_cast<int>(modelsOccluded),
+                    occlusionMilliseconds, static_cast<int>(occlusion.triangleCount()));
+    }
+    else if (occlusionMode == OCCLUSION_GPU) {
+        ImGui::SliderInt("Query interval", &queries.interval, 1, 30);
+        ImGui::Text("Hidden: %d, queries: %d issued, %d read (pool %d%s)", static_cast<int>(queries.objectsHidden()),
+                    static_cast<int>(queries.queriesIssued()), static_cast<int>(queries.resultsRead()),
+                    static_cast<int>(queries.poolSize()), OcclusionQueries::conservative() ? ", conservative" : "");
+    }
+    ImGui::Checkbox("Meshlet culling", &meshletCulling);
+    ImGui::Text("Triangles culled: %d", static_cast<int>(trianglesCulled));
+    if (ImGui::Button("Cancel loads")) {
+        // Drop the requests and the instances that were waiting for them
+        assets.loader.cancelAll();
+        scene.removeIf([](size_t i) { return !(scene.flags[i] & SceneStore::STATIC) && !scene.meshes[i]->ready; });
+        selectedModelIndex = -1;
     }
 
     ImGui::End();
@@ -257,59 +634,414 @@ void renderUI() {
     // Render the ImGui data
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    GLState::invalidate(); // ImGui sets GL state directly
 }
 
 
+// Maps the unit cube to the bounding box of scene object i
+static glm::mat4 boundingBox(size_t i) {
+    glm::mat4 box = glm::translate(glm::mat4(1.0f), 0.5f * (scene.boundsMin[i] + scene.boundsMax[i]));
+    return glm::scale(box, scene.boundsMax[i] - scene.boundsMin[i]);
+}
+
+// Issues the draws of one render queue item and returns the number of
+// draw calls. The depth pre-pass (depthOnly) draws the same geometry with
+// the same uniforms, but leaves the triangle counts alone.
+static size_t drawItem(const DrawItem& item, size_t selected, bool depthOnly) {
+    switch (item.kind) {
+    case DrawItem::STATIC_MODEL: {
+        bool isHighlighted = (item.index == selected);
+        shader.setTransform(scene.transforms[item.index]);
+        shader.setGeometry(*scene.meshes[item.index]);
+        shader.setUniforms(isHighlighted, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.8f, 0.8f, 0.8f, 0.8f)); // Red for highlight, translucent white otherwise
+        scene.meshes[item.index]->draw();
+        break;
+    }
+    case DrawItem::PLACEHOLDER: {
+        shader.setTransform(scene.transforms[item.index]);
+        shader.model = shader.model * boundingBox(item.index);
+        shader.setGeometry(cube);
+        shader.setUniforms(item.index == selected);
+        GLState::polygonMode(GL_LINE);
+        cube.draw();
+        GLState::polygonMode(bWireframe ? GL_LINE : GL_FILL);
+        break;
+    }
+    case DrawItem::LOADED_MODEL: {
+        Obj& mesh = *scene.meshes[item.index];
+        size_t lod = scene.lods[item.index];
+        shader.setTransform(scene.transforms[item.index]);
+        shader.setGeometry(mesh);
+        shader.setUniforms(item.index == selected); // Apply red highlight color
+        size_t culled = 0;
+        if (meshletCulling && lod == 0)
+            culled = mesh.drawCulled(camera.view * scene.transforms[item.index].world(), camera.proj);
+        else
+            mesh.drawLod(lod);
+        if (depthOnly)
+            break;
+        if (lod < mesh.lods.size())
+            trianglesDrawn += mesh.lods[lod].count / 3 - culled;
+        else
+            trianglesDrawn += mesh.count / 3 - culled;
+        trianglesCulled += culled;
+        break;
+    }
+    case DrawItem::INSTANCE_GROUP: {
+        // the model matrices come from the instance buffer
+        const InstanceGroup& group = instances.groups()[item.index];
+        shader.setTransform(glm::mat4(1.0f));
+        shader.setGeometry(*group.mesh);
+        shader.setUniforms(false);
+        instances.draw(group);
+        break;
+    }
+    case DrawItem::INDIRECT:
+        // the position decoding comes from the instance buffer too
+        shader.setTransform(glm::mat4(1.0f));
+        shader.positionScale = glm::vec3(1.0f);
+        shader.positionBias = glm::vec3(0.0f);
+        shader.setUniforms(false);
+        return instances.drawIndirect(pool);
+    }
+    return 1;
+}
+
 void renderModels() {
-    glUseProgram(shader.program);
-    camera.computeMatrices();
+    // Point lights, binned into the clusters of this frame's view
+    if (clusteredLighting) {
+        lightClusters.build(lights, camera.view * sceneRoot.world(), camera.fovy, camera.aspect, camera.nearDist,
+                            camera.farDist);
+        lightClusters.upload();
+        lightClusters.bind(lightUnit);
+    }
 
-    // Loop through static models
-    for (size_t i = 0; i < std::size(models); ++i) {
-        bool isHighlighted = (i == selectedModelIndex);
-        glm::vec4 highlightColor = isHighlighted ? glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(0.8f, 0.8f, 0.8f, 0.8f); // Red for highlight, white otherwise
+    GLState::useProgram(shader.program);
+    shader.view = camera.view;
+    shader.projection = camera.proj;
+    shader.clusterScale = glm::vec4(static_cast<float>(LightClusters::tilesX) / viewportWidth,
+                                    static_cast<float>(LightClusters::tilesY) / viewportHeight,
+                                    lightClusters.depthScale(), lightClusters.depthBias());
+    shader.clusterSize = glm::uvec4(LightClusters::tilesX, LightClusters::tilesY, LightClusters::slices,
+                                    clusteredLighting ? static_cast<uint32_t>(lights.size()) : 0u);
+    shader.setFrame();
+
+    // World matrices and bounds of the objects whose transform changed
+    // (all of them while the scene root turns), and bounds of the ones
+    // whose mesh has just started its upload; the placeholder box is the
+    // real bounds from then on
+    scene.updateWorlds();
+    culler.resize(scene.size());
+    for (size_t i = 0; i < scene.size(); ++i) {
+        if ((scene.flags[i] & SceneStore::BOUNDS_PENDING) && scene.meshes[i]->hasBounds) {
+            scene.boundsMin[i] = scene.meshes[i]->boundsMin;
+            scene.boundsMax[i] = scene.meshes[i]->boundsMax;
+            scene.flags[i] &= ~SceneStore::BOUNDS_PENDING;
+            culler.boundsVersion[i] = 0;
+        }
+        const Transform& transform = scene.transforms[i];
+        culler.updateBounds(i, transform.version(), transform.world(), scene.boundsMin[i], scene.boundsMax[i]);
+    }
+
+    // Frustum culling
+    Frustum frustum;
+    frustum.update(camera.proj * camera.view);
+    auto cullStart = std::chrono::steady_clock::now();
+    modelsVisible = culler.cull(frustum);
+    cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+
+    // Occlusion culling: the coarsest levels of the nearest visible models
+    // are rasterized on the CPU, and every visible model is tested against them
+    modelsOccluded = 0;
+    if (occlusionMode == OCCLUSION_CPU) {
+        auto occlusionStart = std::chrono::steady_clock::now();
+        occluderCandidates.clear();
+        for (size_t i = 0; i < scene.size(); ++i) {
+            const Obj& mesh = *scene.meshes[i];
+            if (culler.visible[i] && !(scene.flags[i] & SceneStore::STATIC) && mesh.ready && !mesh.occluderIndices.empty())
+                occluderCandidates.push_back({ -(camera.view * scene.transforms[i].world()[3]).z, i });
+        }
+        size_t occluders = std::min(occluderCandidates.size(), static_cast<size_t>(maxOccluders));
+        std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + occluders, occluderCandidates.end());
+
+        occlusion.begin(camera.proj * camera.view);
+        for (size_t k = 0; k < occluders; ++k) {
+            size_t i = occluderCandidates[k].second;
+            const Obj& mesh = *scene.meshes[i];
+            occlusion.addOccluder(mesh.occluderPositions.data(), mesh.occluderIndices.data(), mesh.occluderIndices.size(),
+                                  scene.transforms[i].world());
+        }
+        occlusion.rasterize();
 
-        // Apply rotation matrix to model's transformation matrix
-        models[i]->model = rotationMatrix * models[i]->model;
+        modelsOccluded = occlusion.cull(culler);
+        occlusionMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - occlusionStart).count();
+    }
 
-        shader.modelview = camera.view * models[i]->model;
-        shader.setUniforms(isHighlighted, glm::vec3(highlightColor)); // Set highlight color
-        models[i]->draw();
+    // GPU occlusion queries: the results of earlier frames decide which
+    // models are drawn one by one with a query; the others are drawn as usual
+    bool gpuOcclusion = (occlusionMode == OCCLUSION_GPU);
+    if (gpuOcclusion) {
+        queries.beginFrame(culler.size());
+        glm::vec3 eye = glm::vec3(glm::inverse(camera.view)[3]);
+        float margin = 4.0f * camera.nearDist; // the near plane clips boxes closer than that
+        for (size_t i = 0; i < culler.size(); ++i) {
+            // the box of a model around the camera would hide the model
+            bool aroundEye = eye.x > culler.minX[i] - margin && eye.x < culler.maxX[i] + margin &&
+                             eye.y > culler.minY[i] - margin && eye.y < culler.maxY[i] + margin &&
+                             eye.z > culler.minZ[i] - margin && eye.z < culler.maxZ[i] + margin;
+            if (!culler.visible[i] || aroundEye)
+                queries.reset(i);
+        }
     }
+    auto queryAction = [gpuOcclusion](size_t object) {
+        return gpuOcclusion ? queries.action(object) : OcclusionQueries::DRAW;
+    };
+
+    // view * model of every visible object in one batch, read from the
+    // scene's world matrices
+    auto modelviewStart = std::chrono::steady_clock::now();
+    visibleObjects.clear();
+    for (size_t i = 0; i < scene.size(); ++i)
+        if (culler.visible[i])
+            visibleObjects.push_back(static_cast<uint32_t>(i));
+    BatchMath::multiply(camera.view, scene.worlds, visibleObjects.data(), visibleModelviews, visibleObjects.size());
+    modelviewMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - modelviewStart).count();
+
+    // Collect the visible draws into the render queue; the depth of a
+    // draw is the view distance of its bounds' center
+    auto viewDepth = [](const glm::mat4& modelview, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        glm::vec4 center = modelview * glm::vec4(0.5f * (boundsMin + boundsMax), 1.0f);
+        return -center.z / farPlane;
+    };
+    auto enqueue = [](DrawItem::Kind kind, size_t index, RenderPass pass, GLuint vao, float depth,
+                      OcclusionQueries::Action query = OcclusionQueries::DRAW) {
+        renderQueue.push(RenderQueue::makeKey(pass, shader.program, vao, depth), static_cast<uint32_t>(drawItems.size()));
+        drawItems.push_back({ kind, static_cast<uint32_t>(index), query });
+    };
+    renderQueue.clear();
+    drawItems.clear();
+
+    // One pass over the scene objects
+    size_t selected = scene.indexOf(selectedObject);
+    trianglesDrawn = 0;
+    trianglesCulled = 0;
+    float maxErrorPixels = std::exp2(lodBias);
+    bool indirect = (submitPath == SUBMIT_INDIRECT);
+    size_t draws = 0;
+    auto submitStart = std::chrono::steady_clock::now();
+    instances.begin();
+    for (size_t k = 0; k < visibleObjects.size(); ++k) {
+        size_t i = visibleObjects[k];
+        Obj& mesh = *scene.meshes[i];
+        bool isHighlighted = (i == selected);
+        const glm::mat4& model = scene.transforms[i].world();
+        glm::mat4 modelview = BatchMath::load(visibleModelviews, k);
+        float depth = viewDepth(modelview, scene.boundsMin[i], scene.boundsMax[i]);
+
+        // Static models are translucent unless highlighted
+        if (scene.flags[i] & SceneStore::STATIC) {
+            enqueue(DrawItem::STATIC_MODEL, i, isHighlighted ? PASS_OPAQUE : PASS_TRANSLUCENT, mesh.vao, depth, queryAction(i));
+            continue;
+        }
 
-    // Render dynamically loaded models
-    for (const auto& loadedModel : loadedModels) {
-        if (!loadedModel) {
-            // Skip if the model is null (safety check)
+        if (!mesh.ready) {
+            // The bounding box stands in until the mesh is on the GPU
+            enqueue(DrawItem::PLACEHOLDER, i, PASS_OPAQUE, cube.vao, depth);
             continue;
         }
 
-        bool isHighlighted = false;
-        if (selectedModelIndex >= 0 && selectedModelIndex < loadedModels.size()) {
-            isHighlighted = (loadedModel == loadedModels[selectedModelIndex]);
+        size_t lod = mesh.selectLod(modelview, camera.proj, static_cast<float>(viewportHeight), maxErrorPixels);
+        scene.lods[i] = static_cast<uint32_t>(lod);
+
+        // Instances of shared meshes are drawn together; the indirect
+        // path copies each mesh into the pool the first time it is drawn.
+        // Models that need an occlusion query are drawn on their own.
+        OcclusionQueries::Action query = queryAction(i);
+        if (indirect && mesh.supportsInstancing())
+            pool.add(mesh);
+        if (submitPath != SUBMIT_DIRECT && mesh.supportsInstancing() && query == OcclusionQueries::DRAW) {
+            instances.add(&mesh, lod, model, isHighlighted, depth);
+            trianglesDrawn += mesh.lods[lod].count / 3;
+            continue;
         }
+        enqueue(DrawItem::LOADED_MODEL, i, PASS_OPAQUE, mesh.vao, depth, query);
+    }
 
-        // Apply rotation matrix to dynamic models
-        loadedModel->model = rotationMatrix * loadedModel->model;
-        shader.modelview = camera.view * loadedModel->model;
-        shader.setUniforms(isHighlighted, glm::vec3(1.0f, 0.0f, 0.0f)); // Apply red highlight color
-        loadedModel->draw();
+    // One instanced draw per mesh and level of detail, or one multi-draw
+    // per pool storage for all of them
+    instances.upload();
+    if (indirect && !instances.groups().empty())
+        enqueue(DrawItem::INDIRECT, 0, PASS_OPAQUE, pool.storageCount() ? pool.vertexArray(0) : 0, 0.0f);
+    else if (!indirect) {
+        for (size_t g = 0; g < instances.groups().size(); g++) {
+            const InstanceGroup& group = instances.groups()[g];
+            enqueue(DrawItem::INSTANCE_GROUP, g, PASS_OPAQUE, group.mesh->vao, group.depth);
+        }
+    }
+
+    auto sortStart = std::chrono::steady_clock::now();
+    renderQueue.sort();
+    sortMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sortStart).count();
+
+    // Depth pre-pass: the opaque draws (front-to-back, they come first)
+    // write depth with the position-only program and no color, so the
+    // color pass shades each pixel once. Models with occlusion queries
+    // are left to the color pass, where their draws are the test.
+    // In the deferred path both passes draw into the G-buffer.
+    bool deferred = (shadingPath == SHADING_DEFERRED) && gbuffer.resize(viewportWidth, viewportHeight);
+    int path = deferred ? SHADING_DEFERRED : SHADING_FORWARD;
+    GLuint opaqueProgram = deferred ? gbufferShader.program : shader.program;
+    if (deferred)
+        gbuffer.bind();
+    bool prePass = depthPrePass;
+    auto prePassed = [prePass](const DrawItem& item, uint64_t key) {
+        return prePass && RenderQueue::passOf(key) == PASS_OPAQUE && item.query == OcclusionQueries::DRAW;
+    };
+    if (prePass) {
+        prePassTimer.begin();
+        GLState::useProgram(depthShader.program);
+        GLState::colorMask(false);
+        for (size_t q = 0; q < renderQueue.size(); q++) {
+            const DrawItem& item = drawItems[renderQueue.item(q)];
+            if (prePassed(item, renderQueue.key(q)))
+                draws += drawItem(item, selected, true);
+        }
+        GLState::colorMask(true);
+        prePassTimer.end();
+    }
+    GLState::useProgram(opaqueProgram);
+
+    // End of the opaque draws. The deferred path lights the G-buffer into
+    // the window with one full screen triangle, which also copies the
+    // depth for the translucent draws; those stay forward shaded.
+    bool countSamples = (occlusionMode != OCCLUSION_GPU);
+    bool opaqueDone = false;
+    auto finishOpaque = [&]() {
+        opaqueDone = true;
+        if (countSamples)
+            opaqueSamples.end();
+        if (!deferred)
+            return;
+        GBuffer::unbind();
+        gbuffer.bindTextures(gbufferUnit);
+        GLState::useProgram(deferredShader.program);
+        GLState::depthFunc(GL_ALWAYS);
+        GLState::depthMask(true);
+        GLState::polygonMode(GL_FILL);
+        GLState::bindVertexArray(fullScreenVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        GLState::polygonMode(bWireframe ? GL_LINE : GL_FILL);
+        GLState::depthFunc(GL_LESS);
+        GLState::useProgram(shader.program);
+        draws++;
+    };
+
+    // Submit in key order: opaque front-to-back per mesh, then the
+    // translucent draws back-to-front with blending and no depth writes.
+    // After the pre-pass, the opaque draws only pass where they wrote the
+    // depth (GL_EQUAL, as both programs compute the same gl_Position).
+    colorPassTimer.begin();
+    if (countSamples)
+        opaqueSamples.begin();
+    bool blending = false;
+    for (size_t q = 0; q < renderQueue.size(); q++) {
+        if (RenderQueue::passOf(renderQueue.key(q)) == PASS_TRANSLUCENT && !blending) {
+            finishOpaque();
+            GLState::enable(GL_BLEND);
+            GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            blending = true;
+        }
+
+        const DrawItem& item = drawItems[renderQueue.item(q)];
+        bool depthDone = prePassed(item, renderQueue.key(q));
+        GLState::depthFunc(depthDone ? GL_EQUAL : GL_LESS);
+        GLState::depthMask(!depthDone && !blending);
+        size_t calls = 0;
+
+        // Occlusion queries: hidden models test their bounding box first
+        // (front-to-back, so after their occluders) and are only drawn if
+        // it passes; visible models are tested by their own draw
+        size_t object = item.index;
+        if (item.query == OcclusionQueries::TEST_BOX) {
+            GLState::colorMask(false);
+            GLState::depthMask(false);
+            GLState::polygonMode(GL_FILL);
+            shader.setTransform(scene.transforms[object]);
+            shader.model = shader.model * boundingBox(object);
+            shader.setGeometry(cube);
+            shader.setUniforms(false);
+            queries.beginQuery(object);
+            cube.draw();
+            queries.endQuery();
+            GLState::polygonMode(bWireframe ? GL_LINE : GL_FILL);
+            GLState::colorMask(true);
+            GLState::depthMask(!blending);
+            calls++;
+        }
+        if (item.query == OcclusionQueries::DRAW_QUERIED)
+            queries.beginQuery(object);
+        else if (item.query != OcclusionQueries::DRAW)
+            queries.beginConditional(object);
+
+        calls += drawItem(item, selected, false);
+
+        if (item.query == OcclusionQueries::DRAW_QUERIED)
+            queries.endQuery();
+        else if (item.query != OcclusionQueries::DRAW)
+            queries.endConditional();
+        draws += calls;
     }
+    if (!opaqueDone)
+        finishOpaque();
+    if (blending)
+        GLState::disable(GL_BLEND);
+    GLState::depthFunc(GL_LESS);
+    GLState::depthMask(true);
+    colorPassTimer.end();
+    if (colorPassTimer.hasResult())
+        gpuMilliseconds[path][prePass] = prePassTimer.milliseconds() + colorPassTimer.milliseconds();
+
+    // Framebuffer traffic of the opaque part, from the samples that passed
+    // the depth test: forward writes color and depth (8 bytes) per sample;
+    // deferred writes the G-buffer (12) per sample, then clears and reads
+    // it, and writes color and depth, per pixel. Depth test reads and the
+    // translucent draws are the same for both and left out.
+    if (countSamples && opaqueSamples.hasResult()) {
+        double samples = static_cast<double>(opaqueSamples.result());
+        double pixels = static_cast<double>(viewportWidth) * viewportHeight;
+        double bytes = deferred ? samples * GBuffer::bytesPerPixel + pixels * (2 * GBuffer::bytesPerPixel + 8)
+                                : samples * 8;
+        frameMegabytes[path] = bytes * 1e-6;
+    }
+    drawCalls[submitPath] = draws;
+    submitMilliseconds[submitPath] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
 }
 
 void display() 
 {
-    if (bWireframe)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glCallsIssued = GLState::issued();
+    glCallsSkipped = GLState::skipped();
+    GLState::resetCounters();
+
+    GLState::polygonMode(bWireframe ? GL_LINE : GL_FILL);
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     camera.computeMatrices();
     shader.projection = camera.proj; // Update projection matrix
 
+    // Finish background loads within this frame's upload budget
+    assets.loader.pump(static_cast<size_t>(uploadBudgetMB * 1024.0f * 1024.0f));
+    if (assets.loader.failedCount() != loadsFailed) {
+        // the instances of meshes that failed to load would keep their placeholder
+        loadsFailed = assets.loader.failedCount();
+        removeObjects([](size_t i) { return scene.meshes[i]->failed; });
+    }
+
+    uniforms.beginFrame();
     renderModels();  // Render 3D models
+    stepLightSweep();
+    uniforms.endFrame();
     renderUI();      // Render ImGui UI
 
     glutSwapBuffers();
@@ -317,6 +1049,20 @@ void display()
 
 // Cleanup Function
 void cleanup() {
+    // Free the models while the GL context still exists
+    assets.loader.cancelAll();
+    scene.clear();
+    instances.begin();
+    instances.release();
+    pool.release();
+    queries.release();
+    prePassTimer.release();
+    colorPassTimer.release();
+    opaqueSamples.release();
+    gbuffer.release();
+    GLState::deleteVertexArrays(1, &fullScreenVao);
+    lightClusters.release();
+    uniforms.release();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGLUT_Shutdown();
     ImGui::DestroyContext();
@@ -347,16 +1093,39 @@ void onMouseClick(int button, int state, int x, int y) {
     }
 }
 
-bool rayIntersectsModel(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, Geometry* model, float radius) {
-    glm::vec3 modelPos = glm::vec3(model->model[3]); // Extract position from the model matrix
-    glm::vec3 oc = rayOrigin - modelPos;
-
-    float a = glm::dot(rayDirection, rayDirection);
-    float b = 2.0f * glm::dot(oc, rayDirection);
-    float c = glm::dot(oc, oc) - radius * radius;
+// Slab test of a ray against a world space box; distance is where the ray enters it
+bool rayIntersectsBox(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const glm::vec3& boxMin,
+                      const glm::vec3& boxMax, float& distance) {
+    float enter = 0.0f, leave = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.0f / rayDirection[axis]; // infinite for rays parallel to the slab
+        float t0 = (boxMin[axis] - rayOrigin[axis]) * inverse;
+        float t1 = (boxMax[axis] - rayOrigin[axis]) * inverse;
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+    }
+    distance = enter;
+    return enter <= leave;
+}
 
-    float discriminant = b * b - 4 * a * c;
-    return discriminant > 0; // Intersection occurs if the discriminant is positive
+// The nearest scene object whose world bounds are under the mouse
+SceneHandle pickObject(int x, int y) {
+    ImVec2 size = ImGui::GetIO().DisplaySize;
+    glm::vec3 direction = screenToWorldRay(x, y, static_cast<int>(size.x), static_cast<int>(size.y), camera.proj, camera.view);
+    glm::vec3 origin = glm::vec3(glm::inverse(camera.view)[3]);
+    size_t nearest = SceneStore::npos;
+    float nearestDistance = FLT_MAX;
+    size_t count = std::min(scene.size(), culler.size()); // bounds of the last frame
+    for (size_t i = 0; i < count; i++) {
+        float distance;
+        if (rayIntersectsBox(origin, direction, glm::vec3(culler.minX[i], culler.minY[i], culler.minZ[i]),
+                             glm::vec3(culler.maxX[i], culler.maxY[i], culler.maxZ[i]), distance) &&
+            distance < nearestDistance) {
+            nearest = i;
+            nearestDistance = distance;
+        }
+    }
+    return nearest == SceneStore::npos ? SceneHandle() : scene.handle(nearest);
 }
 
 
@@ -367,6 +1136,7 @@ void mouseCallback(int button, int state, int x, int y) {
         // Add your custom mouse handling logic here
         if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
             std::cout << "Left mouse button clicked at (" << x << ", " << y << ")" << std::endl;
+            selectedObject = pickObject(x, y);
         }
     }
 
@@ -378,21 +1148,22 @@ bool isDragging = false;
 bool isMoving = false;  // Track if the user is moving instead of rotating
 
 void mouseDrag(int x, int y) {
-    if (selectedModelIndex != -1 && isDragging) {
-        Geometry* selectedModel = models[selectedModelIndex];
+    size_t selected = scene.indexOf(selectedObject);
+    if (selected != SceneStore::npos && isDragging) {
+        Transform& transform = scene.transforms[selected];
 
         int dx = x - lastMouseX;
         int dy = y - lastMouseY;
 
         // If moving, translate the object
         if (isMoving) {
-            selectedModel->model = glm::translate(selectedModel->model, glm::vec3(dx * 0.01f, -dy * 0.01f, 0.0f));
+            transform.translate(glm::vec3(dx * 0.01f, -dy * 0.01f, 0.0f));
         }
         else {
             // If rotating, apply rotation based on mouse movement
             float rotateSpeed = 0.5f;
-            selectedModel->model = glm::rotate(selectedModel->model, glm::radians(dx * rotateSpeed), glm::vec3(0, 1, 0));
-            selectedModel->model = glm::rotate(selectedModel->model, glm::radians(dy * rotateSpeed), glm::vec3(1, 0, 0));
+            transform.rotate(glm::angleAxis(glm::radians(dx * rotateSpeed), glm::vec3(0.0f, 1.0f, 0.0f)));
+            transform.rotate(glm::angleAxis(glm::radians(dy * rotateSpeed), glm::vec3(1.0f, 0.0f, 0.0f)));
         }
 
         lastMouseX = x;
@@ -428,14 +1199,15 @@ void RenderObjectManipulationUI() {
     }
 
     // If a model is selected, we show the position/rotation data and allow manipulation
-    if (selectedModelIndex != -1) {
-        Geometry* selectedModel = models[selectedModelIndex];
+    size_t selected = scene.indexOf(selectedObject);
+    if (selected != SceneStore::npos) {
+        Transform& transform = scene.transforms[selected];
 
         ImGui::Text("Manipulate Model:");
 
         // Show the current position and rotation values
-        glm::vec3 position = glm::vec3(selectedModel->model[3]); // Assuming model is a 4x4 matrix
-        glm::vec3 rotation = glm::eulerAngles(glm::quat_cast(selectedModel->model)); // Convert matrix to Euler angles
+        glm::vec3 position = transform.position();
+        glm::vec3 rotation = glm::eulerAngles(transform.rotation()); // Convert quaternion to Euler angles
 
         ImGui::Text("Position: %.2f, %.2f, %.2f", position.x, position.y, position.z);
         ImGui::Text("Rotation: %.2f, %.2f, %.2f", rotation.x, rotation.y, rotation.z);
@@ -445,13 +1217,29 @@ void RenderObjectManipulationUI() {
         ImGui::SliderFloat("Move Y", &position.y, -10.0f, 10.0f);
         ImGui::SliderFloat("Move Z", &position.z, -10.0f, 10.0f);
 
-        selectedModel->model = glm::translate(glm::mat4(1.0f), position); // Update position using the sliders
+        transform.setPosition(position); // Update position using the sliders
     }
 
     ImGui::End();
 }
 
 int main(int argc, char** argv) {
+    // CPU-only benchmarks run without a window
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-occlusion") == 0)
+            return OcclusionCuller::benchmark();
+        if (strcmp(argv[i], "--bench-culling") == 0)
+            return FrustumCuller::benchmark();
+        if (strcmp(argv[i], "--bench-sort") == 0)
+            return RenderQueue::benchmark();
+        if (strcmp(argv[i], "--bench-scene") == 0)
+            return SceneStore::benchmark();
+        if (strcmp(argv[i], "--bench-math") == 0)
+            return BatchMath::benchmark();
+        if (strcmp(argv[i], "--bench-lights") == 0)
+            return LightClusters::benchmark();
+    }
+
     // Initialize GLUT and GLEW
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
@@ -470,6 +1258,7 @@ int main(int argc, char** argv) {
     glutMotionFunc(motionFunc);
     glutPassiveMotionFunc(motionFunc);
     glutIdleFunc(glutPostRedisplay);
+    glutCloseFunc(cleanup);
 
     // ImGui-specific mouse handling
     glutMouseFunc(mouseCallback);